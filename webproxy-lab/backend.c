@@ -0,0 +1,120 @@
+/*
+ * backend.c - 리버스 프록시 모드의 backend 풀
+ */
+#include "backend.h"
+#include "conf.h"
+
+#define BACKEND_MAX 64
+
+static backend_t backends[BACKEND_MAX];
+static int nbackends;
+static int leastconn;        /* 1이면 leastconn, 0이면 p2c */
+static unsigned int rr;      /* leastconn 동점일 때 훑기 시작할 위치 */
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread unsigned int seed;  /* p2c 난수 (스레드별) */
+
+int backend_init(void)
+{
+  char *list, *item, *save, *colon;
+  backend_t *b;
+
+  if (!conf.backends || !*conf.backends)
+    return 0;
+  if (!strcmp(conf.backend_policy, "leastconn"))
+    leastconn = 1;
+  else if (strcmp(conf.backend_policy, "p2c"))
+    return -1;
+
+  list = strdup(conf.backends);
+  for (item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+    /* host, port 는 요청의 hostname[NI_MAXHOST], port[NI_MAXSERV] 로 복사되므로 길이도 확인 */
+    if (nbackends == BACKEND_MAX || (colon = strrchr(item, ':')) == NULL ||
+        colon == item || !colon[1] || colon - item >= NI_MAXHOST || strlen(colon + 1) >= NI_MAXSERV)
+      return -1;
+    *colon = '\0';
+    b = &backends[nbackends++];
+    b->host = item;
+    b->port = colon + 1;
+    b->origin = origin_get(b->host, b->port);
+  }
+  return nbackends;
+}
+
+int backend_enabled(void)
+{
+  return nbackends > 0;
+}
+
+backend_t *backend_pick(void)
+{
+  backend_t *cand[BACKEND_MAX], *best;
+  long long now = msec_now();
+  int i, n = 0, a, c, start, load, best_load;
+
+  pthread_mutex_lock(&backend_lock);
+  for (i = 0; i < nbackends; i++)
+    if (backends[i].down_until <= now)
+      cand[n++] = &backends[i];
+  if (n == 0) {
+    /* 모두 down 이면 전부 후보: 그중 살아난 게 있는지 요청으로 확인 */
+    for (i = 0; i < nbackends; i++)
+      cand[i] = &backends[i];
+    n = nbackends;
+  }
+  start = rr++;
+  pthread_mutex_unlock(&backend_lock);
+
+  if (n == 1)
+    return cand[0];
+  if (!leastconn) {
+    if (!seed)
+      seed = (unsigned int)(uintptr_t)&seed ^ (unsigned int)now;
+    a = rand_r(&seed) % n;
+    c = rand_r(&seed) % (n - 1);
+    if (c >= a)
+      c++;
+    return origin_inflight(cand[c]->origin) < origin_inflight(cand[a]->origin) ? cand[c] : cand[a];
+  }
+
+  best = NULL;
+  best_load = 0;
+  for (i = 0; i < n; i++) {
+    c = (start + i) % n;
+    load = origin_inflight(cand[c]->origin);
+    if (!best || load < best_load) {
+      best = cand[c];
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+void backend_result(backend_t *b, int connect_ok)
+{
+  pthread_mutex_lock(&backend_lock);
+  if (connect_ok) {
+    b->fails = 0;
+  } else if (++b->fails >= conf.backend_max_fails) {
+    b->fails = 0;
+    b->down_until = msec_now() + conf.backend_down_ms;
+    fprintf(stderr, "backend down: %s:%s for %d ms\n", b->host, b->port, conf.backend_down_ms);
+  }
+  pthread_mutex_unlock(&backend_lock);
+}
+
+int backend_stats(char *buf, size_t size)
+{
+  long long now = msec_now();
+  size_t len = 0;
+  int i, n;
+
+  for (i = 0; i < nbackends && len < size; i++) {
+    pthread_mutex_lock(&backend_lock);
+    n = snprintf(buf + len, size - len, "backend %s:%s inflight %d down %d\n",
+                 backends[i].host, backends[i].port, origin_inflight(backends[i].origin),
+                 backends[i].down_until > now);
+    pthread_mutex_unlock(&backend_lock);
+    len += n;
+  }
+  return len < size ? (int)len : (int)size - 1;
+}
@@ -0,0 +1,36 @@
+/*
+ * backend.h - 리버스 프록시 모드의 backend 풀
+ *
+ * backends 설정("host:port,host:port,...")이 있으면 프록시는 origin-form
+ * 요청(GET /path)을 URI 대신 이 풀에서 고른 서버로 보낸다. 고르는 기준은
+ * backend 에 나가 있는 요청 수 (origin_inflight):
+ *   p2c        임의의 두 개를 뽑아 덜 바쁜 쪽 (power of two choices)
+ *   leastconn  전체 중 가장 덜 바쁜 쪽
+ * 연결에 연속으로 backend_max_fails 번 실패한 backend 는 backend_down_ms
+ * 동안 후보에서 빠진다 (passive health check). 모두 빠졌으면 전부 후보로 둔다.
+ */
+#ifndef __BACKEND_H__
+#define __BACKEND_H__
+
+#include "origin.h"
+
+typedef struct {
+  char *host, *port;
+  origin_t *origin;      /* 연결 풀, breaker, 진행 중인 요청 수 */
+  int fails;             /* 연속 연결 실패 횟수 */
+  long long down_until;  /* 이 시각까지 후보에서 제외 */
+} backend_t;
+
+/* conf.backends 를 읽음. backend 수 (설정이 없으면 0), 형식이 틀렸거나 host/port 가 너무 길면 -1 */
+int backend_init(void);
+int backend_enabled(void);
+
+backend_t *backend_pick(void);
+
+/* 고른 backend 에 연결이 됐는지 (origin_checkout 결과) 알려줌 */
+void backend_result(backend_t *b, int connect_ok);
+
+/* backend 별 상태를 /stats 형식으로 buf 에. 쓴 길이 */
+int backend_stats(char *buf, size_t size);
+
+#endif /* __BACKEND_H__ */
@@ -0,0 +1,254 @@
+/*
+ * parse_bench.c - 요청 헤더 파싱 벤치마크
+ *
+ * 같은 요청을 rio 버퍼에 넣어두고 (소켓 읽기 없이) 파싱만 반복해서 초당 요청 수를
+ * 잰다. 비교하는 두 경로:
+ *   legacy   - 예전 proxy.c 방식: rio_readlineb 로 줄마다 복사, sscanf 로 요청 줄,
+ *              parse_uri 로 URI 를 자르고, 헤더는 strncasecmp 사슬
+ *   httpparse - 지금 방식: hp_parse_request 로 rio 버퍼 위에서 한 번 훑고,
+ *              요청 전체를 한 번 복사해 두고 (pipelining 때문에), 헤더는 hname 으로 분류
+ * 두 경로 모두 캐시 키와 origin 으로 넘길 헤더(fwd)까지 만든다.
+ *
+ * usage: parse_bench [-n requests] [-h extra headers]
+ */
+#include "csapp.h"
+#include "httpparse.h"
+
+static char req[RIO_BUFSIZE];
+static size_t reqlen;
+
+/* 예전 request_t/reqhdrs_t 에서 파싱이 채우던 부분 */
+typedef struct {
+  char method[MAXLINE], uri[MAXLINE], version[MAXLINE];
+  char hostname[MAXLINE], path[MAXLINE], port[MAXLINE];
+  char key[MAXLINE];
+  char fwd[MAXBUF];
+  size_t fwdlen;
+  long long clen;
+  int chunked, conn_close, conn_keepalive;
+  char host[MAXLINE];
+} legacy_t;
+
+typedef struct {
+  char raw[RIO_BUFSIZE];
+  hp_msg_t hp;
+  char hostname[NI_MAXHOST], port[NI_MAXSERV];
+  char key[MAXLINE];
+  char fwd[MAXBUF];
+  size_t fwdlen;
+  long long clen;
+  int chunked, conn_close, conn_keepalive;
+  hp_str_t host;
+} fast_t;
+
+/* rio 를 소켓 없이 req 로 채운 상태로 */
+static void rio_load(rio_t *rp)
+{
+  rp->rio_fd = -1;
+  rp->rio_cnt = reqlen;
+  rp->rio_bufptr = rp->rio_buf;
+}
+
+static void parse_uri(char *uri, char *hostname, char *path, char *port)
+{
+  char *hostbegin, *pathbegin, *portbegin;
+
+  hostbegin = strncasecmp(uri, "http://", 7) ? uri : uri + 7;
+  if ((pathbegin = strchr(hostbegin, '/'))) {
+    strcpy(path, pathbegin);
+    *pathbegin = '\0';
+  } else
+    path[0] = '\0';
+  if ((portbegin = strchr(hostbegin, ':'))) {
+    *portbegin = '\0';
+    strcpy(hostname, hostbegin);
+    strcpy(port, portbegin + 1);
+  } else {
+    strcpy(hostname, hostbegin);
+    strcpy(port, "80");
+  }
+}
+
+static int legacy_parse(rio_t *rp, legacy_t *q)
+{
+  char buf[MAXLINE], *end;
+  ssize_t n;
+
+  if (rio_readlineb(rp, buf, MAXLINE) <= 0)
+    return -1;
+  if (sscanf(buf, "%s %s %s", q->method, q->uri, q->version) != 3)
+    return -1;
+  strcpy(buf, q->uri);
+  parse_uri(buf, q->hostname, q->path, q->port);
+  snprintf(q->key, sizeof(q->key), "%s:%s%s", q->hostname, q->port, q->path);
+
+  q->fwdlen = 0;
+  q->clen = -1;
+  q->chunked = q->conn_close = q->conn_keepalive = 0;
+  q->host[0] = '\0';
+  while (1) {
+    if ((n = rio_readlineb(rp, buf, MAXLINE)) <= 0)
+      return -1;
+    if (!strcmp(buf, "\r\n"))
+      break;
+    if (!strncasecmp(buf, "Connection:", 11) || !strncasecmp(buf, "Proxy-Connection:", 17)) {
+      for (end = strchr(buf, ':') + 1; *end; end++) {
+        if (!strncasecmp(end, "close", 5))
+          q->conn_close = 1;
+        else if (!strncasecmp(end, "keep-alive", 10))
+          q->conn_keepalive = 1;
+      }
+      continue;
+    }
+    if (!strncasecmp(buf, "Host:", 5))
+      sscanf(buf + 5, " %8191[^\r\n]", q->host);
+    if (!strncasecmp(buf, "Host:", 5) ||
+        !strncasecmp(buf, "User-Agent:", 11) ||
+        !strncasecmp(buf, "Keep-Alive:", 11)) continue;
+    if (!strncasecmp(buf, "Content-Length:", 15)) {
+      q->clen = strtoll(buf + 15, &end, 10);
+      continue;
+    }
+    if (!strncasecmp(buf, "Transfer-Encoding:", 18)) {
+      for (end = buf + 18; *end; end++)
+        if (!strncasecmp(end, "chunked", 7))
+          q->chunked = 1;
+      continue;
+    }
+    if (q->fwdlen + n <= sizeof(q->fwd)) {
+      memcpy(q->fwd + q->fwdlen, buf, n);
+      q->fwdlen += n;
+    }
+  }
+  return 0;
+}
+
+static int fast_parse(rio_t *rp, fast_t *q)
+{
+  hp_msg_t *hp = &q->hp;
+  hp_hdr_t *h;
+  int n, k;
+
+  hp_init(hp);
+  if ((n = hp_parse_request(hp, rp->rio_bufptr, rp->rio_cnt)) <= 0)
+    return -1;
+  memcpy(q->raw, rp->rio_bufptr, n);
+  hp_rebase(hp, q->raw);
+  rp->rio_bufptr += n;
+  rp->rio_cnt -= n;
+
+  snprintf(q->hostname, sizeof(q->hostname), "%.*s", (int)hp->host.len, hp->host.p);
+  if (hp->port.len)
+    snprintf(q->port, sizeof(q->port), "%.*s", (int)hp->port.len, hp->port.p);
+  else
+    strcpy(q->port, "80");
+  snprintf(q->key, sizeof(q->key), "%s:%s%.*s", q->hostname, q->port,
+           (int)hp->path.len, hp->path.p);
+
+  q->fwdlen = 0;
+  q->clen = -1;
+  q->chunked = q->conn_close = q->conn_keepalive = 0;
+  q->host.len = 0;
+  for (k = 0; k < hp->nhdr; k++) {
+    h = &hp->hdr[k];
+    switch (h->id) {
+    case HN_CONNECTION:
+    case HN_PROXY_CONNECTION:
+      if (hp_has(h->value, "close"))
+        q->conn_close = 1;
+      if (hp_has(h->value, "keep-alive"))
+        q->conn_keepalive = 1;
+      continue;
+    case HN_HOST:
+      q->host = h->value;
+      continue;
+    case HN_USER_AGENT:
+    case HN_KEEP_ALIVE:
+      continue;
+    case HN_CONTENT_LENGTH:
+      q->clen = hp_clen(h->value);
+      continue;
+    case HN_TRANSFER_ENCODING:
+      if (hp_has(h->value, "chunked"))
+        q->chunked = 1;
+      continue;
+    default:
+      break;
+    }
+    if (q->fwdlen + h->line.len <= sizeof(q->fwd)) {
+      memcpy(q->fwd + q->fwdlen, h->line.p, h->line.len);
+      q->fwdlen += h->line.len;
+    }
+  }
+  return 0;
+}
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  int n = 1000000, extra = 0, opt, i;
+  static rio_t rio;
+  static legacy_t lq;
+  static fast_t fq;
+  double t, legacy, fast;
+
+  while ((opt = getopt(argc, argv, "n:h:")) != -1) {
+    switch (opt) {
+    case 'n': n = atoi(optarg); break;
+    case 'h': extra = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-n requests] [-h extra headers]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  /* 브라우저가 보내는 정도의 요청 */
+  reqlen = snprintf(req, sizeof(req),
+    "GET http://www.example.com:8080/static/js/app.bundle.js?v=20261019 HTTP/1.1\r\n"
+    "Host: www.example.com:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"
+    "Accept: */*\r\n"
+    "Accept-Language: ko-KR,ko;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Referer: http://www.example.com:8080/index.html\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=ko\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Pragma: no-cache\r\n"
+    "Proxy-Connection: keep-alive\r\n");
+  for (i = 0; i < extra && reqlen < sizeof(req) - 64; i++)
+    reqlen += snprintf(req + reqlen, sizeof(req) - reqlen, "X-Extra-%d: value-%d\r\n", i, i);
+  reqlen += snprintf(req + reqlen, sizeof(req) - reqlen, "\r\n");
+  memcpy(rio.rio_buf, req, reqlen);
+
+  printf("request %zu bytes, %d requests\n", reqlen, n);
+
+  t = now();
+  for (i = 0; i < n; i++) {
+    rio_load(&rio);
+    if (legacy_parse(&rio, &lq) < 0)
+      app_error("legacy parse failed");
+  }
+  legacy = n / (now() - t);
+
+  t = now();
+  for (i = 0; i < n; i++) {
+    rio_load(&rio);
+    if (fast_parse(&rio, &fq) < 0)
+      app_error("httpparse failed");
+  }
+  fast = n / (now() - t);
+
+  if (strcmp(lq.key, fq.key) || lq.fwdlen != fq.fwdlen || memcmp(lq.fwd, fq.fwd, lq.fwdlen))
+    app_error("results differ");
+
+  printf("legacy     %10.0f req/s  %6.0f ns/req\n", legacy, 1e9 / legacy);
+  printf("httpparse  %10.0f req/s  %6.0f ns/req  (x%.2f)\n", fast, 1e9 / fast, fast / legacy);
+  return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * tunnel_bench.c - CONNECT 터널 처리량 벤치마크
+ *
+ * TLS 대신 평문 echo 서버를 같은 프로세스 안에 띄우고, 프록시에 CONNECT 로
+ * 터널을 연 뒤 바이트를 보내고 그대로 돌려받는 데 걸린 시간을 잰다.
+ * -d 를 주면 프록시 없이 echo 서버에 직접 붙어서 기준값을 잰다.
+ * -i 로 idle 터널을 먼저 열어두고, -p 로 프록시 pid를 주면 idle 터널을
+ * 열기 전후의 프록시 스레드 수와 RSS 를 보여준다.
+ *
+ * usage: tunnel_bench [-d] [-c conns] [-m MB] [-i idle] [-p pid] <proxy host> <proxy port>
+ */
+#include "csapp.h"
+
+#define CHUNK (64 * 1024)
+
+static char echo_port[16];
+static char *proxy_host, *proxy_port;
+static long long nbytes = 64LL * 1024 * 1024;
+static int direct;
+
+/* echo 서버 (TLS 없는 origin 대역) */
+static void *echo_conn(void *vargp)
+{
+  int fd = *(int *)vargp;
+  char buf[CHUNK];
+  ssize_t n;
+
+  Free(vargp);
+  Pthread_detach(pthread_self());
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    if (rio_writen(fd, buf, n) != n)
+      break;
+  close(fd);
+  return NULL;
+}
+
+static void *echo_server(void *vargp)
+{
+  int listenfd = *(int *)vargp;
+  pthread_t tid;
+  int *fdp;
+
+  while (1) {
+    fdp = Malloc(sizeof(int));
+    *fdp = Accept(listenfd, NULL, NULL);
+    Pthread_create(&tid, NULL, echo_conn, fdp);
+  }
+  return NULL;
+}
+
+/* 프록시를 통해(또는 직접) echo 서버로 가는 연결 하나 */
+static int open_tunnel(void)
+{
+  char buf[MAXLINE];
+  rio_t rio;
+  int fd;
+
+  if (direct)
+    return Open_clientfd("127.0.0.1", echo_port);
+
+  fd = Open_clientfd(proxy_host, proxy_port);
+  snprintf(buf, sizeof(buf), "CONNECT 127.0.0.1:%s HTTP/1.1\r\nHost: 127.0.0.1:%s\r\n\r\n",
+           echo_port, echo_port);
+  Rio_writen(fd, buf, strlen(buf));
+
+  /* 응답 헤더는 바이트 단위로 읽어서 터널 데이터를 rio 버퍼에 흘리지 않음 */
+  Rio_readinitb(&rio, fd);
+  if (Rio_readlineb(&rio, buf, sizeof(buf)) <= 0 || !strstr(buf, " 200 "))
+    app_error("CONNECT refused");
+  while (Rio_readlineb(&rio, buf, sizeof(buf)) > 0 && strcmp(buf, "\r\n"))
+    ;
+  return fd;
+}
+
+static void *sender(void *vargp)
+{
+  int fd = *(int *)vargp;
+  static char buf[CHUNK];
+  long long left = nbytes;
+  size_t c;
+
+  while (left > 0) {
+    c = left < CHUNK ? left : CHUNK;
+    Rio_writen(fd, buf, c);
+    left -= c;
+  }
+  return NULL;
+}
+
+static void *pingpong(void *vargp)
+{
+  int fd = open_tunnel();
+  char buf[CHUNK];
+  long long got = 0;
+  pthread_t tid;
+  ssize_t n;
+
+  Pthread_create(&tid, NULL, sender, &fd);
+  while (got < nbytes && (n = read(fd, buf, sizeof(buf))) > 0)
+    got += n;
+  Pthread_join(tid, NULL);
+  close(fd);
+  if (got != nbytes)
+    app_error("short echo");
+  return NULL;
+}
+
+static void show_proc(const char *pid, const char *when)
+{
+  char path[64], line[256];
+  FILE *fp;
+
+  snprintf(path, sizeof(path), "/proc/%s/status", pid);
+  if (!(fp = fopen(path, "r")))
+    return;
+  printf("proxy %-14s", when);
+  while (fgets(line, sizeof(line), fp))
+    if (!strncmp(line, "Threads:", 8) || !strncmp(line, "VmRSS:", 6)) {
+      line[strcspn(line, "\n")] = '\0';
+      printf("  %s", line);
+    }
+  printf("\n");
+  fclose(fp);
+}
+
+int main(int argc, char **argv)
+{
+  int conns = 1, idle = 0, listenfd, opt, i, *idlefds;
+  char *pid = NULL;
+  struct sockaddr_in sa;
+  socklen_t salen = sizeof(sa);
+  pthread_t tid, *tids;
+  struct timeval t0, t1;
+  double sec;
+
+  while ((opt = getopt(argc, argv, "dc:m:i:p:")) != -1) {
+    switch (opt) {
+    case 'd': direct = 1; break;
+    case 'c': conns = atoi(optarg); break;
+    case 'm': nbytes = atoll(optarg) * 1024 * 1024; break;
+    case 'i': idle = atoi(optarg); break;
+    case 'p': pid = optarg; break;
+    default: goto usage;
+    }
+  }
+  if (argc - optind != 2 && !direct)
+    goto usage;
+  proxy_host = argv[optind];
+  proxy_port = argv[optind + 1];
+  Signal(SIGPIPE, SIG_IGN);
+
+  /* echo 서버를 임의 포트에 띄움 */
+  listenfd = Open_listenfd("0");
+  getsockname(listenfd, (SA *)&sa, &salen);
+  snprintf(echo_port, sizeof(echo_port), "%d", ntohs(sa.sin_port));
+  Pthread_create(&tid, NULL, echo_server, &listenfd);
+
+  /* idle 터널: 열어만 두고 아무것도 안 보냄 */
+  if (pid)
+    show_proc(pid, "before idle:");
+  idlefds = Malloc(sizeof(int) * (idle + 1));
+  for (i = 0; i < idle; i++)
+    idlefds[i] = open_tunnel();
+  if (pid && idle) {
+    usleep(200000);
+    show_proc(pid, "with idle:");
+  }
+
+  tids = Malloc(sizeof(pthread_t) * conns);
+  gettimeofday(&t0, NULL);
+  for (i = 0; i < conns; i++)
+    Pthread_create(&tids[i], NULL, pingpong, NULL);
+  for (i = 0; i < conns; i++)
+    Pthread_join(tids[i], NULL);
+  gettimeofday(&t1, NULL);
+
+  sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+  printf("%s: %d conn(s) x %lld MB each way, %d idle tunnel(s): %.3f s, %.1f MB/s per direction\n",
+         direct ? "direct" : "tunnel", conns, nbytes >> 20, idle, sec,
+         (double)conns * nbytes / (1024 * 1024) / sec);
+
+  for (i = 0; i < idle; i++)
+    close(idlefds[i]);
+  exit(0);
+
+usage:
+  fprintf(stderr, "usage: %s [-d] [-c conns] [-m MB] [-i idle] [-p pid] <proxy host> <proxy port>\n", argv[0]);
+  exit(1);
+}
@@ -0,0 +1,107 @@
+/*
+ * uds_bench.c - origin 연결: loopback TCP 대 Unix 도메인 소켓
+ *
+ * 프록시가 같은 호스트의 tiny 에 미스를 보낼 때와 같은 일
+ * ("연결 → GET /home.html → 응답 끝까지 읽기 → 닫기") 을 TCP 포트와
+ * Unix 소켓으로 번갈아 반복하면서 요청 하나의 지연을 잰다.
+ * tiny 를 두 가지로 띄워 두고 실행한다:
+ *   (cd ../tiny && ./tiny 18000 & ./tiny /tmp/tiny.sock &)
+ *   ./uds_bench -p 18000 -u /tmp/tiny.sock -n 2000
+ * 프록시에서는 -o unix_origins=localhost:18000=/tmp/tiny.sock 로 같은 효과를 낸다.
+ *
+ * usage: uds_bench -p port -u socket path [-n requests] [-f uri]
+ */
+#include "csapp.h"
+
+static char *uri = "/home.html";
+
+static long long usec_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* 요청 하나의 지연(us). path 가 있으면 Unix 소켓, 없으면 TCP. *nbytes 에 받은 바이트 */
+static long long one_request(char *port, char *path, long long *nbytes)
+{
+  char req[MAXLINE], buf[MAXBUF];
+  long long t0 = usec_now();
+  ssize_t n;
+  int fd, len;
+
+  fd = path ? open_unix_clientfd(path) : open_clientfd("127.0.0.1", port);
+  if (fd < 0)
+    unix_error(path ? "open_unix_clientfd error" : "open_clientfd error");
+  len = snprintf(req, sizeof(req), "GET %s HTTP/1.0\r\nHost: localhost\r\n\r\n", uri);
+  Rio_writen(fd, req, len);
+  *nbytes = 0;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    *nbytes += n;
+  close(fd);
+  return usec_now() - t0;
+}
+
+static void report(const char *name, long long *lat, int n, long long nbytes)
+{
+  long long sum = 0;
+  int i;
+
+  for (i = 0; i < n; i++)
+    sum += lat[i];
+  qsort(lat, n, sizeof(long long), cmp_ll);
+  printf("%-5s %5d reqs  %6lld bytes/resp  mean %7.1f us  p50 %7.1f us  p99 %7.1f us  %8.0f req/s\n",
+         name, n, nbytes, (double)sum / n, (double)lat[n / 2], (double)lat[(n * 99) / 100],
+         n * 1e6 / sum);
+}
+
+static void usage(char *prog)
+{
+  fprintf(stderr, "usage: %s -p port -u socket path [-n requests] [-f uri]\n", prog);
+  exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  char *port = NULL, *path = NULL;
+  long long *tcp, *uds, tcp_bytes = 0, uds_bytes = 0;
+  int opt, n = 1000, i;
+
+  while ((opt = getopt(argc, argv, "p:u:n:f:")) != -1) {
+    switch (opt) {
+    case 'p': port = optarg; break;
+    case 'u': path = optarg; break;
+    case 'n': n = atoi(optarg); break;
+    case 'f': uri = optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if (!port || !path || n <= 0 || optind != argc)
+    usage(argv[0]);
+
+  /* 몸풀기: 페이지 캐시와 tiny 의 첫 요청 비용을 양쪽에서 빼냄 */
+  one_request(port, NULL, &tcp_bytes);
+  one_request(NULL, path, &uds_bytes);
+
+  /* 번갈아 재서 시스템 부하 변동이 양쪽에 고르게 들어가게 함 */
+  tcp = Malloc(n * sizeof(long long));
+  uds = Malloc(n * sizeof(long long));
+  for (i = 0; i < n; i++) {
+    tcp[i] = one_request(port, NULL, &tcp_bytes);
+    uds[i] = one_request(NULL, path, &uds_bytes);
+  }
+  report("tcp", tcp, n, tcp_bytes);
+  report("unix", uds, n, uds_bytes);
+
+  Free(tcp);
+  Free(uds);
+  return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * cache.c - 웹 객체 캐시 (LRU + too-large 힌트)
+ *
+ * 구조:
+ *   - 해시 테이블(체이닝)로 키 → 객체 검색
+ *   - 이중 연결 리스트로 LRU 순서 유지 (head = 최근 사용)
+ *   - 락은 mutex 하나. 락 안에서는 포인터만 만지고, 데이터 전송은
+ *     참조 카운트를 잡은 뒤 락 밖에서 한다
+ */
+#include "csapp.h"
+#include "cache.h"
+
+#define CACHE_NBUCKETS 1024   /* 2의 거듭제곱 */
+#define HINT_NSLOTS    1024   /* too-large 힌트 슬롯 수 (direct-mapped) */
+
+static cache_obj_t *buckets[CACHE_NBUCKETS];
+static cache_obj_t *lru_head, *lru_tail;
+static size_t cache_bytes;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* MAX_OBJECT_SIZE를 넘었던 키의 해시. 충돌하면 덮어쓰므로 틀려도 성능만 조금 손해 */
+static unsigned long long big_hint[HINT_NSLOTS];
+
+/* 따로 채우는 중인 키의 해시. 같은 칸을 다른 키가 쓰고 있으면 그 키는 이번에 못 채움 */
+static unsigned long long fill_busy[HINT_NSLOTS];
+
+/* FNV-1a 64bit */
+static unsigned long long key_hash(const char *key)
+{
+  unsigned long long h = 1469598103934665603ULL;
+
+  while (*key) {
+    h ^= (unsigned char)*key++;
+    h *= 1099511628211ULL;
+  }
+  return h ? h : 1;  /* 0은 빈 힌트 슬롯 표시용 */
+}
+
+static void lru_unlink(cache_obj_t *o)
+{
+  if (o->prev) o->prev->next = o->next; else lru_head = o->next;
+  if (o->next) o->next->prev = o->prev; else lru_tail = o->prev;
+  o->prev = o->next = NULL;
+}
+
+static void lru_push_front(cache_obj_t *o)
+{
+  o->prev = NULL;
+  o->next = lru_head;
+  if (lru_head) lru_head->prev = o; else lru_tail = o;
+  lru_head = o;
+}
+
+static void obj_free(cache_obj_t *o)
+{
+  Free(o->key);
+  Free(o->data);
+  Free(o);
+}
+
+/* 해시/LRU에서 떼어냄. 락을 잡은 상태에서 호출 */
+static void obj_remove(cache_obj_t *o)
+{
+  cache_obj_t **pp = &buckets[o->hash & (CACHE_NBUCKETS - 1)];
+
+  while (*pp != o)
+    pp = &(*pp)->hnext;
+  *pp = o->hnext;
+  lru_unlink(o);
+  cache_bytes -= o->size;
+  if (--o->refcnt == 0)
+    obj_free(o);
+}
+
+static cache_obj_t *obj_find(const char *key, unsigned long long h)
+{
+  cache_obj_t *o;
+
+  for (o = buckets[h & (CACHE_NBUCKETS - 1)]; o; o = o->hnext)
+    if (o->hash == h && !strcmp(o->key, key))
+      return o;
+  return NULL;
+}
+
+void cache_init(void)
+{
+  memset(buckets, 0, sizeof(buckets));
+  memset(big_hint, 0, sizeof(big_hint));
+  memset(fill_busy, 0, sizeof(fill_busy));
+  lru_head = lru_tail = NULL;
+  cache_bytes = 0;
+}
+
+/* 히트면 참조 카운트를 올려서 돌려줌. 다 쓰면 cache_release */
+cache_obj_t *cache_lookup(const char *key)
+{
+  unsigned long long h = key_hash(key);
+  cache_obj_t *o;
+
+  pthread_mutex_lock(&cache_lock);
+  if ((o = obj_find(key, h)) != NULL) {
+    o->refcnt++;
+    lru_unlink(o);
+    lru_push_front(o);
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return o;
+}
+
+void cache_release(cache_obj_t *obj)
+{
+  int last;
+
+  pthread_mutex_lock(&cache_lock);
+  last = (--obj->refcnt == 0);
+  pthread_mutex_unlock(&cache_lock);
+  if (last)
+    obj_free(obj);  /* 이미 쫓겨난 객체의 마지막 사용자 */
+}
+
+int cache_too_large(const char *key)
+{
+  unsigned long long h = key_hash(key);
+  int hit;
+
+  pthread_mutex_lock(&cache_lock);
+  hit = big_hint[h % HINT_NSLOTS] == h;
+  pthread_mutex_unlock(&cache_lock);
+  return hit;
+}
+
+int cache_fill_claim(const char *key)
+{
+  unsigned long long h = key_hash(key);
+  int ok;
+
+  pthread_mutex_lock(&cache_lock);
+  if ((ok = fill_busy[h % HINT_NSLOTS] == 0))
+    fill_busy[h % HINT_NSLOTS] = h;
+  pthread_mutex_unlock(&cache_lock);
+  return ok;
+}
+
+void cache_fill_unclaim(const char *key)
+{
+  unsigned long long h = key_hash(key);
+
+  pthread_mutex_lock(&cache_lock);
+  if (fill_busy[h % HINT_NSLOTS] == h)
+    fill_busy[h % HINT_NSLOTS] = 0;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+static void cache_insert(const char *key, char *data, size_t size, size_t hdrlen)
+{
+  unsigned long long h = key_hash(key);
+  cache_obj_t *o = Malloc(sizeof(cache_obj_t)), *old;
+
+  o->key = strdup(key);
+  o->hash = h;
+  o->data = data;
+  o->size = size;
+  o->hdrlen = hdrlen;
+  o->refcnt = 1;
+  o->prev = o->next = NULL;
+
+  pthread_mutex_lock(&cache_lock);
+  if ((old = obj_find(key, h)) != NULL)
+    obj_remove(old);
+  while (cache_bytes + size > MAX_CACHE_SIZE && lru_tail)
+    obj_remove(lru_tail);
+  o->hnext = buckets[h & (CACHE_NBUCKETS - 1)];
+  buckets[h & (CACHE_NBUCKETS - 1)] = o;
+  lru_push_front(o);
+  cache_bytes += size;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+/*
+ * 채우기
+ */
+void cache_fill_init(cache_fill_t *f, const char *key)
+{
+  f->key = key;
+  f->buf = NULL;
+  f->len = f->cap = 0;
+  f->hdrlen = 0;
+  f->bypass = cache_too_large(key);  /* 예전에 넘쳤던 키면 처음부터 안 모음 */
+}
+
+/* 버퍼를 바로 놓고 스트리밍으로 전환. too_large면 다음 요청을 위해 기억 */
+static void fill_bypass(cache_fill_t *f, int too_large)
+{
+  unsigned long long h;
+
+  if (f->buf)
+    Free(f->buf);
+  f->buf = NULL;
+  f->len = f->cap = 0;
+  f->bypass = 1;
+
+  if (too_large) {
+    h = key_hash(f->key);
+    pthread_mutex_lock(&cache_lock);
+    big_hint[h % HINT_NSLOTS] = h;
+    pthread_mutex_unlock(&cache_lock);
+  }
+}
+
+/* buf[from..len)에서 빈 줄("\r\n\r\n")의 시작을 찾음 */
+static char *find_blank_line(char *buf, size_t from, size_t len)
+{
+  char *p = buf + from, *end = buf + len;
+
+  while (end - p >= 4 && (p = memchr(p, '\r', end - p - 3)) != NULL) {
+    if (p[1] == '\n' && p[2] == '\r' && p[3] == '\n')
+      return p;
+    p++;
+  }
+  return NULL;
+}
+
+/* 헤더가 다 들어왔으면 상태 코드와 Content-Length를 보고 미리 판단 */
+static void fill_check_header(cache_fill_t *f, size_t scan_from)
+{
+  char *end, *p;
+  long long clen;
+
+  end = find_blank_line(f->buf, scan_from, f->len);
+  if (!end)
+    return;
+  f->hdrlen = end + 4 - f->buf;
+
+  /* 200 응답만 캐시 */
+  if (f->hdrlen < 12 || strncmp(f->buf, "HTTP/1.", 7) || strncmp(f->buf + 9, "200", 3)) {
+    fill_bypass(f, 0);
+    return;
+  }
+  p = f->buf;
+  while (p < end) {
+    if (!strncasecmp(p, "Content-Length:", 15)) {
+      clen = strtoll(p + 15, NULL, 10);
+      if (clen + f->hdrlen > MAX_OBJECT_SIZE)
+        fill_bypass(f, 1);
+      return;
+    }
+    if (!(p = memchr(p, '\n', end - p)))
+      break;
+    p++;
+  }
+}
+
+/* relay_tap_t: origin에서 읽은 바이트를 모음 */
+void cache_fill_tap(void *arg, const char *buf, size_t n)
+{
+  cache_fill_t *f = arg;
+  size_t old = f->len;
+
+  if (f->bypass)
+    return;
+  if (f->len + n > MAX_OBJECT_SIZE) {
+    fill_bypass(f, 1);
+    return;
+  }
+  if (f->len + n > f->cap) {
+    f->cap = f->cap ? f->cap : MAXBUF;
+    while (f->cap < f->len + n)
+      f->cap *= 2;
+    if (f->cap > MAX_OBJECT_SIZE)
+      f->cap = MAX_OBJECT_SIZE;
+    f->buf = Realloc(f->buf, f->cap);
+  }
+  memcpy(f->buf + f->len, buf, n);
+  f->len += n;
+
+  if (!f->hdrlen)
+    fill_check_header(f, old > 3 ? old - 3 : 0);
+}
+
+/* ok면 캐시에 넣고(버퍼 소유권 이전), 아니면 버림 */
+void cache_fill_finish(cache_fill_t *f, int ok)
+{
+  if (ok && !f->bypass && f->hdrlen)
+    cache_insert(f->key, Realloc(f->buf, f->len), f->len, f->hdrlen);
+  else if (f->buf)
+    Free(f->buf);
+  f->buf = NULL;
+  f->len = f->cap = 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * cache.h - 웹 객체 캐시 (LRU)
+ *
+ * 응답 전체(상태 줄 + 헤더 + 본문)를 URI 키로 저장한다. 히트된 객체는
+ * 참조 카운트로 잡아두기 때문에 락을 풀고 나서도 복사 없이 바로
+ * 클라이언트에 쓸 수 있다.
+ *
+ * 채우기(cache_fill_t)는 relay 의 tap 으로 붙는다. 응답이 MAX_OBJECT_SIZE 를
+ * 넘는 순간 버퍼를 바로 버리고 bypass 로 바뀌어 나머지는 그냥 흘려보낸다.
+ * 이렇게 넘친 키는 "too large" 힌트로 기억해서, 다음 요청부터는 첫 바이트부터
+ * 버퍼링하지 않는다.
+ *
+ * 클라이언트 요청과 따로 객체 전체를 받아 채울 때(Range 미스)는 먼저
+ * cache_fill_claim 으로 키를 맡는다. 같은 키에 요청이 몰려도 origin 에서는
+ * 한 번만 받는다.
+ */
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stddef.h>
+
+/* Recommended max cache and object sizes */
+#define MAX_CACHE_SIZE 1049000
+#define MAX_OBJECT_SIZE 102400
+
+typedef struct cache_obj {
+  char *key;
+  unsigned long long hash;
+  char *data;          /* 응답 전체 */
+  size_t size;
+  size_t hdrlen;       /* 헤더 길이 = 본문 시작 오프셋 */
+  int refcnt;          /* 캐시 자신 1 + 사용 중인 스레드 수 */
+  struct cache_obj *hnext;             /* 해시 체인 */
+  struct cache_obj *prev, *next;       /* LRU 리스트 (head가 최근) */
+} cache_obj_t;
+
+/* 응답 한 개를 채우는 중인 상태 */
+typedef struct {
+  const char *key;     /* 호출자가 채우기가 끝날 때까지 유지 */
+  char *buf;
+  size_t len, cap;
+  size_t hdrlen;       /* 헤더 끝을 찾았으면 그 길이, 아니면 0 */
+  int bypass;          /* 1이면 더 이상 버퍼링하지 않음 */
+} cache_fill_t;
+
+void cache_init(void);
+cache_obj_t *cache_lookup(const char *key);
+void cache_release(cache_obj_t *obj);
+int cache_too_large(const char *key);
+
+void cache_fill_init(cache_fill_t *f, const char *key);
+void cache_fill_tap(void *arg, const char *buf, size_t n);
+void cache_fill_finish(cache_fill_t *f, int ok);
+
+/* key 를 따로 채우는 일을 맡음. 이미 누가 채우는 중이면 0. 끝나면 cache_fill_unclaim */
+int cache_fill_claim(const char *key);
+void cache_fill_unclaim(const char *key);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,165 @@
+/*
+ * conf.c - 프록시 실행 설정값 테이블과 파서
+ */
+#include "csapp.h"
+#include "conf.h"
+
+/* 기본값 */
+proxy_conf_t conf = {
+  .relay_bufsize = 64 * 1024,
+  .relay_high_wm = 48 * 1024,
+  .relay_low_wm = 16 * 1024,
+  .relay_write_timeout_ms = 30000,
+  .relay_spill = 0,
+  .relay_spill_max = 8 * 1024 * 1024,
+  .relay_splice_min = 16 * 1024,
+  .client_idle_timeout_ms = 15000,
+  .client_max_requests = 100,
+  .client_pipeline_depth = 16,
+  .tunnel_idle_timeout_ms = 300000,
+  .pool_max_idle_per_origin = 8,
+  .pool_idle_timeout_ms = 30000,
+  .dns_ttl_ms = 60000,
+  .dns_negative_ttl_ms = 5000,
+  .dns_cache_max = 1024,
+  .dns_resolver_threads = 4,
+  .dns_timeout_ms = 5000,
+  .upstream_connect_timeout_ms = 5000,
+  .upstream_first_byte_timeout_ms = 30000,
+  .upstream_idle_timeout_ms = 30000,
+  .tfo_listen = 0,
+  .tfo_upstream = 0,
+  .breaker_failure_pct = 50,
+  .breaker_min_requests = 10,
+  .breaker_window_ms = 10000,
+  .breaker_open_ms = 5000,
+  .breaker_slow_ms = 0,
+  .hedge_percentile = 0,
+  .hedge_budget_pct = 5,
+  .hedge_min_delay_ms = 10,
+  .origin_max_conns = 0,
+  .upstream_max_conns = 0,
+  .origin_queue_max = 256,
+  .origin_queue_timeout_ms = 10000,
+  .unix_origins = NULL,
+  .preconnect = 1,
+  .preconnect_rate = 0,
+  .backends = NULL,
+  .backend_policy = "p2c",
+  .backend_max_fails = 3,
+  .backend_down_ms = 10000,
+  .h2c = 1,
+  .h2_max_streams = 100,
+  .stats_path = NULL,
+};
+
+typedef enum { CONF_INT, CONF_SIZE, CONF_STR } conf_type_t;
+
+typedef struct {
+  const char *key;
+  conf_type_t type;
+  size_t offset;      /* proxy_conf_t 안에서의 위치 */
+  const char *help;
+} conf_entry_t;
+
+#define ENTRY(name, type, help) { #name, type, offsetof(proxy_conf_t, name), help }
+
+static const conf_entry_t conf_table[] = {
+  ENTRY(relay_bufsize, CONF_SIZE, "per-connection output buffer bytes"),
+  ENTRY(relay_high_wm, CONF_SIZE, "pause origin reads at this many buffered bytes"),
+  ENTRY(relay_low_wm, CONF_SIZE, "resume origin reads below this many buffered bytes"),
+  ENTRY(relay_write_timeout_ms, CONF_INT, "close clients that accept nothing for this long"),
+  ENTRY(relay_spill, CONF_INT, "1: spill to a temp file instead of pausing the origin"),
+  ENTRY(relay_spill_max, CONF_SIZE, "per-connection spill file limit in bytes"),
+  ENTRY(relay_splice_min, CONF_SIZE, "splice request bodies at least this large (0: off)"),
+  ENTRY(client_idle_timeout_ms, CONF_INT, "close client connections idle this long between requests (0: never)"),
+  ENTRY(client_max_requests, CONF_INT, "requests served per client connection (1: no keep-alive)"),
+  ENTRY(client_pipeline_depth, CONF_INT, "pipelined GETs served concurrently per client connection (1: in turn)"),
+  ENTRY(tunnel_idle_timeout_ms, CONF_INT, "close CONNECT tunnels idle this long (0: never)"),
+  ENTRY(pool_max_idle_per_origin, CONF_INT, "idle keep-alive connections kept per origin (0: off)"),
+  ENTRY(pool_idle_timeout_ms, CONF_INT, "close pooled origin connections idle this long"),
+  ENTRY(dns_ttl_ms, CONF_INT, "reuse resolved origin addresses this long (0: off)"),
+  ENTRY(dns_negative_ttl_ms, CONF_INT, "remember failed name lookups this long"),
+  ENTRY(dns_cache_max, CONF_INT, "maximum cached (host, port) lookups"),
+  ENTRY(dns_resolver_threads, CONF_INT, "threads running getaddrinfo"),
+  ENTRY(dns_timeout_ms, CONF_INT, "give up waiting for a name lookup after this long"),
+  ENTRY(upstream_connect_timeout_ms, CONF_INT, "504 if an origin connect takes longer (-1: none)"),
+  ENTRY(upstream_first_byte_timeout_ms, CONF_INT, "504 if the response has not started by then (0: none)"),
+  ENTRY(upstream_idle_timeout_ms, CONF_INT, "abort when an origin stalls this long mid-message (0: none)"),
+  ENTRY(tfo_listen, CONF_INT, "1: accept TCP Fast Open from clients"),
+  ENTRY(tfo_upstream, CONF_INT, "1: send origin requests in the SYN with TCP Fast Open"),
+  ENTRY(breaker_failure_pct, CONF_INT, "open an origin's circuit at this failure rate (0: off)"),
+  ENTRY(breaker_min_requests, CONF_INT, "requests per window before the rate counts"),
+  ENTRY(breaker_window_ms, CONF_INT, "failure rate window"),
+  ENTRY(breaker_open_ms, CONF_INT, "fail fast this long before a half-open probe"),
+  ENTRY(breaker_slow_ms, CONF_INT, "count responses slower than this as failures (0: off)"),
+  ENTRY(hedge_percentile, CONF_INT, "re-send cacheable GETs slower than this latency percentile (0: off)"),
+  ENTRY(hedge_budget_pct, CONF_INT, "hedge at most this percent of requests"),
+  ENTRY(hedge_min_delay_ms, CONF_INT, "never hedge before this many ms"),
+  ENTRY(origin_max_conns, CONF_INT, "concurrent upstream connections per origin (0: no limit)"),
+  ENTRY(upstream_max_conns, CONF_INT, "concurrent upstream connections in total (0: no limit)"),
+  ENTRY(origin_queue_max, CONF_INT, "requests allowed to wait for a connection per origin"),
+  ENTRY(origin_queue_timeout_ms, CONF_INT, "503 after waiting this long for a connection"),
+  ENTRY(unix_origins, CONF_STR, "host:port=/socket/path,... reached over AF_UNIX instead of TCP"),
+  ENTRY(preconnect, CONF_INT, "1: start the origin connect while request headers are still arriving"),
+  ENTRY(preconnect_rate, CONF_INT, "keep a spare connection to origins above this many requests/s (0: off)"),
+  ENTRY(backends, CONF_STR, "reverse proxy: host:port,... serving origin-form requests"),
+  ENTRY(backend_policy, CONF_STR, "p2c (power of two choices) or leastconn"),
+  ENTRY(backend_max_fails, CONF_INT, "take a backend out after this many connect failures in a row"),
+  ENTRY(backend_down_ms, CONF_INT, "keep a failed backend out this long"),
+  ENTRY(h2c, CONF_INT, "1: accept HTTP/2 cleartext (prior knowledge or Upgrade: h2c)"),
+  ENTRY(h2_max_streams, CONF_INT, "concurrent streams per HTTP/2 connection"),
+  ENTRY(stats_path, CONF_STR, "answer GET <path> (origin-form) with internal counters (unset: off)"),
+};
+
+#define CONF_NENTRIES (sizeof(conf_table) / sizeof(conf_table[0]))
+
+int conf_set(const char *kv)
+{
+  const char *eq = strchr(kv, '=');
+  const conf_entry_t *e;
+  char *end;
+  void *field;
+  size_t i, klen;
+
+  if (!eq)
+    return -1;
+  klen = eq - kv;
+
+  for (i = 0; i < CONF_NENTRIES; i++) {
+    e = &conf_table[i];
+    if (strlen(e->key) != klen || strncmp(e->key, kv, klen))
+      continue;
+
+    field = (char *)&conf + e->offset;
+    switch (e->type) {
+    case CONF_INT:
+      *(int *)field = (int)strtol(eq + 1, &end, 10);
+      return *end ? -1 : 0;
+    case CONF_SIZE:
+      *(size_t *)field = (size_t)strtoull(eq + 1, &end, 10);
+      return *end ? -1 : 0;
+    case CONF_STR:
+      *(char **)field = strdup(eq + 1);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void conf_usage(FILE *fp)
+{
+  size_t i;
+
+  fprintf(fp, "options (-o key=value):\n");
+  for (i = 0; i < CONF_NENTRIES; i++)
+    fprintf(fp, "  %-24s %s\n", conf_table[i].key, conf_table[i].help);
+}
+
+long long msec_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,99 @@
+/*
+ * conf.h - 프록시 실행 설정값
+ *
+ * 모든 튜닝 값은 전역 conf 하나에 모아두고, 명령행에서
+ *   ./proxy -o relay_bufsize=131072 -o relay_spill=1 <port>
+ * 처럼 key=value 로 덮어쓴다. 새 설정을 추가할 때는 proxy_conf_t 필드와
+ * conf.c 의 conf_table 에 한 줄씩만 추가하면 된다.
+ */
+#ifndef __CONF_H__
+#define __CONF_H__
+
+#include <stdio.h>
+#include <stddef.h>
+
+typedef struct {
+  /* 응답 중계 (relay.c) */
+  size_t relay_bufsize;        /* 연결당 출력 버퍼 크기 (상한) */
+  size_t relay_high_wm;        /* 버퍼가 이만큼 차면 origin 읽기 중단 */
+  size_t relay_low_wm;         /* 이 아래로 비워지면 origin 읽기 재개 */
+  int relay_write_timeout_ms;  /* 클라이언트가 이 시간 동안 한 바이트도 못 받으면 끊음 */
+  int relay_spill;             /* 1이면 멈추는 대신 임시 파일로 넘겨 origin을 빨리 놓아줌 */
+  size_t relay_spill_max;      /* 연결당 임시 파일 최대 크기 */
+  size_t relay_splice_min;     /* 이 이상인 요청 본문은 splice로 전달 (0이면 끔) */
+
+  /* 클라이언트 keep-alive (proxy.c) */
+  int client_idle_timeout_ms;  /* 다음 요청(또는 요청의 다음 바이트)을 이만큼만 기다림 */
+  int client_max_requests;     /* 클라이언트 연결 하나에서 처리할 최대 요청 수 (1이면 keep-alive 끔) */
+  int client_pipeline_depth;   /* pipelining된 GET을 연결당 이만큼까지 동시에 처리 (1이면 하나씩) */
+
+  /* CONNECT 터널 (tunnel.c) */
+  int tunnel_idle_timeout_ms;  /* 양방향 모두 이 시간 동안 조용하면 닫음 (0이면 끔) */
+
+  /* origin 연결 풀 (origin.c) */
+  int pool_max_idle_per_origin; /* origin당 놀고 있는 keep-alive 연결 최대 수 (0이면 풀 끔) */
+  int pool_idle_timeout_ms;     /* 이 시간보다 오래 논 연결은 닫음 */
+
+  /* 이름 해석 캐시 (dns.c) */
+  int dns_ttl_ms;              /* 성공한 getaddrinfo 결과를 이 시간 동안 재사용 (0이면 캐시 끔) */
+  int dns_negative_ttl_ms;     /* 실패한 결과를 기억하는 시간 */
+  int dns_cache_max;           /* 캐시 항목 최대 수 */
+  int dns_resolver_threads;    /* getaddrinfo 를 부르는 resolver 스레드 수 */
+  int dns_timeout_ms;          /* 워커가 이름 해석을 기다리는 최대 시간 */
+
+  /* origin 소켓 타임아웃 (넘으면 504 또는 응답 중단) */
+  int upstream_connect_timeout_ms;    /* 연결 완료까지 */
+  int upstream_first_byte_timeout_ms; /* 요청을 다 보낸 뒤 응답 첫 바이트까지 */
+  int upstream_idle_timeout_ms;       /* 그 뒤 읽기/쓰기 사이 최대 공백 */
+
+  /* TCP Fast Open (커널 net.ipv4.tcp_fastopen 도 켜져 있어야 함) */
+  int tfo_listen;              /* 1이면 클라이언트 쪽 listen 소켓에서 TFO 허용 */
+  int tfo_upstream;            /* 1이면 origin 연결에서 요청을 SYN 에 실어 보냄 */
+
+  /* origin별 circuit breaker (origin.c) */
+  int breaker_failure_pct;     /* 창 안의 실패율이 이 % 이상이면 open (0이면 끔) */
+  int breaker_min_requests;    /* 창 안에 요청이 이만큼은 있어야 판단 */
+  int breaker_window_ms;       /* 실패율 집계 창 */
+  int breaker_open_ms;         /* open 뒤 probe 를 보내기까지 기다리는 시간 */
+  int breaker_slow_ms;         /* 첫 바이트가 이보다 늦으면 실패로 셈 (0이면 끔) */
+
+  /* hedged request (캐시 가능한 GET만) */
+  int hedge_percentile;        /* 첫 바이트가 이 분위수 지연보다 늦으면 두 번째 요청 (0이면 끔) */
+  int hedge_budget_pct;        /* hedge 요청은 전체 요청의 이 % 까지만 */
+  int hedge_min_delay_ms;      /* hedge 전에 최소한 이만큼은 기다림 */
+
+  /* 동시 연결 제한과 대기 큐 (origin.c) */
+  int origin_max_conns;        /* origin당 동시에 쓰는 연결 수 (0이면 제한 없음) */
+  int upstream_max_conns;      /* 모든 origin 합쳐서 (0이면 제한 없음) */
+  int origin_queue_max;        /* origin당 자리를 기다릴 수 있는 요청 수 */
+  int origin_queue_timeout_ms; /* 자리를 이만큼 기다려도 안 나면 503 */
+
+  /* 같은 호스트의 origin (origin.c) */
+  char *unix_origins;          /* "host:port=/sock/path,..." 이 origin 들은 AF_UNIX 로 연결 */
+
+  /* 미리 연결 (origin.c) */
+  int preconnect;              /* 1이면 요청 줄을 읽자마자 origin 연결 시작 (헤더 읽기와 겹침) */
+  int preconnect_rate;         /* 초당 요청이 이 이상인 origin 은 풀이 비면 연결 하나를 미리 만듦 (0이면 끔) */
+
+  /* 리버스 프록시 모드 (backend.c) */
+  char *backends;              /* "host:port,host:port,..." 가 있으면 origin-form 요청을 여기로 */
+  char *backend_policy;        /* "p2c" 또는 "leastconn" */
+  int backend_max_fails;       /* 연속으로 이만큼 연결에 실패하면 down */
+  int backend_down_ms;         /* down 된 backend 를 후보에서 빼 두는 시간 */
+
+  /* HTTP/2 cleartext (h2.c) */
+  int h2c;                     /* 1이면 prior knowledge 서문이나 Upgrade: h2c 를 받아 HTTP/2 로 */
+  int h2_max_streams;          /* 연결당 동시 스트림 수 (SETTINGS_MAX_CONCURRENT_STREAMS) */
+
+  /* 내부 카운터 조회 (proxy.c) */
+  char *stats_path;            /* origin-form "GET <이 경로>" 를 프록시가 직접 답함 (NULL이면 끔) */
+} proxy_conf_t;
+
+extern proxy_conf_t conf;
+
+int conf_set(const char *kv);  /* "key=value" 한 개 적용. 성공 0, 실패 -1 */
+void conf_usage(FILE *fp);     /* 설정 가능한 key 목록 출력 */
+
+long long msec_now(void);      /* 단조 증가 시계 (밀리초) */
+
+#endif /* __CONF_H__ */
@@ -866,33 +866,75 @@ ssize_t rio_readnb(rio_t *rp, void *usrbuf, size_t n)
 
 /* 
  * rio_readlineb - Robustly read a text line (buffered)
+ *     Copies a buffer's worth at a time: memchr finds the newline in the
+ *     internal buffer instead of one rio_read call per character.
  */
 /* $begin rio_readlineb */
 ssize_t rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen) 
 {
-    int n, rc;
-    char c, *bufp = usrbuf;
+    size_t n = 0, cnt;
+    char *bufp = usrbuf, *nl;
 
-    for (n = 1; n < maxlen; n++) { 
-        if ((rc = rio_read(rp, &c, 1)) == 1) {
-	    *bufp++ = c;
-	    if (c == '\n') {
-                n++;
-     		break;
+    while (n + 1 < maxlen) {
+        while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
+            rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, sizeof(rp->rio_buf));
+            if (rp->rio_cnt < 0) {
+                if (errno != EINTR) /* Interrupted by sig handler return */
+                    return -1;      /* Error */
             }
-	} else if (rc == 0) {
-	    if (n == 1)
-		return 0; /* EOF, no data read */
-	    else
-		break;    /* EOF, some data was read */
-	} else
-	    return -1;	  /* Error */
+            else if (rp->rio_cnt == 0)  /* EOF */
+                goto done;
+            else
+                rp->rio_bufptr = rp->rio_buf; /* Reset buffer ptr */
+        }
+
+        /* Copy up to and including the newline, or as much as fits */
+        cnt = maxlen - 1 - n;
+        if (rp->rio_cnt < cnt)
+            cnt = rp->rio_cnt;
+        if ((nl = memchr(rp->rio_bufptr, '\n', cnt)) != NULL)
+            cnt = nl - rp->rio_bufptr + 1;
+        memcpy(bufp, rp->rio_bufptr, cnt);
+        rp->rio_bufptr += cnt;
+        rp->rio_cnt -= cnt;
+        bufp += cnt;
+        n += cnt;
+        if (nl)
+            break;
     }
+ done:
     *bufp = 0;
-    return n-1;
+    return n;
 }
 /* $end rio_readlineb */
 
+/*
+ * rio_fillb - Read more bytes into the internal buffer without consuming
+ *     any, so a caller can parse what is there in place. Unread bytes are
+ *     first moved to the front of the buffer (rio_bufptr changes).
+ *     Returns the number of bytes added, 0 on EOF, -1 on error (ENOBUFS
+ *     if the unread bytes already fill the buffer).
+ */
+ssize_t rio_fillb(rio_t *rp)
+{
+    ssize_t n;
+
+    if (rp->rio_cnt >= RIO_BUFSIZE) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    if (rp->rio_bufptr != rp->rio_buf) {
+        memmove(rp->rio_buf, rp->rio_bufptr, rp->rio_cnt);
+        rp->rio_bufptr = rp->rio_buf;
+    }
+    while ((n = read(rp->rio_fd, rp->rio_buf + rp->rio_cnt,
+                     RIO_BUFSIZE - rp->rio_cnt)) < 0 && errno == EINTR)
+        ;
+    if (n > 0)
+        rp->rio_cnt += n;
+    return n;
+}
+
 /**********************************
  * Wrappers for robust I/O routines
  **********************************/
@@ -934,6 +976,135 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
     return rc;
 } 
 
+/****************************************************
+ * The Hdr package - gather header fragments for writev
+ ****************************************************/
+/*
+ * hdr_init - Reset a header builder to the empty state
+ */
+/* $begin hdr_init */
+void hdr_init(hdr_t *hp)
+{
+    hp->hdr_iovcnt = 0;
+    hp->hdr_len = 0;
+    hp->hdr_dynlen = 0;
+}
+/* $end hdr_init */
+
+/*
+ * hdr_add - Append n bytes at buf by reference (no copy). The caller
+ *     must keep buf alive until the builder has been written.
+ */
+/* $begin hdr_add */
+void hdr_add(hdr_t *hp, const void *buf, size_t n)
+{
+    struct iovec *last;
+
+    if (hp->hdr_iovcnt < 0 || n == 0)
+        return;
+
+    /* Extend the previous fragment if buf continues it in memory */
+    if (hp->hdr_iovcnt > 0) {
+        last = &hp->hdr_iov[hp->hdr_iovcnt - 1];
+        if ((char *)last->iov_base + last->iov_len == (char *)buf) {
+            last->iov_len += n;
+            hp->hdr_len += n;
+            return;
+        }
+    }
+    if (hp->hdr_iovcnt == HDR_MAXIOV) {
+        hp->hdr_iovcnt = -1; /* Overflow, reported by hdr_writev */
+        return;
+    }
+    hp->hdr_iov[hp->hdr_iovcnt].iov_base = (void *)buf;
+    hp->hdr_iov[hp->hdr_iovcnt].iov_len = n;
+    hp->hdr_iovcnt++;
+    hp->hdr_len += n;
+}
+/* $end hdr_add */
+
+/*
+ * hdr_adds - Append a NUL-terminated string by reference
+ */
+void hdr_adds(hdr_t *hp, const char *s)
+{
+    hdr_add(hp, s, strlen(s));
+}
+
+/*
+ * hdr_printf - Format a dynamic field into the builder's own storage.
+ *     Consecutive calls land back to back and share one iovec.
+ */
+/* $begin hdr_printf */
+void hdr_printf(hdr_t *hp, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room = HDR_DYNSIZE - hp->hdr_dynlen;
+    char *dst = hp->hdr_dyn + hp->hdr_dynlen;
+    int n;
+
+    if (hp->hdr_iovcnt < 0)
+        return;
+    va_start(ap, fmt);
+    n = vsnprintf(dst, room, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= room) {
+        hp->hdr_iovcnt = -1; /* Truncated, reported by hdr_writev */
+        return;
+    }
+    hp->hdr_dynlen += n;
+    hdr_add(hp, dst, n);
+}
+/* $end hdr_printf */
+
+/*
+ * hdr_writev - Emit every fragment with as few writev calls as the
+ *     kernel allows (normally one). Returns bytes written or -1.
+ */
+/* $begin hdr_writev */
+ssize_t hdr_writev(int fd, hdr_t *hp)
+{
+    struct iovec *iov = hp->hdr_iov;
+    int iovcnt = hp->hdr_iovcnt;
+    size_t nleft = hp->hdr_len;
+    ssize_t nwritten;
+
+    if (iovcnt < 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    while (nleft > 0) {
+        if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+            if (errno == EINTR) /* Interrupted by sig handler return */
+                continue;
+            return -1;          /* errno set by writev() */
+        }
+        nleft -= nwritten;
+
+        /* Short write: skip what went out and trim the next fragment */
+        while (iovcnt > 0 && (size_t)nwritten >= iov->iov_len) {
+            nwritten -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + nwritten;
+            iov->iov_len -= nwritten;
+        }
+    }
+    return hp->hdr_len;
+}
+/* $end hdr_writev */
+
+/**********************************
+ * Wrappers for the Hdr package
+ **********************************/
+void Hdr_writev(int fd, hdr_t *hp)
+{
+    if (hdr_writev(fd, hp) != hp->hdr_len)
+        unix_error("Hdr_writev error");
+}
+
 /******************************** 
  * Client/server helper functions
  ********************************/
@@ -949,7 +1120,7 @@ ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen)
 /* $begin open_clientfd */
 int open_clientfd(char *hostname, char *port) {
     int clientfd, rc;
-    struct addrinfo hints, *listp, *p;
+    struct addrinfo hints, *listp;
 
     /* Get a list of potential server addresses */
     memset(&hints, 0, sizeof(struct addrinfo));
@@ -960,31 +1131,169 @@ int open_clientfd(char *hostname, char *port) {
         fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, port, gai_strerror(rc));
         return -2;
     }
-  
-    /* Walk the list for one that we can successfully connect to */
-    for (p = listp; p; p = p->ai_next) {
-        /* Create a socket descriptor */
-        if ((clientfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) 
-            continue; /* Socket failed, try the next */
 
-        /* Connect to the server */
-        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
-            break; /* Success */
-        if (close(clientfd) < 0) { /* Connect failed, try another */  //line:netp:openclientfd:closefd
-            fprintf(stderr, "open_clientfd: close failed: %s\n", strerror(errno));
-            return -1;
-        } 
-    } 
+    clientfd = open_clientfd_ai(listp, -1, 0);
 
     /* Clean up */
     freeaddrinfo(listp);
-    if (!p) /* All connects failed */
-        return -1;
-    else    /* The last connect succeeded */
-        return clientfd;
+    return clientfd;
 }
 /* $end open_clientfd */
 
+/*
+ * he_order - Reorder an address list for happy eyeballs (RFC 8305,
+ *     section 4): alternate between the family of the first address
+ *     and the other family, keeping the resolver's preference order
+ *     within each family. Returns the number of addresses in out (at
+ *     most HE_MAXADDRS). Also used by callers that race the connects
+ *     from their own event loop.
+ */
+int he_order(struct addrinfo *listp, struct addrinfo **out)
+{
+    struct addrinfo *first[HE_MAXADDRS], *other[HE_MAXADDRS], *p;
+    int nfirst = 0, nother = 0, n = 0, i, j;
+
+    for (p = listp; p; p = p->ai_next) {
+        if (p->ai_family == listp->ai_family) {
+            if (nfirst < HE_MAXADDRS)
+                first[nfirst++] = p;
+        } else if (nother < HE_MAXADDRS) {
+            other[nother++] = p;
+        }
+    }
+    for (i = j = 0; n < HE_MAXADDRS && (i < nfirst || j < nother); ) {
+        if (i < nfirst)
+            out[n++] = first[i++];
+        if (j < nother && n < HE_MAXADDRS)
+            out[n++] = other[j++];
+    }
+    return n;
+}
+
+static long long he_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * open_clientfd_ai - Same as open_clientfd, but connects to an address
+ *     list the caller already resolved (e.g. from a DNS cache). The
+ *     list is not freed.
+ *
+ *     Connection attempts are staggered happy-eyeballs style: a new
+ *     non-blocking connect starts every HE_DELAY_MS (or as soon as the
+ *     previous attempt fails) while earlier attempts keep running. The
+ *     first one to complete wins and the rest are closed, so a
+ *     blackholed address costs HE_DELAY_MS instead of a full SYN
+ *     timeout. The returned socket is back in blocking mode.
+ *
+ *     If timeout_ms >= 0, gives up once that many milliseconds have
+ *     passed without a connection (errno ETIMEDOUT).
+ *
+ *     With OPEN_TFO in flags, sockets use TCP_FASTOPEN_CONNECT: when
+ *     the kernel holds a Fast Open cookie for the server, connect()
+ *     returns at once and the first write rides in the SYN. Otherwise
+ *     the handshake asks for a cookie for next time.
+ *
+ *     On error, returns -1 with errno set.
+ */
+int open_clientfd_ai(struct addrinfo *listp, int timeout_ms, int flags)
+{
+    struct addrinfo *addrs[HE_MAXADDRS], *p;
+    struct pollfd pfd[HE_MAXADDRS];
+    int fflags[HE_MAXADDRS];
+    int naddrs, next = 0, active = 0, win = -1, i, fd, soerr, timeout, optval = 1;
+    int err = ECONNREFUSED;
+    long long next_start = 0, left;
+    long long deadline = timeout_ms >= 0 ? he_now_ms() + timeout_ms : -1;
+    socklen_t len;
+
+    naddrs = he_order(listp, addrs);
+    while (win < 0 && (next < naddrs || active > 0)) {
+        /* Start the next attempt when nothing is in flight or the delay passed */
+        if (next < naddrs && (active == 0 || he_now_ms() >= next_start)) {
+            p = addrs[next++];
+            if ((fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) {
+                err = errno;
+                continue; /* Socket failed, try the next */
+            }
+            if (flags & OPEN_TFO) /* Best effort: plain connect if unsupported */
+                setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &optval, sizeof(int));
+            fflags[active] = fcntl(fd, F_GETFL);
+            fcntl(fd, F_SETFL, fflags[active] | O_NONBLOCK);
+            pfd[active].fd = fd;
+            pfd[active].events = POLLOUT;
+            pfd[active].revents = 0;
+            if (connect(fd, p->ai_addr, p->ai_addrlen) == 0) {
+                win = active++; /* Connected at once (e.g. loopback) */
+                break;
+            }
+            if (errno != EINPROGRESS) {
+                err = errno;
+                close(fd);
+                continue; /* Connect failed, try another right away */
+            }
+            active++;
+            next_start = he_now_ms() + HE_DELAY_MS;
+        }
+
+        timeout = -1;
+        if (next < naddrs) {
+            timeout = (int)(next_start - he_now_ms());
+            if (timeout < 0)
+                timeout = 0;
+        }
+        if (deadline >= 0) {
+            if ((left = deadline - he_now_ms()) <= 0) {
+                err = ETIMEDOUT;
+                break;
+            }
+            if (timeout < 0 || left < timeout)
+                timeout = (int)left;
+        }
+        if (poll(pfd, active, timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            err = errno;
+            break;
+        }
+
+        /* Reap finished attempts: first success wins, failures are dropped */
+        for (i = 0; i < active; ) {
+            if (!pfd[i].revents) {
+                i++;
+                continue;
+            }
+            len = sizeof(soerr);
+            if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &soerr, &len) < 0)
+                soerr = errno;
+            if (soerr == 0) {
+                win = i;
+                break;
+            }
+            err = soerr;
+            close(pfd[i].fd);
+            active--;
+            pfd[i] = pfd[active];
+            fflags[i] = fflags[active];
+        }
+    }
+
+    /* Cancel the attempts that lost the race */
+    for (i = 0; i < active; i++)
+        if (i != win)
+            close(pfd[i].fd);
+    if (win < 0) { /* All connects failed */
+        errno = err;
+        return -1;
+    }
+    fcntl(pfd[win].fd, F_SETFL, fflags[win]);
+    return pfd[win].fd;
+}
+
 /*  
  * open_listenfd - Open and return a listening socket on port. This
  *     function is reentrant and protocol-independent.
@@ -995,9 +1304,21 @@ int open_clientfd(char *hostname, char *port) {
  */
 /* $begin open_listenfd */
 int open_listenfd(char *port) 
+{
+    return open_listenfd_flags(port, 0);
+}
+/* $end open_listenfd */
+
+/*
+ * open_listenfd_flags - Same as open_listenfd. With OPEN_TFO in flags,
+ *     the socket also accepts TCP Fast Open, so a client holding a
+ *     cookie can send its request in the SYN (best effort: ignored if
+ *     the kernel does not allow server-side Fast Open).
+ */
+int open_listenfd_flags(char *port, int flags)
 {
     struct addrinfo hints, *listp, *p;
-    int listenfd, rc, optval=1;
+    int listenfd, rc, optval=1, qlen = TFO_QLEN;
 
     /* Get a list of potential server addresses */
     memset(&hints, 0, sizeof(struct addrinfo));
@@ -1034,6 +1355,9 @@ int open_listenfd(char *port)
     if (!p) /* No address worked */
         return -1;
 
+    if (flags & OPEN_TFO)
+        setsockopt(listenfd, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(int));
+
     /* Make it a listening socket ready to accept connection requests */
     if (listen(listenfd, LISTENQ) < 0) {
         close(listenfd);
@@ -1041,7 +1365,70 @@ int open_listenfd(char *port)
     }
     return listenfd;
 }
-/* $end open_listenfd */
+
+/*
+ * unix_addr - Fill in an AF_UNIX address for path. Returns the address
+ *     length, or -1 with errno set to ENAMETOOLONG.
+ */
+static int unix_addr(char *path, struct sockaddr_un *sa)
+{
+    size_t len = strlen(path);
+
+    if (len >= sizeof(sa->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    memcpy(sa->sun_path, path, len + 1);
+    return offsetof(struct sockaddr_un, sun_path) + len + 1;
+}
+
+/*
+ * open_unix_clientfd - Open a connection to a server listening on the
+ *     Unix domain stream socket at path. A local connect finishes (or
+ *     fails) immediately, so there is no timeout. Returns a descriptor,
+ *     or -1 with errno set.
+ */
+int open_unix_clientfd(char *path)
+{
+    struct sockaddr_un sa;
+    int clientfd, len;
+
+    if ((len = unix_addr(path, &sa)) < 0)
+        return -1;
+    if ((clientfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (connect(clientfd, (SA *)&sa, len) < 0) {
+        close(clientfd);
+        return -1;
+    }
+    return clientfd;
+}
+
+/*
+ * open_unix_listenfd - Open a listening Unix domain stream socket at
+ *     path, replacing a stale socket file left by an earlier run.
+ *     Returns a descriptor, or -1 with errno set.
+ */
+int open_unix_listenfd(char *path)
+{
+    struct sockaddr_un sa;
+    struct stat st;
+    int listenfd, len;
+
+    if ((len = unix_addr(path, &sa)) < 0)
+        return -1;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(path);
+    if ((listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return -1;
+    if (bind(listenfd, (SA *)&sa, len) < 0 || listen(listenfd, LISTENQ) < 0) {
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
 
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
@@ -1064,6 +1451,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_unix_listenfd(char *path)
+{
+    int rc;
+
+    if ((rc = open_unix_listenfd(path)) < 0)
+	unix_error("Open_unix_listenfd error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
@@ -0,0 +1,326 @@
+/*
+ * dns.c - 이름 해석 캐시와 resolver 스레드 풀
+ *
+ * 해시 테이블(체이닝) 하나와 mutex 하나. getaddrinfo 는 resolver 스레드만
+ * 부른다. 미스가 나면 질의(dns_query_t)를 만들어 작업 큐에 넣고, 같은 키로
+ * 오는 요청은 새 질의를 만들지 않고 진행 중인 질의의 대기자로 붙는다.
+ * 결과를 넣을 때 같은 키의 옛 항목을 떼어낸다. 떼어낸 항목도 쓰고 있는
+ * 스레드가 놓을 때까지(refcnt) 살아 있다.
+ */
+#include "dns.h"
+#include "conf.h"
+
+#define DNS_NBUCKETS 1024   /* 2의 거듭제곱 */
+
+/* 질의 결과를 기다리는 쪽. cb 가 NULL 이면 dns_lookup 의 스택에 있는 동기 대기자 */
+typedef struct dns_waiter {
+  dns_cb_t *cb;
+  void *arg;
+  dns_ent_t *ent;          /* 동기 대기자: 결과 */
+  int done;
+  struct dns_query *q;     /* 타임아웃 때 자신을 떼어내기 위함 */
+  struct dns_waiter *next;
+} dns_waiter_t;
+
+/* 진행 중인 getaddrinfo 한 건 */
+typedef struct dns_query {
+  char *key, *host, *port;
+  unsigned long long hash;
+  dns_waiter_t *waiters;
+  struct dns_query *next;  /* in-flight 리스트 */
+  struct dns_query *qnext; /* 작업 큐 (resolver 가 꺼내기 전까지) */
+} dns_query_t;
+
+static dns_ent_t *buckets[DNS_NBUCKETS];
+static int nentries;
+static dns_stats_t stats;
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static dns_query_t *inflight;            /* 진행 중인 질의 (키당 하나) */
+static dns_query_t *qhead, *qtail;       /* resolver 작업 큐 */
+static pthread_cond_t job_cond;          /* 큐에 일이 생김 */
+static pthread_cond_t done_cond;         /* 어떤 질의가 끝남 (동기 대기자용) */
+
+/* FNV-1a 64bit */
+static unsigned long long key_hash(const char *key)
+{
+  unsigned long long h = 1469598103934665603ULL;
+
+  while (*key) {
+    h ^= (unsigned char)*key++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void ent_free(dns_ent_t *e)
+{
+  if (e->addrs)
+    freeaddrinfo(e->addrs);
+  Free(e->key);
+  Free(e);
+}
+
+/* 해시에서 떼어냄. 락을 잡은 상태에서 호출 */
+static void ent_remove(dns_ent_t **pp)
+{
+  dns_ent_t *e = *pp;
+
+  *pp = e->hnext;
+  nentries--;
+  if (--e->refcnt == 0)
+    ent_free(e);
+}
+
+/* 만료된 항목 전부 정리. 캐시가 가득 찼을 때만 부르므로 드묾 */
+static void sweep_locked(long long now)
+{
+  dns_ent_t **pp;
+  int i;
+
+  for (i = 0; i < DNS_NBUCKETS; i++)
+    for (pp = &buckets[i]; *pp; )
+      if ((*pp)->expires <= now)
+        ent_remove(pp);
+      else
+        pp = &(*pp)->hnext;
+}
+
+static int resolve(const char *host, const char *port, struct addrinfo **listp)
+{
+  struct addrinfo hints;
+
+  /* open_clientfd 와 같은 hints */
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  return getaddrinfo(host, port, &hints, listp);
+}
+
+/* 캐시 히트면 참조를 잡은 항목을, 아니면 w 를 진행 중인 질의에 붙이고
+   (없으면 새 질의를 큐에 넣고) NULL. dns_lock 을 잡은 상태에서 호출 */
+static dns_ent_t *lookup_or_wait(const char *host, const char *port, dns_waiter_t *w)
+{
+  char key[MAXLINE];
+  unsigned long long h;
+  dns_query_t *q;
+  dns_ent_t *e;
+  long long now = msec_now();
+
+  snprintf(key, sizeof(key), "%s:%s", host, port);
+  h = key_hash(key);
+
+  for (e = buckets[h & (DNS_NBUCKETS - 1)]; e; e = e->hnext) {
+    if (e->hash == h && !strcmp(e->key, key) && e->expires > now) {
+      e->refcnt++;
+      stats.hits++;
+      if (e->err)
+        stats.neg_hits++;
+      return e;
+    }
+  }
+
+  /* 같은 이름을 이미 누가 찾는 중이면 그 결과를 같이 기다림 */
+  for (q = inflight; q; q = q->next)
+    if (q->hash == h && !strcmp(q->key, key))
+      break;
+  if (q) {
+    stats.joins++;
+  } else {
+    stats.misses++;
+    q = Calloc(1, sizeof(dns_query_t));
+    q->key = strdup(key);
+    q->host = strdup(host);
+    q->port = strdup(port);
+    q->hash = h;
+    q->next = inflight;
+    inflight = q;
+    if (qtail) qtail->qnext = q; else qhead = q;
+    qtail = q;
+    pthread_cond_signal(&job_cond);
+  }
+  w->q = q;
+  w->next = q->waiters;
+  q->waiters = w;
+  return NULL;
+}
+
+/* 결과를 캐시에 넣음 (TTL이 0이면 안 넣음). dns_lock 을 잡은 상태에서 호출 */
+static void ent_insert(dns_ent_t *e)
+{
+  dns_ent_t **pp;
+  long long now = msec_now();
+  int ttl = e->err ? conf.dns_negative_ttl_ms : conf.dns_ttl_ms;
+
+  if (ttl <= 0 || conf.dns_cache_max <= 0)
+    return;  /* 캐시 안 함: 마지막 release 때 해제 */
+  e->expires = now + ttl;
+
+  /* 같은 키의 옛 항목(만료된 것)은 교체 */
+  for (pp = &buckets[e->hash & (DNS_NBUCKETS - 1)]; *pp; pp = &(*pp)->hnext) {
+    if ((*pp)->hash == e->hash && !strcmp((*pp)->key, e->key)) {
+      ent_remove(pp);
+      break;
+    }
+  }
+  if (nentries >= conf.dns_cache_max)
+    sweep_locked(now);
+  if (nentries < conf.dns_cache_max) {
+    pp = &buckets[e->hash & (DNS_NBUCKETS - 1)];
+    e->hnext = *pp;
+    *pp = e;
+    e->refcnt++;
+    nentries++;
+  }
+}
+
+static void *resolver_thread(void *vargp)
+{
+  dns_waiter_t *w, *next, *async;
+  dns_query_t *q, **qp;
+  dns_ent_t *e;
+
+  Pthread_detach(pthread_self());
+  while (1) {
+    pthread_mutex_lock(&dns_lock);
+    while (!qhead)
+      pthread_cond_wait(&job_cond, &dns_lock);
+    q = qhead;
+    if (!(qhead = q->qnext))
+      qtail = NULL;
+    pthread_mutex_unlock(&dns_lock);
+
+    /* 락 밖에서 resolver 호출 */
+    e = Calloc(1, sizeof(dns_ent_t));
+    e->key = q->key;
+    e->hash = q->hash;
+    e->refcnt = 1;  /* 이 스레드 몫 */
+    if ((e->err = resolve(q->host, q->port, &e->addrs)) != 0) {
+      fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", q->host, q->port, gai_strerror(e->err));
+      e->addrs = NULL;
+    }
+
+    /* 캐시에 넣고, 대기자마다 참조 하나씩. 동기 대기자는 락 안에서 깨우고
+       비동기 콜백은 락을 놓은 뒤 부른다 */
+    pthread_mutex_lock(&dns_lock);
+    ent_insert(e);
+    for (qp = &inflight; *qp != q; qp = &(*qp)->next)
+      ;
+    *qp = q->next;
+    async = NULL;
+    for (w = q->waiters; w; w = next) {
+      next = w->next;
+      e->refcnt++;
+      if (w->cb) {
+        w->next = async;
+        async = w;
+      } else {
+        w->ent = e;
+        w->done = 1;
+      }
+    }
+    pthread_cond_broadcast(&done_cond);
+    pthread_mutex_unlock(&dns_lock);
+
+    for (w = async; w; w = next) {
+      next = w->next;
+      w->cb(w->arg, e);
+      Free(w);
+    }
+    dns_release(e);
+    Free(q->host);
+    Free(q->port);
+    Free(q);  /* q->key 는 e 가 가져감 */
+  }
+  return NULL;
+}
+
+void dns_init(void)
+{
+  pthread_condattr_t attr;
+  pthread_t tid;
+  int i;
+
+  /* 대기 마감은 msec_now() 와 같은 단조 시계 기준 */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&done_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_cond_init(&job_cond, NULL);
+
+  for (i = 0; i < (conf.dns_resolver_threads > 0 ? conf.dns_resolver_threads : 1); i++)
+    Pthread_create(&tid, NULL, resolver_thread, NULL);
+}
+
+void dns_lookup_async(const char *host, const char *port, dns_cb_t *cb, void *arg)
+{
+  dns_waiter_t *w = Calloc(1, sizeof(dns_waiter_t));
+  dns_ent_t *e;
+
+  w->cb = cb;
+  w->arg = arg;
+  pthread_mutex_lock(&dns_lock);
+  e = lookup_or_wait(host, port, w);
+  pthread_mutex_unlock(&dns_lock);
+  if (e) {
+    Free(w);
+    cb(arg, e);
+  }
+}
+
+dns_ent_t *dns_lookup(const char *host, const char *port)
+{
+  dns_waiter_t w, **wp;
+  struct timespec deadline;
+  dns_ent_t *e;
+  long long until;
+  int rc = 0;
+
+  memset(&w, 0, sizeof(w));
+  pthread_mutex_lock(&dns_lock);
+  if ((e = lookup_or_wait(host, port, &w)) == NULL) {
+    until = msec_now() + conf.dns_timeout_ms;
+    deadline.tv_sec = until / 1000;
+    deadline.tv_nsec = (until % 1000) * 1000000;
+    while (!w.done && rc != ETIMEDOUT)
+      rc = pthread_cond_timedwait(&done_cond, &dns_lock, &deadline);
+    if (w.done) {
+      e = w.ent;
+    } else {
+      /* 마감이 지나면 질의는 그대로 두고(결과는 캐시에 들어감) 혼자 빠짐 */
+      for (wp = &w.q->waiters; *wp != &w; wp = &(*wp)->next)
+        ;
+      *wp = w.next;
+      stats.timeouts++;
+    }
+  }
+  pthread_mutex_unlock(&dns_lock);
+
+  if (!e) {
+    fprintf(stderr, "getaddrinfo timed out (%s:%s)\n", host, port);
+    e = Calloc(1, sizeof(dns_ent_t));
+    e->key = strdup("");
+    e->err = EAI_AGAIN;
+    e->refcnt = 1;
+  }
+  return e;
+}
+
+void dns_release(dns_ent_t *e)
+{
+  int last;
+
+  pthread_mutex_lock(&dns_lock);
+  last = --e->refcnt == 0;
+  pthread_mutex_unlock(&dns_lock);
+  if (last)
+    ent_free(e);
+}
+
+void dns_stats(dns_stats_t *st)
+{
+  pthread_mutex_lock(&dns_lock);
+  *st = stats;
+  st->entries = nentries;
+  pthread_mutex_unlock(&dns_lock);
+}
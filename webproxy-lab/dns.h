@@ -0,0 +1,54 @@
+/*
+ * dns.h - 이름 해석 캐시와 비동기 resolver
+ *
+ * (host, port) → getaddrinfo 결과를 dns_ttl_ms 동안 들고 있다. 실패한
+ * 결과도 dns_negative_ttl_ms 동안 기억해서, 없는 이름 때문에 매번 resolver
+ * 를 기다리지 않는다. 항목은 참조 카운트로 잡아두므로 히트는 락 안에서
+ * 포인터만 만지고 아무것도 할당하지 않는다.
+ *
+ * 미스는 resolver 스레드 풀(dns_resolver_threads)이 처리하고, 같은 이름을
+ * 동시에 찾는 요청들은 진행 중인 질의 하나를 같이 기다린다. 워커 스레드는
+ * dns_lookup 으로 최대 dns_timeout_ms 까지만 기다리고, 이벤트 루프 쪽은
+ * dns_lookup_async 의 콜백으로 결과를 받는다.
+ */
+#ifndef __DNS_H__
+#define __DNS_H__
+
+#include "csapp.h"
+
+typedef struct dns_ent {
+  char *key;               /* "host:port" */
+  unsigned long long hash;
+  int err;                 /* getaddrinfo 에러 코드 (0이면 성공) */
+  struct addrinfo *addrs;  /* err == 0 일 때만 */
+  long long expires;       /* msec_now() 기준 만료 시각 */
+  int refcnt;              /* 캐시 자신 1 + 사용 중인 스레드 수 */
+  struct dns_ent *hnext;
+} dns_ent_t;
+
+/* 결과 콜백. e 의 참조 하나를 넘겨받으므로 다 쓰면 dns_release */
+typedef void dns_cb_t(void *arg, dns_ent_t *e);
+
+void dns_init(void);  /* resolver 스레드 시작 */
+
+/* 항상 항목 하나를 돌려준다 (실패/타임아웃도 err 에 담아서). 다 쓰면 dns_release */
+dns_ent_t *dns_lookup(const char *host, const char *port);
+
+/* 블록하지 않음. 캐시 히트면 호출한 스레드에서 바로, 아니면 resolver 스레드에서
+   cb 를 부른다. cb 안에서는 오래 머물지 말 것 (다른 질의가 밀림) */
+void dns_lookup_async(const char *host, const char *port, dns_cb_t *cb, void *arg);
+
+void dns_release(dns_ent_t *e);
+
+typedef struct {
+  long long hits;          /* 캐시에서 바로 돌려준 횟수 (negative 포함) */
+  long long neg_hits;      /* 그중 실패 결과 */
+  long long misses;        /* getaddrinfo 를 부른 횟수 */
+  long long joins;         /* 진행 중인 같은 질의에 붙은 횟수 */
+  long long timeouts;      /* dns_timeout_ms 안에 답을 못 받은 횟수 */
+  long long entries;       /* 현재 캐시 항목 수 */
+} dns_stats_t;
+
+void dns_stats(dns_stats_t *st);
+
+#endif /* __DNS_H__ */
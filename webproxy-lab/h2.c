@@ -0,0 +1,1140 @@
+/*
+ * h2.c - HTTP/2 cleartext (h2c) 프론트엔드 (RFC 9113)
+ */
+#include "h2.h"
+#include "hpack.h"
+#include "conf.h"
+#include "backend.h"
+#include "hname.h"
+
+/* 프레임 타입 */
+#define H2_DATA          0x0
+#define H2_HEADERS       0x1
+#define H2_PRIORITY      0x2
+#define H2_RST_STREAM    0x3
+#define H2_SETTINGS      0x4
+#define H2_PUSH_PROMISE  0x5
+#define H2_PING          0x6
+#define H2_GOAWAY        0x7
+#define H2_WINDOW_UPDATE 0x8
+#define H2_CONTINUATION  0x9
+
+/* 플래그 */
+#define F_END_STREAM  0x1
+#define F_ACK         0x1
+#define F_END_HEADERS 0x4
+#define F_PADDED      0x8
+#define F_PRIORITY    0x20
+
+/* 오류 코드 */
+#define E_NO_ERROR       0x0
+#define E_PROTOCOL       0x1
+#define E_INTERNAL       0x2
+#define E_FLOW_CONTROL   0x3
+#define E_STREAM_CLOSED  0x5
+#define E_FRAME_SIZE     0x6
+#define E_REFUSED_STREAM 0x7
+#define E_COMPRESSION    0x9
+#define E_CALM           0xb   /* ENHANCE_YOUR_CALM */
+
+/* SETTINGS */
+#define S_HEADER_TABLE_SIZE      0x1
+#define S_MAX_CONCURRENT_STREAMS 0x3
+#define S_INITIAL_WINDOW_SIZE    0x4
+#define S_MAX_FRAME_SIZE         0x5
+
+#define H2_FRAME_MAX    16384        /* 우리 SETTINGS_MAX_FRAME_SIZE (기본값) */
+#define H2_WINDOW       65535        /* 우리가 받는 window (기본값) */
+#define H2_WINDOW_MAX   0x7fffffffLL
+#define H2_HDRBLOCK_MAX (64 * 1024)  /* CONTINUATION 으로 이어 받는 헤더 블록 상한 */
+
+static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+#define PREFACE_HEAD 18              /* "PRI * HTTP/2.0\r\n\r\n": 헤더 없는 HTTP/1 요청으로 읽힘 */
+
+typedef struct h2conn h2conn_t;
+
+typedef struct h2stream {
+  h2conn_t *c;
+  unsigned int id;
+  int fd;                /* socketpair 의 이쪽 끝: 요청과 본문을 쓰고 응답을 읽음 */
+  char *req;             /* 처리 함수에 넘길 HTTP/1.1 요청 헤더 */
+  size_t reqlen;
+  int head;              /* HEAD 요청: 응답 본문 없음 */
+  int chunked;           /* 본문 길이를 모름: 처리 함수에는 chunked 로 넘김 */
+  char *body;            /* 받았지만 아직 처리 함수에 넘기지 않은 본문 */
+  size_t blen;
+  int end_remote;        /* 클라이언트가 END_STREAM 을 보냄 */
+  int reset;             /* RST_STREAM 을 주고받음: 더 보내지 않음 */
+  long long recv_window; /* 클라이언트가 더 보낼 수 있는 본문 바이트 */
+  long long send_window; /* 우리가 더 보낼 수 있는 DATA 바이트 (SETTINGS 로 음수가 될 수 있음) */
+  struct h2stream *next;
+} h2stream_t;
+
+struct h2conn {
+  int fd;
+  rio_t *rp;
+  pthread_mutex_t mutex;   /* 아래 상태 전부 */
+  pthread_mutex_t wmutex;  /* fd 쓰기와 인코더 (헤더 블록은 인코드한 순서대로 나가야 함) */
+  pthread_cond_t cond;     /* window, 본문 도착, 스트림 종료, 연결 종료 */
+  hpack_t dec, enc;
+  h2stream_t *streams;
+  int nstreams;
+  unsigned int last_id;    /* 클라이언트가 연 가장 큰 스트림 id */
+  long long send_window;   /* 연결 수준 window */
+  long long init_window;   /* 클라이언트 SETTINGS_INITIAL_WINDOW_SIZE */
+  int dead;                /* 연결이 끝남: 스트림들은 정리만 */
+  char local_host[NI_MAXHOST], local_port[NI_MAXSERV];  /* :authority 가 프록시 자신인지 */
+};
+
+/* HEADERS 를 HTTP/1.1 요청으로 바꾸는 중 (hpack_cb_t 의 arg) */
+typedef struct {
+  char method[16], scheme[16], authority[MAXLINE], path[MAXLINE], host[MAXLINE];
+  char hdrs[MAXBUF];     /* 일반 헤더를 "name: value\r\n" 로 */
+  size_t hlen;
+  char cookie[MAXBUF];   /* cookie 는 나뉘어 오므로 "; " 로 다시 이음 */
+  size_t cklen;
+  long long clen;        /* content-length (-1이면 없음) */
+  int regular;           /* 일반 헤더가 나옴 (그 뒤 pseudo-header 는 잘못) */
+  int bad;               /* 형식이 틀림: RST_STREAM(PROTOCOL_ERROR) */
+  int toolarge;          /* 버퍼를 넘음: 431 */
+} h2req_t;
+
+static void *(*serve_conn)(void *);
+static long long nconns, nstreams_total;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void h2_init(void *(*serve)(void *))
+{
+  serve_conn = serve;
+}
+
+void h2_stats(long long *conns, long long *streams)
+{
+  pthread_mutex_lock(&stats_lock);
+  *conns = nconns;
+  *streams = nstreams_total;
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static void put32(unsigned char *p, unsigned int v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static unsigned int get32(const unsigned char *p)
+{
+  return (unsigned int)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+/* 프레임 하나 (헤더 9바이트 + payload 를 writev 한 번으로). wmutex 를 잡은 채로 */
+static int frame_write_locked(h2conn_t *c, int type, int flags, unsigned int id,
+                              const void *payload, size_t len)
+{
+  unsigned char fh[9];
+  hdr_t hdr;
+
+  fh[0] = len >> 16;
+  fh[1] = len >> 8;
+  fh[2] = len;
+  fh[3] = type;
+  fh[4] = flags;
+  put32(fh + 5, id);
+  hdr_init(&hdr);
+  hdr_add(&hdr, fh, 9);
+  if (len > 0)
+    hdr_add(&hdr, payload, len);
+  return hdr_writev(c->fd, &hdr) < 0 ? -1 : 0;
+}
+
+static int frame_write(h2conn_t *c, int type, int flags, unsigned int id,
+                       const void *payload, size_t len)
+{
+  int rc;
+
+  pthread_mutex_lock(&c->wmutex);
+  rc = frame_write_locked(c, type, flags, id, payload, len);
+  pthread_mutex_unlock(&c->wmutex);
+  return rc;
+}
+
+static void send_rst(h2conn_t *c, unsigned int id, unsigned int err)
+{
+  unsigned char p[4];
+
+  put32(p, err);
+  frame_write(c, H2_RST_STREAM, 0, id, p, 4);
+}
+
+static void send_window_update(h2conn_t *c, unsigned int id, unsigned int inc)
+{
+  unsigned char p[4];
+
+  put32(p, inc);
+  frame_write(c, H2_WINDOW_UPDATE, 0, id, p, 4);
+}
+
+static void send_goaway(h2conn_t *c, unsigned int err)
+{
+  unsigned char p[8];
+
+  pthread_mutex_lock(&c->mutex);
+  put32(p, c->last_id);
+  pthread_mutex_unlock(&c->mutex);
+  put32(p + 4, err);
+  frame_write(c, H2_GOAWAY, 0, 0, p, 8);
+}
+
+/* 헤더 블록 하나를 HEADERS (+ CONTINUATION) 으로. names/values 는 n 개 */
+static int send_headers(h2conn_t *c, unsigned int id, int end_stream,
+                        const char **names, const char **values, int n)
+{
+  unsigned char block[MAXBUF * 2];
+  size_t len, off, chunk;
+  int i, m, rc = 0;
+
+  pthread_mutex_lock(&c->wmutex);
+  if ((m = hpack_encode_begin(&c->enc, block, sizeof(block))) < 0)
+    rc = -1;
+  len = m;
+  for (i = 0; i < n && rc == 0; i++) {
+    m = hpack_encode(&c->enc, block + len, sizeof(block) - len,
+                     names[i], strlen(names[i]), values[i], strlen(values[i]));
+    if (m < 0)
+      rc = -1;  /* 인코더 상태가 상대와 어긋났을 수 있으니 연결째 정리됨 */
+    else
+      len += m;
+  }
+  for (off = 0; rc == 0; off += chunk) {
+    chunk = len - off > H2_FRAME_MAX ? H2_FRAME_MAX : len - off;
+    rc = frame_write_locked(c, off == 0 ? H2_HEADERS : H2_CONTINUATION,
+                            (off == 0 && end_stream ? F_END_STREAM : 0) |
+                            (off + chunk == len ? F_END_HEADERS : 0),
+                            id, block + off, chunk);
+    if (off + chunk == len)
+      break;
+  }
+  pthread_mutex_unlock(&c->wmutex);
+  return rc;
+}
+
+/* 처리 함수를 거치지 않는 짧은 응답 (:status 만, 본문 없음) */
+static void send_status(h2conn_t *c, unsigned int id, const char *status)
+{
+  const char *name = ":status";
+
+  send_headers(c, id, 1, &name, &status, 1);
+}
+
+static h2stream_t *stream_find(h2conn_t *c, unsigned int id)
+{
+  h2stream_t *s;
+
+  for (s = c->streams; s; s = s->next)
+    if (s->id == id)
+      return s;
+  return NULL;
+}
+
+/* 스트림이 끝남: 목록에서 빼고 정리. rst 가 있으면 RST_STREAM 을 먼저 보냄
+   (nstreams 가 0이 되면 연결 스레드가 fd 를 닫을 수 있으므로 그 전에 써야 함) */
+static void stream_close(h2stream_t *s, int rst, unsigned int err)
+{
+  h2conn_t *c = s->c;
+  h2stream_t **pp;
+
+  if (rst)
+    send_rst(c, s->id, err);
+  pthread_mutex_lock(&c->mutex);
+  for (pp = &c->streams; *pp != s; pp = &(*pp)->next)
+    ;
+  *pp = s->next;
+  c->nstreams--;
+  pthread_cond_broadcast(&c->cond);
+  pthread_mutex_unlock(&c->mutex);
+  close(s->fd);
+  Free(s->req);
+  Free(s->body);
+  Free(s);
+}
+
+/* 요청 헤더와 본문을 처리 함수 쪽으로. 처리 함수가 본문을 다 읽기 전에 응답하고
+   닫았으면 쓰기가 실패하는데, 그래도 응답은 읽어야 하므로 0 (나머지 본문은 응답 뒤에
+   stream_discard 가 받아 버림).
+   연결이 끝났거나 스트림이 리셋됐으면 -1 */
+static int stream_feed(h2stream_t *s)
+{
+  h2conn_t *c = s->c;
+  char line[32], *buf;
+  size_t n;
+  int ok;
+
+  ok = rio_writen(s->fd, s->req, s->reqlen) == s->reqlen;
+  pthread_mutex_lock(&c->mutex);
+  while (ok) {
+    while (s->blen == 0 && !s->end_remote && !s->reset && !c->dead)
+      pthread_cond_wait(&c->cond, &c->mutex);
+    if (s->reset || c->dead) {
+      pthread_mutex_unlock(&c->mutex);
+      return -1;
+    }
+    if (s->blen == 0)
+      break;  /* END_STREAM 까지 다 넘김 */
+    buf = s->body;
+    n = s->blen;
+    s->body = NULL;
+    s->blen = 0;
+    pthread_mutex_unlock(&c->mutex);
+
+    if (s->chunked) {
+      snprintf(line, sizeof(line), "%zx\r\n", n);
+      ok = rio_writen(s->fd, line, strlen(line)) > 0 && rio_writen(s->fd, buf, n) == n &&
+           rio_writen(s->fd, "\r\n", 2) == 2;
+    } else {
+      ok = rio_writen(s->fd, buf, n) == n;
+    }
+    Free(buf);
+
+    /* 넘긴 만큼 클라이언트가 더 보낼 수 있음. 처리 함수가 안 읽으면 여기서 막혀
+       window 가 돌아가지 않으므로 버퍼는 window 이상 쌓이지 않는다 */
+    pthread_mutex_lock(&c->mutex);
+    if (!s->end_remote && ok) {
+      s->recv_window += n;
+      pthread_mutex_unlock(&c->mutex);
+      send_window_update(c, s->id, n);
+      pthread_mutex_lock(&c->mutex);
+    }
+  }
+  pthread_mutex_unlock(&c->mutex);
+  if (ok && s->chunked)
+    rio_writen(s->fd, "0\r\n\r\n", 5);
+  shutdown(s->fd, SHUT_WR);
+  return 0;
+}
+
+/* DATA 를 window 안에서 잘라 보냄. end 면 마지막 조각에 END_STREAM */
+static int send_data(h2stream_t *s, const char *buf, size_t len, int end)
+{
+  h2conn_t *c = s->c;
+  size_t off = 0, n;
+
+  do {
+    pthread_mutex_lock(&c->mutex);
+    while (len > 0 && !s->reset && !c->dead && (s->send_window <= 0 || c->send_window <= 0))
+      pthread_cond_wait(&c->cond, &c->mutex);
+    if (s->reset || c->dead) {
+      pthread_mutex_unlock(&c->mutex);
+      return -1;
+    }
+    n = len - off;
+    if ((long long)n > s->send_window)
+      n = s->send_window;
+    if ((long long)n > c->send_window)
+      n = c->send_window;
+    s->send_window -= n;
+    c->send_window -= n;
+    pthread_mutex_unlock(&c->mutex);
+
+    if (frame_write(c, H2_DATA, end && off + n == len ? F_END_STREAM : 0, s->id, buf + off, n) < 0)
+      return -1;
+    off += n;
+  } while (off < len);
+  return 0;
+}
+
+/* 본문 n 바이트를 읽는 대로 DATA 로 (n < 0 이면 EOF 까지). last 면 끝에 END_STREAM */
+static int relay_body(h2stream_t *s, rio_t *rp, long long n, int last)
+{
+  char buf[H2_FRAME_MAX];
+  ssize_t m;
+  size_t want;
+
+  while (n != 0) {
+    want = n < 0 || n > (long long)sizeof(buf) ? sizeof(buf) : (size_t)n;
+    if ((m = rio_readnb(rp, buf, want)) <= 0)
+      return n < 0 && m == 0 ? send_data(s, NULL, 0, last) : -1;
+    if (n > 0)
+      n -= m;
+    if (send_data(s, buf, m, last && n == 0) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* 처리 함수가 쓴 HTTP/1.1 응답을 HEADERS/DATA 로 바꿔 보냄.
+   성공 0, 응답이 이상하면 RST_STREAM 에 쓸 오류 코드 */
+static int stream_respond(h2stream_t *s)
+{
+  rio_t rio;
+  char line[MAXLINE], status[4], store[MAXBUF], *colon, *v, *e;
+  const char *names[64], *values[64];
+  size_t used = 0, nl, vl;
+  long long clen = -1;
+  int code, n = 0, chunked = 0, nobody, i;
+
+  rio_readinitb(&rio, s->fd);
+  if (rio_readlineb(&rio, line, MAXLINE) <= 0 || sscanf(line, "HTTP/1.%*d %3d", &code) != 1 ||
+      code < 200)
+    return E_INTERNAL;
+  snprintf(status, sizeof(status), "%d", code);
+  names[n] = ":status";
+  values[n++] = status;
+
+  /* 헤더: 이름은 소문자로, 연결 관리 헤더는 HTTP/2 에 없으므로 버림 */
+  while (1) {
+    if (rio_readlineb(&rio, line, MAXLINE) <= 0)
+      return E_INTERNAL;
+    if (!strcmp(line, "\r\n") || !strcmp(line, "\n"))
+      break;
+    if ((colon = strchr(line, ':')) == NULL)
+      continue;
+    *colon = '\0';
+    for (v = colon + 1; *v == ' ' || *v == '\t'; v++)
+      ;
+    for (e = v + strlen(v); e > v && (e[-1] == '\r' || e[-1] == '\n' || e[-1] == ' '); e--)
+      ;
+    *e = '\0';
+    for (i = 0; line[i]; i++)
+      line[i] = tolower((unsigned char)line[i]);
+
+    switch (hname_lookup(line, colon - line)) {
+    case HN_TRANSFER_ENCODING:
+      chunked = strstr(v, "chunked") != NULL;
+      continue;
+    case HN_CONNECTION:
+    case HN_KEEP_ALIVE:
+    case HN_PROXY_CONNECTION:
+    case HN_UPGRADE:
+      continue;
+    case HN_CONTENT_LENGTH:
+      clen = strtoll(v, NULL, 10);
+      break;
+    default:
+      break;
+    }
+
+    nl = strlen(line) + 1;
+    vl = strlen(v) + 1;
+    if (n == 64 || used + nl + vl > sizeof(store))
+      return E_INTERNAL;
+    names[n] = memcpy(store + used, line, nl);
+    values[n++] = memcpy(store + used + nl, v, vl);
+    used += nl + vl;
+  }
+
+  nobody = s->head || code == 204 || code == 304 || (!chunked && clen == 0);
+  pthread_mutex_lock(&s->c->mutex);
+  i = s->reset || s->c->dead;
+  pthread_mutex_unlock(&s->c->mutex);
+  if (i || send_headers(s->c, s->id, nobody, names, values, n) < 0)
+    return -1;
+  if (nobody)
+    return 0;
+
+  if (!chunked)
+    return relay_body(s, &rio, clen, 1) < 0 ? -1 : 0;
+
+  /* chunked 는 청크 크기 줄만 벗겨서 그대로 DATA 로 (trailer 는 버림) */
+  while (1) {
+    if (rio_readlineb(&rio, line, MAXLINE) <= 0)
+      return -1;
+    if ((clen = strtoll(line, NULL, 16)) <= 0)
+      break;
+    if (relay_body(s, &rio, clen, 0) < 0 || rio_readlineb(&rio, line, MAXLINE) <= 0)
+      return -1;
+  }
+  do {
+    if (rio_readlineb(&rio, line, MAXLINE) <= 0)
+      return -1;
+  } while (strcmp(line, "\r\n") && strcmp(line, "\n"));
+  return send_data(s, NULL, 0, 1);
+}
+
+/* 응답을 다 보냈는데 클라이언트가 아직 본문을 보내는 중이면 END_STREAM 까지 받아 버림.
+   RST_STREAM(NO_ERROR) 로 끊어도 되지만 (8.1) 그러면 받은 응답까지 버리는 클라이언트가 있음 */
+static void stream_discard(h2stream_t *s)
+{
+  h2conn_t *c = s->c;
+  size_t n;
+
+  pthread_mutex_lock(&c->mutex);
+  while (!s->end_remote && !s->reset && !c->dead) {
+    if ((n = s->blen) == 0) {
+      pthread_cond_wait(&c->cond, &c->mutex);
+      continue;
+    }
+    Free(s->body);
+    s->body = NULL;
+    s->blen = 0;
+    s->recv_window += n;
+    pthread_mutex_unlock(&c->mutex);
+    send_window_update(c, s->id, n);
+    pthread_mutex_lock(&c->mutex);
+  }
+  pthread_mutex_unlock(&c->mutex);
+}
+
+/* 스트림 하나: 본문을 넘기고, 응답을 프레임으로 바꿔 보냄 */
+static void *stream_thread(void *vargp)
+{
+  h2stream_t *s = vargp;
+  h2conn_t *c = s->c;
+  int err = -1, rst;
+
+  Pthread_detach(pthread_self());
+  if (stream_feed(s) == 0 && (err = stream_respond(s)) == 0)
+    stream_discard(s);
+
+  /* 응답이 이상하면 이 스트림만 끝냄 */
+  pthread_mutex_lock(&c->mutex);
+  rst = !s->reset && !c->dead && err > 0;
+  pthread_mutex_unlock(&c->mutex);
+  stream_close(s, rst, err);
+  return NULL;
+}
+
+/* 새 스트림: socketpair 한쪽 끝은 HTTP/1.1 처리 함수로, 다른 쪽은 스트림 스레드로 */
+static int stream_open(h2conn_t *c, unsigned int id, char *req, size_t reqlen,
+                       int head, int chunked, int end_remote)
+{
+  h2stream_t *s;
+  pthread_t tid;
+  int sv[2], *fdp;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+    return -1;
+  s = Calloc(1, sizeof(h2stream_t));
+  s->c = c;
+  s->id = id;
+  s->fd = sv[0];
+  s->req = req;
+  s->reqlen = reqlen;
+  s->head = head;
+  s->chunked = chunked;
+  s->end_remote = end_remote;
+  s->recv_window = H2_WINDOW;
+
+  pthread_mutex_lock(&c->mutex);
+  s->send_window = c->init_window;
+  s->next = c->streams;
+  c->streams = s;
+  c->nstreams++;
+  pthread_mutex_unlock(&c->mutex);
+
+  pthread_mutex_lock(&stats_lock);
+  nstreams_total++;
+  pthread_mutex_unlock(&stats_lock);
+
+  fdp = Malloc(sizeof(int));
+  *fdp = sv[1];
+  Pthread_create(&tid, NULL, serve_conn, fdp);
+  Pthread_create(&tid, NULL, stream_thread, s);
+  return 0;
+}
+
+/* hpack_cb_t: 디코드한 헤더를 h2req_t 에 모음 */
+static void on_header(void *arg, const char *name, size_t nlen, const char *value, size_t vlen)
+{
+  h2req_t *r = arg;
+  char *dst = NULL;
+  size_t size = 0, i;
+  int n;
+
+  if (r->bad || r->toolarge)
+    return;
+  if (nlen > 0 && name[0] == ':') {
+    if (nlen == 7 && !memcmp(name, ":method", 7))
+      dst = r->method, size = sizeof(r->method);
+    else if (nlen == 7 && !memcmp(name, ":scheme", 7))
+      dst = r->scheme, size = sizeof(r->scheme);
+    else if (nlen == 10 && !memcmp(name, ":authority", 10))
+      dst = r->authority, size = sizeof(r->authority);
+    else if (nlen == 5 && !memcmp(name, ":path", 5))
+      dst = r->path, size = sizeof(r->path);
+    if (dst == NULL || r->regular || dst[0]) {  /* 모르는 것, 일반 헤더 뒤, 중복 */
+      r->bad = 1;
+      return;
+    }
+    if (vlen >= size) {
+      r->toolarge = 1;
+      return;
+    }
+    memcpy(dst, value, vlen);
+    dst[vlen] = '\0';
+    return;
+  }
+
+  r->regular = 1;
+  for (i = 0; i < nlen; i++) {
+    if (isupper((unsigned char)name[i])) {  /* HTTP/2 헤더 이름은 소문자만 */
+      r->bad = 1;
+      return;
+    }
+  }
+  switch (hname_lookup(name, nlen)) {
+  /* 연결 관리 헤더는 HTTP/2 에 없음. host, content-length 는 요청을 만들 때 다시 씀 */
+  case HN_CONNECTION:
+  case HN_KEEP_ALIVE:
+  case HN_PROXY_CONNECTION:
+  case HN_TRANSFER_ENCODING:
+  case HN_UPGRADE:
+  case HN_TE:
+    return;
+  case HN_HOST:
+    if (vlen >= sizeof(r->host))
+      r->toolarge = 1;
+    else
+      memcpy(r->host, value, vlen), r->host[vlen] = '\0';
+    return;
+  case HN_CONTENT_LENGTH:
+    /* 값은 NUL 로 끝나지 않음 */
+    for (r->clen = 0, i = 0; i < vlen && r->clen < (1LL << 50); i++) {
+      if (!isdigit((unsigned char)value[i])) {
+        r->bad = 1;
+        return;
+      }
+      r->clen = r->clen * 10 + (value[i] - '0');
+    }
+    if (vlen == 0 || i < vlen)
+      r->bad = 1;
+    return;
+  case HN_COOKIE:
+    n = snprintf(r->cookie + r->cklen, sizeof(r->cookie) - r->cklen, "%s%.*s",
+                 r->cklen ? "; " : "", (int)vlen, value);
+    if (n >= (int)(sizeof(r->cookie) - r->cklen))
+      r->toolarge = 1;
+    else
+      r->cklen += n;
+    return;
+  default:
+    break;
+  }
+  n = snprintf(r->hdrs + r->hlen, sizeof(r->hdrs) - r->hlen, "%.*s: %.*s\r\n",
+               (int)nlen, name, (int)vlen, value);
+  if (n >= (int)(sizeof(r->hdrs) - r->hlen))
+    r->toolarge = 1;
+  else
+    r->hlen += n;
+}
+
+/* :authority 가 이 프록시 자신이면 origin-form (GET /path) 으로 넘겨서 /stats 나
+   backend 풀로 가게 하고, 아니면 그 origin 으로 가는 absolute-form */
+static int is_self(h2conn_t *c, const char *authority)
+{
+  const char *colon = strrchr(authority, ':');
+  const char *port = colon ? colon + 1 : "80";
+  size_t hlen = colon ? (size_t)(colon - authority) : strlen(authority);
+
+  if (strcmp(port, c->local_port))
+    return 0;
+  return (hlen == 9 && !strncasecmp(authority, "localhost", 9)) ||
+         (hlen == strlen(c->local_host) && !strncmp(authority, c->local_host, hlen));
+}
+
+/* Upgrade 로 받은 요청도 HEADERS 와 같은 규칙으로: origin-form 인데 Host 가 프록시
+   자신이 아니면 그 origin 으로 가는 absolute-form 으로 바꿈. Malloc 한 복사본 */
+static char *upgrade_request(h2conn_t *c, const char *req, size_t reqlen, size_t *lenp)
+{
+  const char *target = memchr(req, ' ', reqlen), *host, *end;
+  char *out = Malloc(reqlen + MAXLINE + 8), hostbuf[MAXLINE];
+  size_t n;
+
+  *lenp = reqlen;
+  if (target && target[1] == '/' && !backend_enabled() &&
+      (host = strstr(req, "\r\nHost: ")) != NULL && (end = strstr(host + 8, "\r\n")) != NULL &&
+      end > host + 8 && (n = end - host - 8) < sizeof(hostbuf)) {
+    memcpy(hostbuf, host + 8, n);
+    hostbuf[n] = '\0';
+    if (!is_self(c, hostbuf)) {
+      n = target + 1 - req;
+      memcpy(out, req, n);
+      *lenp = n + sprintf(out + n, "http://%s", hostbuf);
+      memcpy(out + *lenp, target + 1, reqlen - n);
+      *lenp += reqlen - n;
+      return out;
+    }
+  }
+  memcpy(out, req, reqlen);
+  return out;
+}
+
+/* 완성된 헤더 블록 하나 (새 요청 또는 trailer). 연결 오류면 오류 코드, 아니면 0 */
+static int on_request(h2conn_t *c, unsigned int id, int end_stream,
+                      const unsigned char *block, size_t len)
+{
+  h2req_t *r = Calloc(1, sizeof(h2req_t));
+  h2stream_t *s;
+  char *req, *authority;
+  int err = 0, origin_form, reqlen, chunked, refuse;
+
+  r->clen = -1;
+  if (hpack_decode(&c->dec, block, len, on_header, r) < 0) {  /* 디코더가 어긋나면 연결째 */
+    Free(r);
+    return E_COMPRESSION;
+  }
+
+  pthread_mutex_lock(&c->mutex);
+  if ((s = stream_find(c, id)) != NULL) {
+    /* 본문 뒤의 trailer: 본문의 끝으로만 씀 */
+    if (!end_stream || s->end_remote)
+      err = E_PROTOCOL;
+    s->end_remote = 1;
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+    Free(r);
+    return err;
+  }
+  if (id <= c->last_id || (id & 1) == 0) {
+    pthread_mutex_unlock(&c->mutex);
+    Free(r);
+    return id <= c->last_id && (id & 1) ? E_STREAM_CLOSED : E_PROTOCOL;
+  }
+  c->last_id = id;
+  refuse = c->nstreams >= conf.h2_max_streams;
+  pthread_mutex_unlock(&c->mutex);
+
+  authority = r->authority[0] ? r->authority : r->host;
+  if (refuse) {
+    send_rst(c, id, E_REFUSED_STREAM);
+  } else if (r->toolarge) {
+    send_status(c, id, "431");
+    if (!end_stream)
+      send_rst(c, id, E_NO_ERROR);
+  } else if (r->bad || !r->method[0] || (strcmp(r->method, "CONNECT") && (!r->path[0] || !authority[0])) ||
+             (end_stream && r->clen > 0)) {
+    send_rst(c, id, E_PROTOCOL);
+  } else if (!strcmp(r->method, "CONNECT")) {
+    send_status(c, id, "501");  /* h2 위의 터널은 지원하지 않음 */
+    if (!end_stream)
+      send_rst(c, id, E_NO_ERROR);
+  } else {
+    /* HTTP/1.1 요청으로: 본문 길이를 모르면 chunked 로 넘김, 응답 뒤에는 닫음 */
+    origin_form = backend_enabled() || is_self(c, authority);
+    chunked = !end_stream && r->clen < 0;
+    req = Malloc(MAXBUF * 3);
+    reqlen = snprintf(req, MAXBUF * 3, "%s %s%s%s HTTP/1.1\r\nHost: %s\r\n%.*s%s%.*s%s",
+                      r->method, origin_form ? "" : "http://", origin_form ? "" : authority,
+                      r->path, authority, (int)r->hlen, r->hdrs,
+                      r->cklen ? "Cookie: " : "", (int)r->cklen, r->cookie, r->cklen ? "\r\n" : "");
+    if (chunked)
+      reqlen += snprintf(req + reqlen, MAXBUF * 3 - reqlen, "Transfer-Encoding: chunked\r\n");
+    else if (r->clen >= 0)
+      reqlen += snprintf(req + reqlen, MAXBUF * 3 - reqlen, "Content-Length: %lld\r\n", r->clen);
+    reqlen += snprintf(req + reqlen, MAXBUF * 3 - reqlen, "Connection: close\r\n\r\n");
+    if (stream_open(c, id, req, reqlen, !strcmp(r->method, "HEAD"), chunked, end_stream) < 0) {
+      Free(req);
+      send_rst(c, id, E_REFUSED_STREAM);
+    }
+  }
+  Free(r);
+  return 0;
+}
+
+/* DATA: 스트림 버퍼에 붙이고 스트림 스레드를 깨움 */
+static int on_data(h2conn_t *c, unsigned int id, int flags, const unsigned char *p, size_t len)
+{
+  h2stream_t *s;
+  size_t pad = 0, dlen = len;
+
+  if (id == 0)
+    return E_PROTOCOL;
+  if (flags & F_PADDED) {
+    if (len < 1 || (pad = p[0]) >= len)
+      return E_PROTOCOL;
+    p++;
+    dlen = len - 1 - pad;
+  }
+  /* 연결 window 는 바로 돌려줌 (스트림마다 window 만큼만 쌓이므로) */
+  if (len > 0)
+    send_window_update(c, 0, len);
+
+  pthread_mutex_lock(&c->mutex);
+  if (id > c->last_id) {
+    pthread_mutex_unlock(&c->mutex);
+    return E_PROTOCOL;
+  }
+  if ((s = stream_find(c, id)) == NULL || s->end_remote) {
+    pthread_mutex_unlock(&c->mutex);
+    send_rst(c, id, E_STREAM_CLOSED);
+    return 0;
+  }
+  if ((long long)len > s->recv_window) {
+    s->reset = 1;
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_cond_broadcast(&c->cond);
+    pthread_mutex_unlock(&c->mutex);
+    send_rst(c, id, E_FLOW_CONTROL);
+    return 0;
+  }
+  s->recv_window -= dlen;  /* 패딩은 안 쌓이므로 세지 않음 */
+  if (dlen > 0 && !s->reset) {
+    s->body = Realloc(s->body, s->blen + dlen);
+    memcpy(s->body + s->blen, p, dlen);
+    s->blen += dlen;
+  }
+  if (flags & F_END_STREAM)
+    s->end_remote = 1;
+  pthread_cond_broadcast(&c->cond);
+  pthread_mutex_unlock(&c->mutex);
+  if (len > dlen && !(flags & F_END_STREAM))
+    send_window_update(c, id, len - dlen);
+  return 0;
+}
+
+/* SETTINGS 적용 (Upgrade 의 HTTP2-Settings 도 같은 형식). 연결 오류면 오류 코드 */
+static int apply_settings(h2conn_t *c, const unsigned char *p, size_t len)
+{
+  h2stream_t *s;
+  unsigned int id, val;
+  long long delta;
+
+  if (len % 6)
+    return E_FRAME_SIZE;
+  for (; len > 0; p += 6, len -= 6) {
+    id = p[0] << 8 | p[1];
+    val = get32(p + 2);
+    switch (id) {
+    case S_HEADER_TABLE_SIZE:
+      pthread_mutex_lock(&c->wmutex);
+      hpack_set_limit(&c->enc, val);
+      pthread_mutex_unlock(&c->wmutex);
+      break;
+    case S_INITIAL_WINDOW_SIZE:
+      if (val > H2_WINDOW_MAX)
+        return E_FLOW_CONTROL;
+      /* 이미 열린 스트림의 window 도 차이만큼 옮김 (6.9.2) */
+      pthread_mutex_lock(&c->mutex);
+      delta = (long long)val - c->init_window;
+      c->init_window = val;
+      for (s = c->streams; s; s = s->next)
+        s->send_window += delta;
+      pthread_cond_broadcast(&c->cond);
+      pthread_mutex_unlock(&c->mutex);
+      break;
+    case S_MAX_FRAME_SIZE:
+      if (val < 16384 || val > 16777215)
+        return E_PROTOCOL;
+      break;  /* 우리는 늘 16384 이하로 보냄 */
+    }
+  }
+  return 0;
+}
+
+static int on_window_update(h2conn_t *c, unsigned int id, const unsigned char *p, size_t len)
+{
+  unsigned int inc;
+  h2stream_t *s;
+  int err = 0;
+
+  if (len != 4)
+    return E_FRAME_SIZE;
+  inc = get32(p) & 0x7fffffff;
+  pthread_mutex_lock(&c->mutex);
+  if (id == 0) {
+    if (inc == 0 || (c->send_window += inc) > H2_WINDOW_MAX)
+      err = inc == 0 ? E_PROTOCOL : E_FLOW_CONTROL;
+  } else if (id > c->last_id) {
+    err = E_PROTOCOL;
+  } else if ((s = stream_find(c, id)) != NULL && !s->reset &&
+             (inc == 0 || (s->send_window += inc) > H2_WINDOW_MAX)) {
+    /* 스트림 오류: 이 스트림만 끝냄 */
+    s->reset = 1;
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&c->mutex);
+    send_rst(c, id, inc == 0 ? E_PROTOCOL : E_FLOW_CONTROL);
+    pthread_mutex_lock(&c->mutex);
+  }
+  pthread_cond_broadcast(&c->cond);
+  pthread_mutex_unlock(&c->mutex);
+  return err;
+}
+
+static int on_rst_stream(h2conn_t *c, unsigned int id, size_t len)
+{
+  h2stream_t *s;
+  int err = 0;
+
+  if (len != 4)
+    return E_FRAME_SIZE;
+  pthread_mutex_lock(&c->mutex);
+  if (id == 0 || id > c->last_id) {
+    err = E_PROTOCOL;
+  } else if ((s = stream_find(c, id)) != NULL) {
+    /* 처리 함수와 스트림 스레드가 읽기/쓰기에서 바로 빠져나오도록 */
+    s->reset = 1;
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_cond_broadcast(&c->cond);
+  }
+  pthread_mutex_unlock(&c->mutex);
+  return err;
+}
+
+/* Upgrade 의 HTTP2-Settings 는 SETTINGS payload 를 base64url 로 쓴 것 */
+static int b64url_decode(const char *s, unsigned char *out, size_t size)
+{
+  static const char tab[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  unsigned int acc = 0;
+  int bits = 0;
+  size_t n = 0;
+  const char *q;
+
+  for (; *s && *s != '='; s++) {
+    if ((q = strchr(tab, *s)) == NULL)
+      return -1;
+    acc = (acc << 6) | (q - tab);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      if (n == size)
+        return -1;
+      out[n++] = acc >> bits;
+    }
+  }
+  return n;
+}
+
+/* 연결 하나의 프레임 루프. 연결 오류면 오류 코드, 클라이언트가 닫았거나 조용히 끝나면 -1 */
+static int h2_loop(h2conn_t *c)
+{
+  unsigned char fh[9], *p, *block = NULL;
+  unsigned int id, block_id = 0;
+  size_t len, blen = 0;
+  struct pollfd pfd;
+  int type, flags, block_end = 0, err = 0, pad, idle;
+  unsigned char *payload = Malloc(H2_FRAME_MAX);
+
+  pfd.fd = c->fd;
+  pfd.events = POLLIN;
+  while (err == 0) {
+    /* 스트림이 하나도 없이 client_idle_timeout_ms 동안 조용하면 GOAWAY */
+    if (c->rp->rio_cnt == 0 &&
+        poll(&pfd, 1, conf.client_idle_timeout_ms > 0 ? conf.client_idle_timeout_ms : -1) == 0) {
+      pthread_mutex_lock(&c->mutex);
+      idle = c->nstreams == 0;
+      pthread_mutex_unlock(&c->mutex);
+      if (idle)
+        break;
+      continue;
+    }
+    if (rio_readnb(c->rp, fh, 9) != 9) {
+      err = -1;
+      break;
+    }
+    len = fh[0] << 16 | fh[1] << 8 | fh[2];
+    type = fh[3];
+    flags = fh[4];
+    id = get32(fh + 5) & 0x7fffffff;
+    if (len > H2_FRAME_MAX) {
+      err = E_FRAME_SIZE;
+      break;
+    }
+    if (len > 0 && rio_readnb(c->rp, payload, len) != (ssize_t)len) {
+      err = -1;
+      break;
+    }
+    /* 헤더 블록이 CONTINUATION 으로 이어지는 중에는 다른 프레임이 끼면 안 됨 */
+    if (block && (type != H2_CONTINUATION || id != block_id)) {
+      err = E_PROTOCOL;
+      break;
+    }
+    p = payload;
+
+    switch (type) {
+    case H2_DATA:
+      err = on_data(c, id, flags, p, len);
+      break;
+
+    case H2_HEADERS:
+      if (id == 0) {
+        err = E_PROTOCOL;
+        break;
+      }
+      pad = 0;
+      if (flags & F_PADDED) {
+        if (len < 1) {
+          err = E_PROTOCOL;
+          break;
+        }
+        pad = *p++;
+        len--;
+      }
+      if (flags & F_PRIORITY) {  /* 우선순위는 쓰지 않음 */
+        if (len < 5) {
+          err = E_PROTOCOL;
+          break;
+        }
+        p += 5;
+        len -= 5;
+      }
+      if ((size_t)pad > len) {
+        err = E_PROTOCOL;
+        break;
+      }
+      len -= pad;
+      if (flags & F_END_HEADERS) {
+        err = on_request(c, id, flags & F_END_STREAM, p, len);
+      } else {
+        block = Malloc(H2_HDRBLOCK_MAX);
+        memcpy(block, p, len);
+        blen = len;
+        block_id = id;
+        block_end = flags & F_END_STREAM;
+      }
+      break;
+
+    case H2_CONTINUATION:
+      if (!block) {
+        err = E_PROTOCOL;
+        break;
+      }
+      if (blen + len > H2_HDRBLOCK_MAX) {
+        err = E_CALM;
+        break;
+      }
+      memcpy(block + blen, p, len);
+      blen += len;
+      if (flags & F_END_HEADERS) {
+        err = on_request(c, block_id, block_end, block, blen);
+        Free(block);
+        block = NULL;
+      }
+      break;
+
+    case H2_PRIORITY:
+      if (id == 0)
+        err = E_PROTOCOL;
+      else if (len != 5)
+        err = E_FRAME_SIZE;
+      break;
+
+    case H2_RST_STREAM:
+      err = on_rst_stream(c, id, len);
+      break;
+
+    case H2_SETTINGS:
+      if (id != 0)
+        err = E_PROTOCOL;
+      else if (flags & F_ACK)
+        err = len ? E_FRAME_SIZE : 0;
+      else if ((err = apply_settings(c, p, len)) == 0)
+        frame_write(c, H2_SETTINGS, F_ACK, 0, NULL, 0);
+      break;
+
+    case H2_PING:
+      if (id != 0)
+        err = E_PROTOCOL;
+      else if (len != 8)
+        err = E_FRAME_SIZE;
+      else if (!(flags & F_ACK))
+        frame_write(c, H2_PING, F_ACK, 0, p, 8);
+      break;
+
+    case H2_GOAWAY:
+      /* 클라이언트는 새 스트림을 열지 않음. 진행 중인 응답을 다 받고 닫을 것 */
+      if (id != 0)
+        err = E_PROTOCOL;
+      break;
+
+    case H2_WINDOW_UPDATE:
+      err = on_window_update(c, id, p, len);
+      break;
+
+    case H2_PUSH_PROMISE:  /* 클라이언트는 push 하지 않음 */
+      err = E_PROTOCOL;
+      break;
+
+    default:  /* 모르는 프레임은 무시 */
+      break;
+    }
+  }
+  Free(block);
+  Free(payload);
+  return err;
+}
+
+void h2_serve(int fd, rio_t *rp, const char *req, size_t reqlen, const char *settings)
+{
+  static const char switching[] =
+      "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+  unsigned char buf[256];
+  struct sockaddr_storage addr;
+  socklen_t addrlen = sizeof(addr);
+  size_t off = req ? 0 : PREFACE_HEAD;
+  h2conn_t c;
+  h2stream_t *s;
+  char *copy;
+  size_t len;
+  int err = 0, n;
+
+  memset(&c, 0, sizeof(c));
+  c.fd = fd;
+  c.rp = rp;
+  pthread_mutex_init(&c.mutex, NULL);
+  pthread_mutex_init(&c.wmutex, NULL);
+  pthread_cond_init(&c.cond, NULL);
+  hpack_init(&c.dec);
+  hpack_init(&c.enc);
+  c.send_window = H2_WINDOW;
+  c.init_window = H2_WINDOW;
+  if (getsockname(fd, (SA *)&addr, &addrlen) == 0)
+    getnameinfo((SA *)&addr, addrlen, c.local_host, sizeof(c.local_host),
+                c.local_port, sizeof(c.local_port), NI_NUMERICHOST | NI_NUMERICSERV);
+
+  pthread_mutex_lock(&stats_lock);
+  nconns++;
+  pthread_mutex_unlock(&stats_lock);
+
+  /* 느린 클라이언트 하나가 스트림 스레드들을 쓰기에서 영원히 잡지 못하게 */
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO,
+             &(struct timeval){ conf.relay_write_timeout_ms / 1000, (conf.relay_write_timeout_ms % 1000) * 1000 },
+             sizeof(struct timeval));
+
+  /* Upgrade: 101 을 보내고, 받은 요청은 스트림 1 (클라이언트 쪽은 이미 닫힘) */
+  if (req) {
+    if (rio_writen(fd, (void *)switching, sizeof(switching) - 1) != sizeof(switching) - 1)
+      goto done;
+    if (settings && (n = b64url_decode(settings, buf, sizeof(buf))) >= 0)
+      err = apply_settings(&c, buf, n);
+  }
+
+  /* 서버 서문: 우리 SETTINGS (동시 스트림 수만 알림, 나머지는 기본값) */
+  buf[0] = 0;
+  buf[1] = S_MAX_CONCURRENT_STREAMS;
+  put32(buf + 2, conf.h2_max_streams);
+  frame_write(&c, H2_SETTINGS, 0, 0, buf, 6);
+
+  if (req && err == 0) {
+    copy = upgrade_request(&c, req, reqlen, &len);
+    c.last_id = 1;
+    if (stream_open(&c, 1, copy, len, !strncmp(req, "HEAD ", 5), 0, 1) < 0) {
+      Free(copy);
+      send_rst(&c, 1, E_REFUSED_STREAM);
+    }
+  }
+
+  /* 클라이언트 서문 (prior knowledge 는 앞부분을 이미 읽었음) */
+  if (err == 0) {
+    if (rio_readnb(rp, buf, sizeof(preface) - 1 - off) != (ssize_t)(sizeof(preface) - 1 - off) ||
+        memcmp(buf, preface + off, sizeof(preface) - 1 - off))
+      err = E_PROTOCOL;
+    else
+      err = h2_loop(&c);
+  }
+  if (err >= 0)
+    send_goaway(&c, err);
+
+done:
+  /* 남은 스트림을 끝냄. 스트림 스레드가 다 빠져나간 뒤에야 fd 를 돌려줄 수 있음 */
+  pthread_mutex_lock(&c.mutex);
+  c.dead = 1;
+  for (s = c.streams; s; s = s->next)
+    shutdown(s->fd, SHUT_RDWR);
+  pthread_cond_broadcast(&c.cond);
+  while (c.nstreams > 0)
+    pthread_cond_wait(&c.cond, &c.mutex);
+  pthread_mutex_unlock(&c.mutex);
+  hpack_free(&c.dec);
+  hpack_free(&c.enc);
+}
@@ -0,0 +1,35 @@
+/*
+ * h2.h - HTTP/2 cleartext (h2c) 프론트엔드
+ *
+ * 클라이언트가 연결 서문("PRI * HTTP/2.0")으로 바로 시작하거나(prior knowledge)
+ * 첫 HTTP/1.1 요청에 Upgrade: h2c 를 붙이면 그 연결은 HTTP/2 프레임으로 처리한다.
+ * 연결 하나에 요청(스트림)이 여러 개 동시에 오가므로 클라이언트는 연결을 여러 개
+ * 열 필요가 없다.
+ *
+ * 연결 스레드는 프레임만 읽는다. 스트림마다 socketpair 를 하나 만들어
+ *   - 한쪽 끝은 평소의 HTTP/1.1 연결 처리 함수(h2_init 에 넘긴 것)가 맡는다.
+ *     HEADERS 를 HTTP/1.1 요청으로 바꿔 넣으므로 캐시, origin 풀, hedging,
+ *     backend 선택이 HTTP/1.1 요청과 똑같이 적용된다.
+ *   - 다른 끝은 스트림 스레드가 맡아 요청 본문(DATA)을 넣고, HTTP/1.1 응답을 읽어
+ *     HEADERS/DATA 프레임으로 바꿔 보낸다.
+ * 흐름 제어: 보내는 DATA 는 스트림/연결 window 안에서만 보내고, 받는 DATA 는 처리
+ * 함수에 넘긴 만큼만 스트림 window 를 돌려준다.
+ */
+#ifndef __H2_H__
+#define __H2_H__
+
+#include "csapp.h"
+
+/* 스트림마다 부를 HTTP/1.1 연결 처리 함수 (Malloc 한 int * 로 fd 를 받고, 다 쓰면 닫음) */
+void h2_init(void *(*serve)(void *));
+
+/* fd 의 나머지를 HTTP/2 로 처리하고 돌아온다 (fd 는 부른 쪽이 닫음). rp 에는 이미
+   읽힌 프레임이 남아 있을 수 있다.
+   prior knowledge: 서문의 앞부분("PRI * HTTP/2.0\r\n\r\n")을 읽은 뒤 req == NULL 로.
+   Upgrade: req 는 스트림 1 이 될 HTTP/1.1 요청 (빈 줄까지), settings 는 HTTP2-Settings 값 */
+void h2_serve(int fd, rio_t *rp, const char *req, size_t reqlen, const char *settings);
+
+/* 지금까지 처리한 h2 연결 수와 스트림 수 */
+void h2_stats(long long *conns, long long *streams);
+
+#endif /* __H2_H__ */
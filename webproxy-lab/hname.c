@@ -0,0 +1,57 @@
+/*
+ * hname.c - 알려진 HTTP 헤더 이름을 enum 으로 (완전 해시)
+ */
+#include <strings.h>
+#include "hname.h"
+
+/* 표 크기는 2의 거듭제곱. 곱수는 HNAME_LIST 의 이름들이 서로 다른 칸에 오도록 고른 값.
+   | 0x20 은 글자를 소문자로 (글자가 아닌 바이트는 해시 값만 달라질 뿐 아래에서 다시 비교함) */
+#define HNAME_SLOTS 128
+#define HNAME_HASH(first, last, len) \
+  ((((first) | 0x20) + 8 * ((last) | 0x20) + 53 * (len)) & (HNAME_SLOTS - 1))
+
+/* 칸 → enum (비어 있으면 HN_OTHER) */
+static const unsigned char slots[HNAME_SLOTS] = {
+#define HNAME_SLOT(id, name, first, last) [HNAME_HASH(first, last, sizeof(name) - 1)] = HN_##id,
+  HNAME_LIST(HNAME_SLOT)
+#undef HNAME_SLOT
+};
+
+static const struct {
+  const char *name;
+  size_t len;
+} names[HN_COUNT] = {
+  [HN_OTHER] = { "", 0 },
+#define HNAME_NAME(id, name, first, last) [HN_##id] = { name, sizeof(name) - 1 },
+  HNAME_LIST(HNAME_NAME)
+#undef HNAME_NAME
+};
+
+/* 부르지 않음: 두 이름이 같은 칸이면 case 값이 겹쳐 컴파일 에러가 남 */
+__attribute__((unused))
+static void hname_collision_check(int slot)
+{
+  switch (slot) {
+#define HNAME_CASE(id, name, first, last) case HNAME_HASH(first, last, sizeof(name) - 1):
+    HNAME_LIST(HNAME_CASE)
+#undef HNAME_CASE
+    break;
+  }
+}
+
+hname_t hname_lookup(const char *name, size_t len)
+{
+  hname_t id;
+
+  if (len == 0)
+    return HN_OTHER;
+  id = slots[HNAME_HASH((unsigned char)name[0], (unsigned char)name[len - 1], len)];
+  if (id != HN_OTHER && names[id].len == len && !strncasecmp(names[id].name, name, len))
+    return id;
+  return HN_OTHER;
+}
+
+const char *hname_str(hname_t id)
+{
+  return id > HN_OTHER && id < HN_COUNT ? names[id].name : "";
+}
@@ -0,0 +1,77 @@
+/*
+ * hname.h - 알려진 HTTP 헤더 이름을 enum 으로 (완전 해시)
+ *
+ * 헤더 이름을 (첫 글자, 마지막 글자, 길이) 로 해시해서 표의 한 칸만 보고
+ * O(1) 에 분류한다. 대소문자는 구분하지 않는다. strncasecmp 를 이름마다 차례로
+ * 부르지 않고 switch (hname_lookup(...)) 로 쓰면 된다.
+ *
+ * 표는 아래 HNAME_LIST 로 컴파일할 때 만들어진다. 이름을 더했는데 두 이름이 같은
+ * 칸에 오면 hname.c 에서 컴파일 에러(duplicate case value)가 나므로, 그때는
+ * hname.c 의 HNAME_HASH 곱수를 다시 고른다.
+ */
+#ifndef __HNAME_H__
+#define __HNAME_H__
+
+#include <stddef.h>
+
+/* X(enum 이름, 헤더 이름, 첫 글자, 마지막 글자) - 글자는 소문자로 */
+#define HNAME_LIST(X) \
+  X(ACCEPT,              "Accept",              'a', 't') \
+  X(ACCEPT_ENCODING,     "Accept-Encoding",     'a', 'g') \
+  X(ACCEPT_LANGUAGE,     "Accept-Language",     'a', 'e') \
+  X(ACCEPT_RANGES,       "Accept-Ranges",       'a', 's') \
+  X(AGE,                 "Age",                 'a', 'e') \
+  X(AUTHORIZATION,       "Authorization",       'a', 'n') \
+  X(CACHE_CONTROL,       "Cache-Control",       'c', 'l') \
+  X(CONNECTION,          "Connection",          'c', 'n') \
+  X(CONTENT_ENCODING,    "Content-Encoding",    'c', 'g') \
+  X(CONTENT_LENGTH,      "Content-Length",      'c', 'h') \
+  X(CONTENT_RANGE,       "Content-Range",       'c', 'e') \
+  X(CONTENT_TYPE,        "Content-Type",        'c', 'e') \
+  X(COOKIE,              "Cookie",              'c', 'e') \
+  X(DATE,                "Date",                'd', 'e') \
+  X(ETAG,                "ETag",                'e', 'g') \
+  X(EXPECT,              "Expect",              'e', 't') \
+  X(EXPIRES,             "Expires",             'e', 's') \
+  X(HOST,                "Host",                'h', 't') \
+  X(HTTP2_SETTINGS,      "HTTP2-Settings",      'h', 's') \
+  X(IF_MATCH,            "If-Match",            'i', 'h') \
+  X(IF_MODIFIED_SINCE,   "If-Modified-Since",   'i', 'e') \
+  X(IF_NONE_MATCH,       "If-None-Match",       'i', 'h') \
+  X(IF_RANGE,            "If-Range",            'i', 'e') \
+  X(IF_UNMODIFIED_SINCE, "If-Unmodified-Since", 'i', 'e') \
+  X(KEEP_ALIVE,          "Keep-Alive",          'k', 'e') \
+  X(LAST_MODIFIED,       "Last-Modified",       'l', 'd') \
+  X(LOCATION,            "Location",            'l', 'n') \
+  X(PRAGMA,              "Pragma",              'p', 'a') \
+  X(PROXY_AUTHENTICATE,  "Proxy-Authenticate",  'p', 'e') \
+  X(PROXY_AUTHORIZATION, "Proxy-Authorization", 'p', 'n') \
+  X(PROXY_CONNECTION,    "Proxy-Connection",    'p', 'n') \
+  X(RANGE,               "Range",               'r', 'e') \
+  X(REFERER,             "Referer",             'r', 'r') \
+  X(SERVER,              "Server",              's', 'r') \
+  X(SET_COOKIE,          "Set-Cookie",          's', 'e') \
+  X(TE,                  "TE",                  't', 'e') \
+  X(TRAILER,             "Trailer",             't', 'r') \
+  X(TRANSFER_ENCODING,   "Transfer-Encoding",   't', 'g') \
+  X(UPGRADE,             "Upgrade",             'u', 'e') \
+  X(USER_AGENT,          "User-Agent",          'u', 't') \
+  X(VARY,                "Vary",                'v', 'y') \
+  X(VIA,                 "Via",                 'v', 'a') \
+  X(WWW_AUTHENTICATE,    "WWW-Authenticate",    'w', 'e')
+
+typedef enum {
+  HN_OTHER = 0,  /* 목록에 없는 헤더 */
+#define HNAME_ENUM(id, name, first, last) HN_##id,
+  HNAME_LIST(HNAME_ENUM)
+#undef HNAME_ENUM
+  HN_COUNT
+} hname_t;
+
+/* name[0..len) 이 어느 헤더인지 (NUL 로 끝나지 않아도 됨) */
+hname_t hname_lookup(const char *name, size_t len);
+
+/* 헤더 이름 ("Content-Length" 처럼). HN_OTHER 면 "" */
+const char *hname_str(hname_t id);
+
+#endif /* __HNAME_H__ */
@@ -0,0 +1,506 @@
+/*
+ * hpack.c - HTTP/2 헤더 압축 (RFC 7541)
+ */
+#include "csapp.h"
+#include "hpack.h"
+
+#define STATIC_COUNT 61
+#define ENT_OVERHEAD 32   /* 항목 크기 = name + value + 32 */
+#define HUFF_MAXLEN  30
+
+typedef struct {
+  const char *name, *value;
+  size_t nlen, vlen;
+} static_ent_t;
+
+#define S(n, v) { n, v, sizeof(n) - 1, sizeof(v) - 1 }
+
+/* 정적 테이블 (부록 A). index 1부터 */
+static const static_ent_t static_table[STATIC_COUNT] = {
+  S(":authority", ""),
+  S(":method", "GET"),
+  S(":method", "POST"),
+  S(":path", "/"),
+  S(":path", "/index.html"),
+  S(":scheme", "http"),
+  S(":scheme", "https"),
+  S(":status", "200"),
+  S(":status", "204"),
+  S(":status", "206"),
+  S(":status", "304"),
+  S(":status", "400"),
+  S(":status", "404"),
+  S(":status", "500"),
+  S("accept-charset", ""),
+  S("accept-encoding", "gzip, deflate"),
+  S("accept-language", ""),
+  S("accept-ranges", ""),
+  S("accept", ""),
+  S("access-control-allow-origin", ""),
+  S("age", ""),
+  S("allow", ""),
+  S("authorization", ""),
+  S("cache-control", ""),
+  S("content-disposition", ""),
+  S("content-encoding", ""),
+  S("content-language", ""),
+  S("content-length", ""),
+  S("content-location", ""),
+  S("content-range", ""),
+  S("content-type", ""),
+  S("cookie", ""),
+  S("date", ""),
+  S("etag", ""),
+  S("expect", ""),
+  S("expires", ""),
+  S("from", ""),
+  S("host", ""),
+  S("if-match", ""),
+  S("if-modified-since", ""),
+  S("if-none-match", ""),
+  S("if-range", ""),
+  S("if-unmodified-since", ""),
+  S("last-modified", ""),
+  S("link", ""),
+  S("location", ""),
+  S("max-forwards", ""),
+  S("proxy-authenticate", ""),
+  S("proxy-authorization", ""),
+  S("range", ""),
+  S("referer", ""),
+  S("refresh", ""),
+  S("retry-after", ""),
+  S("server", ""),
+  S("set-cookie", ""),
+  S("strict-transport-security", ""),
+  S("transfer-encoding", ""),
+  S("user-agent", ""),
+  S("vary", ""),
+  S("via", ""),
+  S("www-authenticate", "")
+};
+
+/* Huffman 코드 길이 (부록 B, 심볼 0..255 + EOS).
+   canonical 코드라서 길이만 있으면 코드를 다시 만들 수 있다: 짧은 길이부터,
+   같은 길이 안에서는 심볼 순서대로 1씩 커짐 */
+static const unsigned char huff_len[257] = {
+  13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+  28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+  5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+  13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+  7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+  15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+  6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+  20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+  24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+  22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+  21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+  26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+  19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+  20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+  26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+  30
+};
+
+static unsigned int huff_code[257];               /* 심볼 → 코드 (인코드용) */
+static unsigned int huff_first[HUFF_MAXLEN + 1];  /* 길이별 첫 코드 */
+static unsigned int huff_count[HUFF_MAXLEN + 1];  /* 길이별 코드 수 */
+static unsigned int huff_off[HUFF_MAXLEN + 1];    /* 길이별 첫 심볼의 huff_sym 위치 */
+static unsigned short huff_sym[257];              /* (길이, 심볼) 순으로 정렬한 심볼 */
+static pthread_once_t huff_once = PTHREAD_ONCE_INIT;
+
+static void huff_build(void)
+{
+  unsigned int code = 0;
+  int len, s, n = 0;
+
+  for (len = 1; len <= HUFF_MAXLEN; len++) {
+    huff_first[len] = code;
+    huff_off[len] = n;
+    for (s = 0; s < 257; s++) {
+      if (huff_len[s] == len) {
+        huff_sym[n++] = s;
+        huff_code[s] = code++;
+      }
+    }
+    huff_count[len] = n - huff_off[len];
+    code <<= 1;
+  }
+}
+
+/* 비트를 하나씩 붙여 가며, 지금 길이의 코드 범위 안에 들어오면 심볼 하나.
+   디코드한 길이, 잘못된 코드/EOS/패딩이면 -1 */
+static int huff_decode(const unsigned char *p, size_t len, char *out, size_t size)
+{
+  unsigned int code = 0;
+  int nbits = 0, bit, sym;
+  size_t i, n = 0;
+
+  for (i = 0; i < len; i++) {
+    for (bit = 7; bit >= 0; bit--) {
+      code = (code << 1) | ((p[i] >> bit) & 1);
+      nbits++;
+      if (code - huff_first[nbits] < huff_count[nbits]) {
+        sym = huff_sym[huff_off[nbits] + code - huff_first[nbits]];
+        if (sym == 256 || n == size)
+          return -1;
+        out[n++] = sym;
+        code = 0;
+        nbits = 0;
+      } else if (nbits == HUFF_MAXLEN) {
+        return -1;
+      }
+    }
+  }
+  /* 남은 비트는 7개 이하이고 모두 1 (EOS 코드의 앞부분) 이어야 함 */
+  if (nbits > 7 || code != (1u << nbits) - 1)
+    return -1;
+  return n;
+}
+
+static size_t huff_size(const char *s, size_t len)
+{
+  size_t i, bits = 0;
+
+  for (i = 0; i < len; i++)
+    bits += huff_len[(unsigned char)s[i]];
+  return (bits + 7) / 8;
+}
+
+static void huff_encode(unsigned char *out, const char *s, size_t len)
+{
+  unsigned long long acc = 0;
+  int nbits = 0, c;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    c = (unsigned char)s[i];
+    acc = (acc << huff_len[c]) | huff_code[c];
+    nbits += huff_len[c];
+    while (nbits >= 8) {
+      nbits -= 8;
+      *out++ = acc >> nbits;
+    }
+  }
+  if (nbits > 0)  /* 마지막 바이트는 1로 채움 (EOS 의 앞부분) */
+    *out = (acc << (8 - nbits)) | (0xff >> nbits);
+}
+
+/* prefix 비트 정수 (5.1). 성공 0 */
+static int dec_int(const unsigned char **pp, const unsigned char *end, int prefix, size_t *out)
+{
+  const unsigned char *p = *pp;
+  size_t v, max = (1u << prefix) - 1;
+  int shift = 0;
+
+  if (p >= end)
+    return -1;
+  v = *p++ & max;
+  if (v == max) {
+    do {
+      if (p >= end || shift > 28)
+        return -1;
+      v += (size_t)(*p & 0x7f) << shift;
+      shift += 7;
+    } while (*p++ & 0x80);
+  }
+  *pp = p;
+  *out = v;
+  return 0;
+}
+
+/* 쓴 길이, 공간이 모자라면 -1 */
+static int enc_int(unsigned char *out, size_t size, int prefix, unsigned char flags, size_t v)
+{
+  size_t max = (1u << prefix) - 1;
+  size_t n = 0;
+
+  if (size == 0)
+    return -1;
+  if (v < max) {
+    out[0] = flags | v;
+    return 1;
+  }
+  out[n++] = flags | max;
+  for (v -= max; v >= 128; v >>= 7) {
+    if (n == size)
+      return -1;
+    out[n++] = (v & 0x7f) | 0x80;
+  }
+  if (n == size)
+    return -1;
+  out[n++] = v;
+  return n;
+}
+
+/* 문자열 (5.2) 을 buf 에 풀어 놓음. 길이, 오류면 -1 */
+static int dec_str(const unsigned char **pp, const unsigned char *end, char *buf, size_t size)
+{
+  const unsigned char *p = *pp;
+  int huff, n;
+  size_t len;
+
+  if (p >= end)
+    return -1;
+  huff = *p & 0x80;
+  if (dec_int(&p, end, 7, &len) < 0 || len > (size_t)(end - p))
+    return -1;
+  if (huff) {
+    n = huff_decode(p, len, buf, size);
+  } else {
+    if (len > size)
+      return -1;
+    memcpy(buf, p, len);
+    n = len;
+  }
+  *pp = p + len;
+  return n;
+}
+
+/* Huffman 이 더 짧을 때만 Huffman. 쓴 길이, 공간이 모자라면 -1 */
+static int enc_str(unsigned char *out, size_t size, const char *s, size_t len)
+{
+  size_t hlen = huff_size(s, len);
+  int n;
+
+  if (hlen < len) {
+    if ((n = enc_int(out, size, 7, 0x80, hlen)) < 0 || n + hlen > size)
+      return -1;
+    huff_encode(out + n, s, len);
+    return n + hlen;
+  }
+  if ((n = enc_int(out, size, 7, 0, len)) < 0 || n + len > size)
+    return -1;
+  memcpy(out + n, s, len);
+  return n + len;
+}
+
+/* 동적 테이블의 i번째 (0 = 가장 새 항목) */
+static hpack_ent_t *tab_get(hpack_t *t, int i)
+{
+  return &t->ent[(t->head + i) % t->cap];
+}
+
+/* 크기가 max 이하가 될 때까지 오래된 항목부터 버림 */
+static void tab_evict(hpack_t *t, size_t max)
+{
+  hpack_ent_t *e;
+
+  while (t->count > 0 && t->size > max) {
+    e = tab_get(t, t->count - 1);
+    t->size -= e->nlen + e->vlen + ENT_OVERHEAD;
+    Free(e->name);
+    t->count--;
+  }
+}
+
+/* name/value 가 곧 버려질 항목을 가리킬 수 있으므로 먼저 복사한 뒤 비움 (4.4) */
+static void tab_add(hpack_t *t, const char *name, size_t nlen, const char *value, size_t vlen)
+{
+  size_t esize = nlen + vlen + ENT_OVERHEAD;
+  hpack_ent_t *ent, *e;
+  char *buf;
+  int i, cap;
+
+  if (esize > t->max_size) {
+    tab_evict(t, 0);  /* 너무 큰 항목은 테이블만 비우고 들어가지 않음 */
+    return;
+  }
+  buf = Malloc(nlen + vlen);
+  memcpy(buf, name, nlen);
+  memcpy(buf + nlen, value, vlen);
+  tab_evict(t, t->max_size - esize);
+
+  if (t->count == t->cap) {
+    cap = t->cap ? t->cap * 2 : 16;
+    ent = Malloc(cap * sizeof(*ent));
+    for (i = 0; i < t->count; i++)
+      ent[i] = *tab_get(t, i);
+    Free(t->ent);
+    t->ent = ent;
+    t->cap = cap;
+    t->head = 0;
+  }
+  t->head = (t->head + t->cap - 1) % t->cap;
+  e = &t->ent[t->head];
+  e->name = buf;
+  e->nlen = nlen;
+  e->value = buf + nlen;
+  e->vlen = vlen;
+  t->count++;
+  t->size += esize;
+}
+
+/* index (1부터, 정적 다음에 동적) → 이름/값. 없는 index 면 -1 */
+static int tab_lookup(hpack_t *t, size_t idx, const char **name, size_t *nlen,
+                      const char **value, size_t *vlen)
+{
+  hpack_ent_t *e;
+
+  if (idx == 0)
+    return -1;
+  if (idx <= STATIC_COUNT) {
+    *name = static_table[idx - 1].name;
+    *nlen = static_table[idx - 1].nlen;
+    *value = static_table[idx - 1].value;
+    *vlen = static_table[idx - 1].vlen;
+    return 0;
+  }
+  idx -= STATIC_COUNT + 1;
+  if (idx >= (size_t)t->count)
+    return -1;
+  e = tab_get(t, idx);
+  *name = e->name;
+  *nlen = e->nlen;
+  *value = e->value;
+  *vlen = e->vlen;
+  return 0;
+}
+
+void hpack_init(hpack_t *t)
+{
+  pthread_once(&huff_once, huff_build);
+  t->ent = NULL;
+  t->cap = t->head = t->count = 0;
+  t->size = 0;
+  t->max_size = t->limit = HPACK_TABLE_SIZE;
+  t->update = 0;
+}
+
+void hpack_free(hpack_t *t)
+{
+  tab_evict(t, 0);
+  Free(t->ent);
+  t->ent = NULL;
+}
+
+int hpack_decode(hpack_t *t, const unsigned char *p, size_t len, hpack_cb_t *cb, void *arg)
+{
+  const unsigned char *end = p + len;
+  char nbuf[HPACK_MAXSTR], vbuf[HPACK_MAXSTR];
+  const char *name, *value;
+  size_t idx, nlen, vlen;
+  int n, index;
+
+  while (p < end) {
+    /* indexed (6.1): 1xxxxxxx */
+    if (*p & 0x80) {
+      if (dec_int(&p, end, 7, &idx) < 0 || tab_lookup(t, idx, &name, &nlen, &value, &vlen) < 0)
+        return -1;
+      cb(arg, name, nlen, value, vlen);
+      continue;
+    }
+
+    /* dynamic table size update (6.3): 001xxxxx */
+    if ((*p & 0xe0) == 0x20) {
+      if (dec_int(&p, end, 5, &idx) < 0 || idx > t->limit)
+        return -1;
+      t->max_size = idx;
+      tab_evict(t, idx);
+      continue;
+    }
+
+    /* literal (6.2): 01xxxxxx 테이블에 넣음, 0000xxxx 안 넣음, 0001xxxx 절대 넣지 않음 */
+    index = (*p & 0x40) != 0;
+    if (dec_int(&p, end, index ? 6 : 4, &idx) < 0)
+      return -1;
+    if (idx) {
+      if (tab_lookup(t, idx, &name, &nlen, &value, &vlen) < 0)
+        return -1;
+    } else {
+      if ((n = dec_str(&p, end, nbuf, sizeof(nbuf))) < 0)
+        return -1;
+      name = nbuf;
+      nlen = n;
+    }
+    if ((n = dec_str(&p, end, vbuf, sizeof(vbuf))) < 0)
+      return -1;
+    cb(arg, name, nlen, vbuf, n);
+    if (index)
+      tab_add(t, name, nlen, vbuf, n);
+  }
+  return 0;
+}
+
+void hpack_set_limit(hpack_t *t, size_t limit)
+{
+  size_t max = limit < HPACK_TABLE_SIZE ? limit : HPACK_TABLE_SIZE;
+
+  t->limit = limit;
+  if (max != t->max_size) {
+    t->max_size = max;
+    tab_evict(t, max);
+    t->update = 1;
+  }
+}
+
+int hpack_encode_begin(hpack_t *t, unsigned char *out, size_t size)
+{
+  if (!t->update)
+    return 0;
+  t->update = 0;
+  return enc_int(out, size, 5, 0x20, t->max_size);
+}
+
+/* 인코드 방식: 응답마다 바뀌는 값은 테이블을 더럽히지 않게 넣지 않고, 쿠키 같은
+   민감한 값은 중간 프록시도 넣지 못하게 (never indexed) */
+static unsigned char enc_mode(const char *name, size_t nlen, size_t vlen)
+{
+  if ((nlen == 10 && !memcmp(name, "set-cookie", 10)) ||
+      (nlen == 13 && !memcmp(name, "authorization", 13)))
+    return 0x10;
+  if ((nlen == 14 && !memcmp(name, "content-length", 14)) ||
+      (nlen == 4 && !memcmp(name, "date", 4)) ||
+      (nlen == 4 && !memcmp(name, "etag", 4)) ||
+      (nlen == 13 && !memcmp(name, "last-modified", 13)) ||
+      vlen > 1024)
+    return 0x00;
+  return 0x40;
+}
+
+int hpack_encode(hpack_t *t, unsigned char *out, size_t size,
+                 const char *name, size_t nlen, const char *value, size_t vlen)
+{
+  const static_ent_t *s;
+  hpack_ent_t *e;
+  size_t name_idx = 0;
+  unsigned char mode;
+  int i, n, m;
+
+  /* 이름과 값이 다 같은 항목이 있으면 index 하나로 */
+  for (i = 0; i < STATIC_COUNT; i++) {
+    s = &static_table[i];
+    if (s->nlen != nlen || memcmp(s->name, name, nlen))
+      continue;
+    if (s->vlen == vlen && !memcmp(s->value, value, vlen))
+      return enc_int(out, size, 7, 0x80, i + 1);
+    if (!name_idx)
+      name_idx = i + 1;
+  }
+  for (i = 0; i < t->count; i++) {
+    e = tab_get(t, i);
+    if (e->nlen != nlen || memcmp(e->name, name, nlen))
+      continue;
+    if (e->vlen == vlen && !memcmp(e->value, value, vlen))
+      return enc_int(out, size, 7, 0x80, STATIC_COUNT + 1 + i);
+    if (!name_idx)
+      name_idx = STATIC_COUNT + 1 + i;
+  }
+
+  /* literal: 이름은 index 가 있으면 index 로 */
+  mode = enc_mode(name, nlen, vlen);
+  if ((n = enc_int(out, size, mode == 0x40 ? 6 : 4, mode, name_idx)) < 0)
+    return -1;
+  if (!name_idx) {
+    if ((m = enc_str(out + n, size - n, name, nlen)) < 0)
+      return -1;
+    n += m;
+  }
+  if ((m = enc_str(out + n, size - n, value, vlen)) < 0)
+    return -1;
+  n += m;
+  if (mode == 0x40)
+    tab_add(t, name, nlen, value, vlen);
+  return n;
+}
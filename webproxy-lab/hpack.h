@@ -0,0 +1,55 @@
+/*
+ * hpack.h - HTTP/2 헤더 압축 (RFC 7541)
+ *
+ * 연결마다 방향별로 hpack_t 하나씩 (클라이언트 → 프록시 디코더, 프록시 →
+ * 클라이언트 인코더). 헤더 블록은 연결 안에서 보낸 순서대로 처리해야 동적
+ * 테이블이 양쪽에서 같게 유지된다.
+ *
+ * 디코더는 모든 표현(indexed, literal 세 가지, 테이블 크기 변경)과 Huffman
+ * 문자열을 읽는다. 인코더는 정적/동적 테이블에 있으면 인덱스 하나로 보내고,
+ * 없으면 동적 테이블에 넣어 다음 응답부터 인덱스로 보낸다. 문자열은 Huffman
+ * 으로 줄어들 때만 Huffman 으로 쓴다.
+ */
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <stddef.h>
+
+#define HPACK_TABLE_SIZE 4096  /* SETTINGS_HEADER_TABLE_SIZE 기본값 */
+#define HPACK_MAXSTR     8192  /* 디코드한 이름/값 하나의 최대 길이 */
+
+typedef struct {
+  char *name, *value;  /* 한 덩어리로 할당 (name 바로 뒤에 value) */
+  size_t nlen, vlen;
+} hpack_ent_t;
+
+typedef struct {
+  hpack_ent_t *ent;    /* 원형 버퍼. ent[head] 가 가장 새 항목 (index 62) */
+  int cap, head, count;
+  size_t size;         /* 항목 크기 합 (항목마다 name + value + 32) */
+  size_t max_size;     /* 지금 최대 크기 (dynamic table size update 로 바뀜) */
+  size_t limit;        /* SETTINGS_HEADER_TABLE_SIZE: max_size 의 상한 */
+  int update;          /* 인코더: 다음 헤더 블록 앞에 크기 변경을 알려야 함 */
+} hpack_t;
+
+/* 헤더 하나를 디코드할 때마다 불림. 이름/값은 콜백 안에서만 유효 */
+typedef void hpack_cb_t(void *arg, const char *name, size_t nlen, const char *value, size_t vlen);
+
+void hpack_init(hpack_t *t);
+void hpack_free(hpack_t *t);
+
+/* 헤더 블록 하나(HEADERS + CONTINUATION 을 이어 붙인 것)를 디코드.
+   성공 0, 압축 오류 -1 (연결 오류: COMPRESSION_ERROR) */
+int hpack_decode(hpack_t *t, const unsigned char *p, size_t len, hpack_cb_t *cb, void *arg);
+
+/* 인코더: 상대 디코더의 SETTINGS_HEADER_TABLE_SIZE 가 바뀜 */
+void hpack_set_limit(hpack_t *t, size_t limit);
+
+/* 헤더 블록의 시작. 밀린 테이블 크기 변경이 있으면 out 에 씀. 쓴 길이 (모자라면 -1) */
+int hpack_encode_begin(hpack_t *t, unsigned char *out, size_t size);
+
+/* 헤더 하나를 out 에 인코드 (name 은 소문자여야 함). 쓴 길이, 공간이 모자라면 -1 */
+int hpack_encode(hpack_t *t, unsigned char *out, size_t size,
+                 const char *name, size_t nlen, const char *value, size_t vlen);
+
+#endif /* __HPACK_H__ */
@@ -0,0 +1,301 @@
+/*
+ * httpparse.c - HTTP/1.x 요청/응답 헤더 파서 (복사 없이 한 번 훑기)
+ */
+#include <string.h>
+#include <strings.h>
+#include "httpparse.h"
+#include "scan.h"
+
+enum { ST_FIRSTLINE, ST_HEADERS };
+
+/* hdr[] 는 채운 만큼만 읽으므로 지우지 않음 (요청마다 3KB memset 을 피함) */
+void hp_init(hp_msg_t *r)
+{
+  memset(r, 0, offsetof(hp_msg_t, hdr));
+  r->nhdr = 0;
+  r->base = NULL;
+  r->off = r->scan = 0;
+  r->state = 0;
+}
+
+static void move(hp_str_t *s, const char *from, const char *to)
+{
+  if (s->p)
+    s->p = to + (s->p - from);
+}
+
+void hp_rebase(hp_msg_t *r, const char *buf)
+{
+  int i;
+
+  if (r->base == NULL || r->base == buf) {
+    r->base = buf;
+    return;
+  }
+  move(&r->method, r->base, buf);
+  move(&r->uri, r->base, buf);
+  move(&r->version, r->base, buf);
+  move(&r->host, r->base, buf);
+  move(&r->port, r->base, buf);
+  move(&r->path, r->base, buf);
+  move(&r->reason, r->base, buf);
+  move(&r->line, r->base, buf);
+  for (i = 0; i < r->nhdr; i++) {
+    move(&r->hdr[i].name, r->base, buf);
+    move(&r->hdr[i].value, r->base, buf);
+    move(&r->hdr[i].line, r->base, buf);
+  }
+  r->base = buf;
+}
+
+int hp_eq(hp_str_t a, const char *s)
+{
+  return a.len == strlen(s) && !strncasecmp(a.p, s, a.len);
+}
+
+int hp_has(hp_str_t a, const char *s)
+{
+  size_t n = strlen(s), i;
+
+  for (i = 0; i + n <= a.len; i++)
+    if (!strncasecmp(a.p + i, s, n))
+      return 1;
+  return 0;
+}
+
+static int is_ws(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+long long hp_clen(hp_str_t a)
+{
+  long long v = 0;
+  size_t i;
+
+  if (a.len == 0 || a.len > 18)
+    return -1;
+  for (i = 0; i < a.len; i++) {
+    if (a.p[i] < '0' || a.p[i] > '9')
+      return -1;
+    v = v * 10 + (a.p[i] - '0');
+  }
+  return v;
+}
+
+/* p 에서 시작하는 숫자. 없거나 너무 길면 -1 */
+static long long number(const char **pp, const char *e)
+{
+  const char *p = *pp;
+  long long v = 0;
+
+  if (p == e || *p < '0' || *p > '9')
+    return -1;
+  for (; p < e && *p >= '0' && *p <= '9'; p++) {
+    if (p - *pp >= 18)
+      return -1;
+    v = v * 10 + (*p - '0');
+  }
+  *pp = p;
+  return v;
+}
+
+int hp_range(hp_str_t a, long long size, hp_range_t *rg, int max)
+{
+  const char *p = a.p, *e = a.p + a.len;
+  long long first, last;
+  int n = 0, nspec = 0;
+
+  if (a.len < 6 || strncasecmp(p, "bytes=", 6))
+    return -1;
+  for (p += 6; ; ) {
+    while (p < e && (is_ws(*p) || *p == ','))  /* 빈 목록 원소는 건너뜀 */
+      p++;
+    if (p == e)
+      break;
+
+    /* "first-last", "first-" 또는 "-suffix" */
+    first = last = -1;
+    if (*p != '-' && (first = number(&p, e)) < 0)
+      return -1;
+    if (p == e || *p++ != '-')
+      return -1;
+    if (p < e && *p >= '0' && *p <= '9' && (last = number(&p, e)) < 0)
+      return -1;
+    if ((first < 0 && last < 0) || (first >= 0 && last >= 0 && last < first))
+      return -1;
+    while (p < e && is_ws(*p))
+      p++;
+    if (p < e && *p != ',')
+      return -1;
+    nspec++;
+
+    /* 본문 길이에 맞춤. 본문 밖에서 시작하는 구간은 만족할 수 없으니 뺌 */
+    if (first < 0) {
+      if (last == 0 || size == 0)
+        continue;
+      first = last >= size ? 0 : size - last;
+      last = size - 1;
+    } else {
+      if (first >= size)
+        continue;
+      if (last < 0 || last >= size)
+        last = size - 1;
+    }
+    if (n == max)
+      return -1;
+    rg[n].first = first;
+    rg[n].last = last;
+    n++;
+  }
+  return nspec ? n : -1;
+}
+
+/* 앞의 공백을 건너뛰고, 다음 공백(이나 제어 문자)까지를 tok 에 */
+static const char *token(const char *p, const char *e, hp_str_t *tok)
+{
+  while (p < e && is_ws(*p))
+    p++;
+  tok->p = p;
+  p = scan_delim(p, e, 0);
+  tok->len = p - tok->p;
+  return p;
+}
+
+/* URI 를 host/port/path 로. absolute-form(http://host:port/path), origin-form(/path),
+   authority-form(host:port, CONNECT) 모두 */
+static void split_uri(hp_msg_t *r)
+{
+  const char *p = r->uri.p, *e = r->uri.p + r->uri.len, *a, *c;
+
+  if (r->uri.len >= 7 && !strncasecmp(p, "http://", 7))
+    p += 7;
+  if (p < e && *p == '/') {  /* origin-form */
+    r->path.p = p;
+    r->path.len = e - p;
+    return;
+  }
+  for (a = p; a < e && *a != '/'; a++)
+    ;
+  if (a < e) {
+    r->path.p = a;
+    r->path.len = e - a;
+  }
+  if (p < a && *p == '[') {  /* [IPv6]:port */
+    for (c = p; c < a && *c != ']'; c++)
+      ;
+    r->host.p = p + 1;
+    r->host.len = c - p - 1;
+    c += c < a;
+    if (c < a && *c != ':')
+      c = a;
+  } else {
+    for (c = p; c < a && *c != ':'; c++)
+      ;
+    r->host.p = p;
+    r->host.len = c - p;
+  }
+  if (c < a) {
+    r->port.p = c + 1;
+    r->port.len = a - c - 1;
+  }
+}
+
+/* 요청 줄 "METHOD URI VERSION". 성공 0 */
+static int reqline(hp_msg_t *r, const char *p, const char *e)
+{
+  p = token(p, e, &r->method);
+  p = token(p, e, &r->uri);
+  p = token(p, e, &r->version);
+  while (p < e && is_ws(*p))
+    p++;
+  if (p != e || !r->method.len || !r->uri.len || !r->version.len)
+    return -1;
+  split_uri(r);
+  return 0;
+}
+
+/* 상태 줄 "VERSION STATUS [REASON]". 성공 0 */
+static int statusline(hp_msg_t *r, const char *p, const char *e)
+{
+  hp_str_t code;
+
+  p = token(p, e, &r->version);
+  p = token(p, e, &code);
+  if (!r->version.len || code.len != 3 || hp_clen(code) < 0 || (p < e && !is_ws(*p)))
+    return -1;
+  r->status = hp_clen(code);
+  while (p < e && is_ws(*p))
+    p++;
+  r->reason.p = p;
+  r->reason.len = e - p;
+  return 0;
+}
+
+/* 헤더 줄 "name: value". 성공 0 */
+static int header(hp_hdr_t *h, const char *p, const char *e)
+{
+  const char *c = scan_delim(p, e, 1);
+
+  if (c == p || c == e || *c != ':')  /* 이름 안의 공백, 이어진 줄(obs-fold) */
+    return -1;
+  h->name.p = p;
+  h->name.len = c - p;
+  h->id = hname_lookup(p, c - p);
+  for (c++; c < e && is_ws(*c); c++)
+    ;
+  while (e > c && is_ws(e[-1]))
+    e--;
+  h->value.p = c;
+  h->value.len = e - c;
+  return 0;
+}
+
+static int parse(hp_msg_t *r, const char *buf, size_t len,
+                 int (*first)(hp_msg_t *, const char *, const char *))
+{
+  const char *nl, *e;
+  size_t start;
+
+  hp_rebase(r, buf);
+  while (1) {
+    if (r->scan >= len || (nl = scan_eol(buf + r->scan, buf + len)) == buf + len) {
+      r->scan = len;
+      return HP_AGAIN;
+    }
+    start = r->off;
+    r->off = r->scan = nl + 1 - buf;
+    e = nl > buf + start && nl[-1] == '\r' ? nl - 1 : nl;
+
+    if (e == buf + start) {  /* 빈 줄 */
+      if (r->state == ST_HEADERS)
+        return r->off;
+      continue;  /* 첫 줄 앞의 빈 줄은 무시 (RFC 9112 2.2) */
+    }
+    if (r->state == ST_FIRSTLINE) {
+      if (first(r, buf + start, e) < 0)
+        return HP_ERROR;
+      r->line.p = buf + start;
+      r->line.len = r->off - start;
+      r->state = ST_HEADERS;
+      continue;
+    }
+    if (r->nhdr == HP_MAXHDRS)
+      return HP_TOOMANY;
+    if (header(&r->hdr[r->nhdr], buf + start, e) < 0)
+      return HP_ERROR;
+    r->hdr[r->nhdr].line.p = buf + start;
+    r->hdr[r->nhdr].line.len = r->off - start;
+    r->nhdr++;
+  }
+}
+
+int hp_parse_request(hp_msg_t *r, const char *buf, size_t len)
+{
+  return parse(r, buf, len, reqline);
+}
+
+int hp_parse_response(hp_msg_t *r, const char *buf, size_t len)
+{
+  return parse(r, buf, len, statusline);
+}
@@ -0,0 +1,88 @@
+/*
+ * httpparse.h - HTTP/1.x 요청/응답 헤더 파서 (복사 없이 한 번 훑기)
+ *
+ * 받은 바이트(보통 rio 버퍼) 위에서 그대로 파싱해서 요청 줄(메서드, URI 구성
+ * 요소)이나 상태 줄, 헤더 이름/값을 (포인터, 길이) 조각으로 돌려준다.
+ * 줄 끝과 구분 문자는 scan.h 로 여러 바이트씩 찾는다. 문자열을 복사하거나 NUL 로
+ * 끊지 않으므로 buf 는 읽기만 한다.
+ *
+ * 이어서 파싱할 수 있다: 헤더 블록이 아직 다 안 왔으면 HP_AGAIN 을 돌려주고,
+ * 바이트를 더 받은 뒤 같은 hp_msg_t 로 다시 부르면 끝난 줄은 다시 보지 않는다.
+ * 그 사이에 버퍼가 옮겨졌으면(rio_fillb 의 당기기) 새 위치를 넘기면 된다.
+ * buf 는 매번 요청의 첫 바이트부터여야 한다.
+ */
+#ifndef __HTTPPARSE_H__
+#define __HTTPPARSE_H__
+
+#include <stddef.h>
+#include "hname.h"
+
+#define HP_MAXHDRS 64   /* 요청 하나의 헤더 수 상한 */
+#define HP_MAXRANGES 8  /* Range 하나에서 따르는 구간 수 상한 (넘으면 Range 를 무시) */
+
+/* hp_parse_request/hp_parse_response 결과 (0보다 크면 헤더 블록 길이) */
+#define HP_AGAIN    0   /* 헤더 블록이 아직 덜 옴 */
+#define HP_ERROR   -1   /* 형식이 틀림 (400) */
+#define HP_TOOMANY -2   /* 헤더가 HP_MAXHDRS 개를 넘음 (431) */
+
+typedef struct {
+  const char *p;
+  size_t len;
+} hp_str_t;
+
+typedef struct {
+  hname_t id;      /* 알려진 헤더면 HN_*, 아니면 HN_OTHER */
+  hp_str_t name;   /* ':' 앞 */
+  hp_str_t value;  /* 앞뒤 공백을 뺀 값 */
+  hp_str_t line;   /* 줄 전체 (줄바꿈 포함): 그대로 전달할 때 */
+} hp_hdr_t;
+
+/* 바이트 구간 [first, last] (양 끝 포함) */
+typedef struct {
+  long long first, last;
+} hp_range_t;
+
+/* 요청이나 응답 하나 */
+typedef struct {
+  hp_str_t line;               /* 첫 줄 전체 (줄바꿈 포함) */
+  hp_str_t version;
+  hp_str_t method, uri;        /* 요청 */
+  hp_str_t host, port, path;   /* 요청 URI 구성 요소. 없는 것은 len 0 (IPv6 주소는 [] 를 뺌) */
+  int status;                  /* 응답 */
+  hp_str_t reason;
+  hp_hdr_t hdr[HP_MAXHDRS];
+  int nhdr;
+
+  /* 이어서 파싱하기 위한 상태 */
+  const char *base;  /* 지난번 buf: 달라졌으면 위 조각들을 옮김 */
+  size_t off;        /* 아직 처리하지 않은 첫 줄의 시작 */
+  size_t scan;       /* 줄 끝('\n')을 여기서부터 찾음 */
+  int state;
+} hp_msg_t;
+
+void hp_init(hp_msg_t *r);
+
+/* buf[0..len) 에서 요청 줄과 헤더를 빈 줄까지. 헤더 블록 길이(빈 줄 포함) 또는 HP_* */
+int hp_parse_request(hp_msg_t *r, const char *buf, size_t len);
+
+/* 같은 일을 상태 줄("HTTP/1.1 200 OK")로 시작하는 응답에 */
+int hp_parse_response(hp_msg_t *r, const char *buf, size_t len);
+
+/* 조각들이 같은 내용을 담은 다른 버퍼(buf)를 가리키도록 (파싱이 끝난 뒤 복사해 둘 때) */
+void hp_rebase(hp_msg_t *r, const char *buf);
+
+/* 조각이 문자열 s 와 대소문자 없이 같은지 */
+int hp_eq(hp_str_t a, const char *s);
+
+/* 조각 안에 문자열 s 가 (대소문자 없이) 들어 있는지 */
+int hp_has(hp_str_t a, const char *s);
+
+/* Content-Length 값. 숫자만으로 된 게 아니면 -1 */
+long long hp_clen(hp_str_t a);
+
+/* Range 값("bytes=0-99, 200-, -500")을 길이 size 인 본문에 맞춰 rg 에 (요청 순서대로).
+   만족하는 구간 수를 돌려줌: 0 이면 하나도 없음 (416). 형식이 틀렸거나 bytes 가 아니거나
+   구간이 max 개를 넘으면 -1 (Range 를 무시하고 전체를 보내면 됨) */
+int hp_range(hp_str_t a, long long size, hp_range_t *rg, int max);
+
+#endif /* __HTTPPARSE_H__ */
@@ -0,0 +1,846 @@
+/*
+ * origin.c - origin(host:port)별 상태: keep-alive 연결 풀, circuit breaker, 동시 연결 제한
+ *
+ * breaker 상태 전이:
+ *   CLOSED   --(창 안에서 실패율이 breaker_failure_pct 이상)-->  OPEN
+ *   OPEN     --(breaker_open_ms 경과)-->  HALF_OPEN
+ *   HALF_OPEN: 요청 하나만 probe 로 통과. 성공하면 CLOSED, 실패하면 다시 OPEN
+ *
+ * 동시 연결 제한: checkout 은 먼저 연결 자리(slot)를 얻는다. origin 마다
+ * origin_max_conns, 전체로 upstream_max_conns 까지만 동시에 checkout 된다.
+ * 자리가 없으면 origin 별 FIFO 큐에서 기다리고, 자리가 나면 기다리는 origin
+ * 들을 돌아가며(round robin, 한 번에 요청 하나) 나눠 준다. 그래서 한 origin
+ * 이 큐를 길게 쌓아도 다른 origin 의 요청은 자기 차례에 바로 나간다.
+ * 미리 연결도 시작할 때 자리를 하나 받아 두고(바로 받을 수 있을 때만), 그 연결을
+ * 쓰는 요청이 checkout 에서 자리를 넘겨받는다. 그래서 미리 연결이 한도를 넘지 않는다.
+ */
+#include <poll.h>
+#include "origin.h"
+#include "conf.h"
+#include "dns.h"
+
+#define ORIGIN_NBUCKETS 256     /* 2의 거듭제곱 */
+#define POOL_SWEEP_MS   1000    /* idle 연결 정리 주기 */
+#define LAT_NBUCKETS    20      /* 지연 히스토그램: i번 칸은 [2^(i-1), 2^i) ms */
+#define LAT_MAXCOUNT    1024    /* 표본이 이만큼 쌓이면 전부 반으로 (최근 값 위주) */
+#define HEDGE_MIN_SAMPLES 20    /* 이보다 표본이 적으면 hedge 하지 않음 */
+#define HEDGE_MAX_CREDIT 1000   /* hedge 예산 상한 (1/100 단위, 연속 10번) */
+
+/* 요청 줄만 읽고 시작한 연결 (헤더를 읽는 동안 연결이 진행됨) */
+struct preconn {
+  origin_t *o;
+  upconn_t *c;           /* 결과. 실패면 NULL */
+  int err;               /* 실패했을 때 errno */
+  int done;
+  int abandoned;         /* 요청 쪽이 안 기다림: 스레드가 결과를 풀에 넣고 정리 */
+  int slot;              /* 받아 둔 slot: checkout 이 넘겨받거나, 안 쓰이면 놓음 */
+  pthread_cond_t cond;
+};
+
+/* slot 을 기다리는 요청 하나 */
+typedef struct slot_waiter {
+  pthread_cond_t cond;
+  int granted;           /* 자리를 받았음 (inflight 에 이미 반영됨) */
+  struct slot_waiter *next;
+} slot_waiter_t;
+
+enum { BRK_CLOSED, BRK_OPEN, BRK_HALF_OPEN };
+
+struct origin {
+  char *host, *port;
+  char *unix_path;       /* unix_origins 에 있으면 이 AF_UNIX 소켓으로 연결 */
+  unsigned long long hash;
+  upconn_t *idle;        /* 놀고 있는 연결 스택 (top이 가장 최근) */
+  int nidle;
+  int inflight;          /* slot 을 받은 요청 수 (연결 중이거나 checkout 된 연결, 미리 연결 포함) */
+  slot_waiter_t *qhead, *qtail; /* slot 대기 큐 (FIFO) */
+  int qlen;
+  origin_t *bnext, *bprev; /* 대기 중인 origin 들의 원형 리스트 */
+  long long waits;       /* slot 을 받은 횟수 */
+  long long wait_hist[LAT_NBUCKETS]; /* slot 대기 시간 분포 (ms, 2의 거듭제곱 칸) */
+  long long queue_rejected; /* 큐가 가득 찼거나 기다리다 시간이 다 된 요청 */
+
+  /* 미리 연결 */
+  int preconnecting;     /* 진행 중인 미리 연결 수 */
+  long long rate_start;  /* 요청 빈도 집계 창 시작 */
+  int rate_count, rate_last; /* 이번 창 / 지난 창의 요청 수 */
+  origin_t *hnext;       /* 해시 체인 */
+
+  /* circuit breaker */
+  int brk_state;
+  long long win_start;   /* 현재 집계 창 시작 시각 (tumbling window) */
+  int win_total, win_fail;
+  long long open_until;  /* OPEN 이 끝나는 시각 */
+  int probing;           /* HALF_OPEN 에서 probe 요청이 나가 있음 */
+  long long lat_ewma_ms; /* 첫 바이트까지 지연의 지수 이동 평균 */
+  int lat_hist[LAT_NBUCKETS]; /* 첫 바이트 지연 분포 (hedge 지연 계산용) */
+  int lat_count;
+};
+
+static origin_t *buckets[ORIGIN_NBUCKETS];
+static pthread_mutex_t origin_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_stats_t stats;
+static long long last_sweep;
+static int hedge_credit;     /* hedge 예산 (1/100 단위). 요청마다 hedge_budget_pct 씩 쌓임 */
+static int total_inflight;   /* 모든 origin 의 inflight 합 */
+static origin_t *backlog;    /* 다음에 slot 을 받을 차례인 대기 origin */
+static int nbacklog;
+
+static unsigned long long origin_hash(const char *host, const char *port)
+{
+  unsigned long long h = 1469598103934665603ULL;
+
+  while (*host)
+    h = (h ^ (unsigned char)*host++) * 1099511628211ULL;
+  h = (h ^ ':') * 1099511628211ULL;
+  while (*port)
+    h = (h ^ (unsigned char)*port++) * 1099511628211ULL;
+  return h;
+}
+
+/* unix_origins ("host:port=/path,...") 에서 host:port 에 해당하는 소켓 경로. 없으면 NULL */
+static char *unix_path_for(const char *host, const char *port)
+{
+  const char *s = conf.unix_origins, *eq, *end;
+  size_t hlen = strlen(host), plen = strlen(port);
+
+  for (; s && *s; s = *end ? end + 1 : end) {
+    end = strchr(s, ',');
+    if (!end)
+      end = s + strlen(s);
+    eq = memchr(s, '=', end - s);
+    if (eq && eq - s == hlen + 1 + plen && !strncasecmp(s, host, hlen) &&
+        s[hlen] == ':' && !strncmp(s + hlen + 1, port, plen))
+      return strndup(eq + 1, end - eq - 1);
+  }
+  return NULL;
+}
+
+/* 없으면 만든다. origin_lock 을 잡은 상태에서 호출 */
+static origin_t *origin_get_locked(const char *host, const char *port)
+{
+  unsigned long long h = origin_hash(host, port);
+  origin_t **bp = &buckets[h & (ORIGIN_NBUCKETS - 1)], *o;
+
+  for (o = *bp; o; o = o->hnext)
+    if (o->hash == h && !strcmp(o->host, host) && !strcmp(o->port, port))
+      return o;
+
+  o = Calloc(1, sizeof(origin_t));
+  o->host = strdup(host);
+  o->port = strdup(port);
+  o->unix_path = unix_path_for(host, port);
+  o->hash = h;
+  o->hnext = *bp;
+  *bp = o;
+  return o;
+}
+
+/* idle_timeout 이 지난 연결을 떼어내 dead 리스트로. origin_lock 잡은 상태 */
+static void sweep_locked(long long now, upconn_t **dead)
+{
+  upconn_t **pp, *c;
+  origin_t *o;
+  int i;
+
+  if (now - last_sweep < POOL_SWEEP_MS)
+    return;
+  last_sweep = now;
+  for (i = 0; i < ORIGIN_NBUCKETS; i++) {
+    for (o = buckets[i]; o; o = o->hnext) {
+      for (pp = &o->idle; (c = *pp) != NULL; ) {
+        if (now - c->idle_since >= conf.pool_idle_timeout_ms) {
+          *pp = c->next;
+          o->nidle--;
+          stats.evicted++;
+          c->next = *dead;
+          *dead = c;
+        } else {
+          pp = &c->next;
+        }
+      }
+    }
+  }
+}
+
+static void close_list(upconn_t *c)
+{
+  upconn_t *next;
+
+  for (; c; c = next) {
+    next = c->next;
+    close(c->fd);
+    Free(c);
+  }
+}
+
+/* 놀던 연결에 읽을 게 있으면 origin이 끊었거나(EOF) 이상한 바이트를 보낸 것 */
+static int conn_alive(int fd)
+{
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+  return poll(&pfd, 1, 0) == 0;
+}
+
+origin_t *origin_get(const char *host, const char *port)
+{
+  origin_t *o;
+
+  pthread_mutex_lock(&origin_lock);
+  o = origin_get_locked(host, port);
+  pthread_mutex_unlock(&origin_lock);
+  return o;
+}
+
+int origin_admit(origin_t *o)
+{
+  long long now = msec_now();
+  int ok = 1;
+
+  if (conf.breaker_failure_pct <= 0)
+    return 1;
+  pthread_mutex_lock(&origin_lock);
+  if (o->brk_state == BRK_OPEN && now >= o->open_until) {
+    o->brk_state = BRK_HALF_OPEN;
+    o->probing = 0;
+  }
+  if (o->brk_state == BRK_OPEN || (o->brk_state == BRK_HALF_OPEN && o->probing))
+    ok = 0;
+  else if (o->brk_state == BRK_HALF_OPEN)
+    o->probing = 1;  /* 이 요청이 probe */
+  if (!ok)
+    stats.brk_rejected++;
+  pthread_mutex_unlock(&origin_lock);
+  return ok;
+}
+
+/* origin_lock 잡은 상태 */
+static void brk_trip(origin_t *o, long long now)
+{
+  o->brk_state = BRK_OPEN;
+  o->open_until = now + conf.breaker_open_ms;
+  o->probing = 0;
+  stats.brk_opened++;
+  fprintf(stderr, "circuit open: %s:%s (%d/%d failed)\n",
+          o->host, o->port, o->win_fail, o->win_total);
+}
+
+/* ms 가 들어갈 히스토그램 칸: 0 → 0, [2^(i-1), 2^i) → i */
+static int log2_bucket(long long ms)
+{
+  int i = 0;
+
+  while (ms > 0 && i < LAT_NBUCKETS - 1) {
+    ms >>= 1;
+    i++;
+  }
+  return i;
+}
+
+/* origin_lock 잡은 상태 */
+static void lat_record(origin_t *o, long long ms)
+{
+  int i;
+
+  o->lat_hist[log2_bucket(ms)]++;
+  if (++o->lat_count >= LAT_MAXCOUNT) {
+    o->lat_count = 0;
+    for (i = 0; i < LAT_NBUCKETS; i++)
+      o->lat_count += (o->lat_hist[i] >>= 1);
+  }
+}
+
+int origin_hedge_delay(origin_t *o)
+{
+  int i, cum = 0, want, delay = -1;
+
+  if (conf.hedge_percentile <= 0)
+    return -1;
+  pthread_mutex_lock(&origin_lock);
+  hedge_credit += conf.hedge_budget_pct;
+  if (hedge_credit > HEDGE_MAX_CREDIT)
+    hedge_credit = HEDGE_MAX_CREDIT;
+  if (o->lat_count >= HEDGE_MIN_SAMPLES) {
+    want = (o->lat_count * conf.hedge_percentile + 99) / 100;
+    for (i = 0; i < LAT_NBUCKETS; i++) {
+      if ((cum += o->lat_hist[i]) >= want) {
+        delay = 1 << i;  /* 칸의 위쪽 경계 */
+        break;
+      }
+    }
+    if (delay >= 0 && delay < conf.hedge_min_delay_ms)
+      delay = conf.hedge_min_delay_ms;
+  }
+  pthread_mutex_unlock(&origin_lock);
+  return delay;
+}
+
+int origin_hedge_spend(void)
+{
+  int ok;
+
+  pthread_mutex_lock(&origin_lock);
+  if ((ok = hedge_credit >= 100)) {
+    hedge_credit -= 100;
+    stats.hedge_sent++;
+  }
+  pthread_mutex_unlock(&origin_lock);
+  return ok;
+}
+
+void origin_hedge_won(void)
+{
+  pthread_mutex_lock(&origin_lock);
+  stats.hedge_won++;
+  pthread_mutex_unlock(&origin_lock);
+}
+
+void origin_result(origin_t *o, int ok, long long latency_ms)
+{
+  long long now = msec_now();
+
+  pthread_mutex_lock(&origin_lock);
+  if (ok < 0) {
+    /* origin 까지 가지도 않았음: 실패율에 넣지 않고 probe 자리만 돌려줌 */
+    if (o->brk_state == BRK_HALF_OPEN)
+      o->probing = 0;
+    pthread_mutex_unlock(&origin_lock);
+    return;
+  }
+  if (ok && latency_ms >= 0) {
+    o->lat_ewma_ms = o->lat_ewma_ms ? (o->lat_ewma_ms * 7 + latency_ms) / 8 : latency_ms;
+    lat_record(o, latency_ms);
+  }
+  if (ok && conf.breaker_slow_ms > 0 && latency_ms >= conf.breaker_slow_ms)
+    ok = 0;  /* 너무 느린 응답도 실패로 셈 */
+
+  if (conf.breaker_failure_pct > 0) {
+    switch (o->brk_state) {
+    case BRK_CLOSED:
+      if (now - o->win_start >= conf.breaker_window_ms) {
+        o->win_start = now;
+        o->win_total = o->win_fail = 0;
+      }
+      o->win_total++;
+      o->win_fail += !ok;
+      if (o->win_total >= conf.breaker_min_requests &&
+          o->win_fail * 100 >= o->win_total * conf.breaker_failure_pct)
+        brk_trip(o, now);
+      break;
+    case BRK_HALF_OPEN:
+      if (!o->probing)
+        break;  /* probe 전에 들어갔던 요청의 늦은 결과 */
+      if (ok) {
+        o->brk_state = BRK_CLOSED;
+        o->probing = 0;
+        o->win_start = now;
+        o->win_total = o->win_fail = 0;
+      } else {
+        brk_trip(o, now);
+      }
+      break;
+    default:
+      break;  /* OPEN 중에 도착한 늦은 결과는 무시 */
+    }
+  }
+  pthread_mutex_unlock(&origin_lock);
+}
+
+static int slot_limited(void)
+{
+  return conf.origin_max_conns > 0 || conf.upstream_max_conns > 0;
+}
+
+/* 대기 origin 원형 리스트. origin_lock 잡은 상태 */
+static void backlog_add(origin_t *o)
+{
+  if (!backlog) {
+    o->bnext = o->bprev = o;
+    backlog = o;
+  } else {
+    /* 지금 차례(backlog) 바로 앞 = 한 바퀴의 맨 끝 */
+    o->bnext = backlog;
+    o->bprev = backlog->bprev;
+    o->bprev->bnext = o;
+    backlog->bprev = o;
+  }
+  nbacklog++;
+}
+
+static void backlog_remove(origin_t *o)
+{
+  if (o->bnext == o) {
+    backlog = NULL;
+  } else {
+    o->bprev->bnext = o->bnext;
+    o->bnext->bprev = o->bprev;
+    if (backlog == o)
+      backlog = o->bnext;
+  }
+  o->bnext = o->bprev = NULL;
+  nbacklog--;
+}
+
+/* 빈 자리를 대기 origin 들에 돌아가며 하나씩 나눠 줌. origin_lock 잡은 상태 */
+static void slot_dispatch_locked(void)
+{
+  slot_waiter_t *w;
+  origin_t *o;
+  int skipped = 0;  /* 연속으로 자기 한도에 걸린 origin 수 */
+
+  while (backlog && skipped < nbacklog &&
+         (conf.upstream_max_conns <= 0 || total_inflight < conf.upstream_max_conns)) {
+    o = backlog;
+    backlog = o->bnext;  /* 다음 자리는 다음 origin 차례 */
+    if (conf.origin_max_conns > 0 && o->inflight >= conf.origin_max_conns) {
+      skipped++;
+      continue;
+    }
+    skipped = 0;
+    w = o->qhead;
+    if (!(o->qhead = w->next))
+      o->qtail = NULL;
+    if (--o->qlen == 0)
+      backlog_remove(o);
+    o->inflight++;
+    total_inflight++;
+    w->granted = 1;
+    pthread_cond_signal(&w->cond);
+  }
+}
+
+static void slot_release_locked(origin_t *o)
+{
+  o->inflight--;
+  total_inflight--;
+  if (slot_limited())
+    slot_dispatch_locked();
+}
+
+/* 기다리는 요청이 없고 자리가 남아 있으면 바로 하나 받음 (미리 연결용: 줄을 서지 않음)
+   받았으면 1. origin_lock 잡은 상태 */
+static int slot_try_locked(origin_t *o)
+{
+  if (slot_limited() && (backlog ||
+      (conf.upstream_max_conns > 0 && total_inflight >= conf.upstream_max_conns) ||
+      (conf.origin_max_conns > 0 && o->inflight >= conf.origin_max_conns)))
+    return 0;
+  o->inflight++;
+  total_inflight++;
+  return 1;
+}
+
+/* slot 을 받으면 0. 큐가 가득 찼거나, nowait 인데 바로 못 받았거나,
+   origin_queue_timeout_ms 안에 못 받으면 -1 */
+static int slot_acquire(origin_t *o, int nowait)
+{
+  pthread_condattr_t attr;
+  struct timespec deadline;
+  slot_waiter_t w, *p, *prev;
+  long long start, until;
+  int rc = 0;
+
+  pthread_mutex_lock(&origin_lock);
+  if (!slot_limited()) {
+    o->inflight++;
+    total_inflight++;
+    pthread_mutex_unlock(&origin_lock);
+    return 0;
+  }
+  if (o->qlen >= conf.origin_queue_max) {
+    o->queue_rejected++;
+    pthread_mutex_unlock(&origin_lock);
+    return -1;
+  }
+
+  /* 일단 줄을 서고 나눠 주기를 돌림: 자리가 있고 앞에 기다리는 origin 이 없으면
+     바로 받는다. 새로 온 요청이 오래 기다린 요청을 앞지르지 못함 */
+  start = msec_now();
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&w.cond, &attr);
+  pthread_condattr_destroy(&attr);
+  w.granted = 0;
+  w.next = NULL;
+  if (o->qtail)
+    o->qtail->next = &w;
+  else
+    o->qhead = &w;
+  o->qtail = &w;
+  if (o->qlen++ == 0)
+    backlog_add(o);
+  slot_dispatch_locked();
+
+  if (!w.granted && !nowait) {
+    until = start + conf.origin_queue_timeout_ms;
+    deadline.tv_sec = until / 1000;
+    deadline.tv_nsec = (until % 1000) * 1000000;
+    while (!w.granted && rc != ETIMEDOUT)
+      rc = pthread_cond_timedwait(&w.cond, &origin_lock, &deadline);
+  }
+  pthread_cond_destroy(&w.cond);
+
+  if (!w.granted) {
+    for (prev = NULL, p = o->qhead; p != &w; prev = p, p = p->next)
+      ;
+    if (prev)
+      prev->next = w.next;
+    else
+      o->qhead = w.next;
+    if (o->qtail == &w)
+      o->qtail = prev;
+    if (--o->qlen == 0)
+      backlog_remove(o);
+    if (!nowait)
+      o->queue_rejected++;
+    pthread_mutex_unlock(&origin_lock);
+    return -1;
+  }
+  o->waits++;
+  o->wait_hist[log2_bucket(msec_now() - start)]++;
+  pthread_mutex_unlock(&origin_lock);
+  return 0;
+}
+
+/* 새 연결 (주소는 DNS 캐시에서). 이름 해석이 제때 안 끝났으면(EAI_AGAIN)
+   연결 타임아웃과 같이 ETIMEDOUT 으로 알림. slot 은 건드리지 않음.
+   같은 호스트의 origin 이면 이름 해석도 TCP 도 없이 Unix 소켓으로 바로 연결 */
+static upconn_t *conn_open(origin_t *o, int tfo)
+{
+  upconn_t *c;
+  dns_ent_t *de;
+  int fd;
+
+  if (o->unix_path) {
+    fd = open_unix_clientfd(o->unix_path);
+    tfo = 0;
+  } else {
+    de = dns_lookup(o->host, o->port);
+    if (de->err)
+      errno = de->err == EAI_AGAIN ? ETIMEDOUT : EHOSTUNREACH;
+    fd = de->err ? -1 : open_clientfd_ai(de->addrs, conf.upstream_connect_timeout_ms,
+                                         tfo ? OPEN_TFO : 0);
+    dns_release(de);
+  }
+  if (fd < 0)
+    return NULL;
+  c = Malloc(sizeof(upconn_t));
+  c->fd = fd;
+  rio_readinitb(&c->rio, fd);
+  c->origin = o;
+  c->reused = 0;
+  c->tfo = tfo;
+  c->idle_since = 0;
+  c->next = NULL;
+  return c;
+}
+
+/* 놀고 있는 연결로 풀에 넣음. 풀이 가득 찼으면 0 (호출자가 닫음). origin_lock 잡은 상태 */
+static int pool_put_locked(origin_t *o, upconn_t *c)
+{
+  if (o->nidle >= conf.pool_max_idle_per_origin) {
+    stats.evicted++;
+    return 0;
+  }
+  c->idle_since = msec_now();
+  c->next = o->idle;
+  o->idle = c;
+  o->nidle++;
+  return 1;
+}
+
+/* 요청이 안 쓰게 된 미리 연결한 연결은 풀로 (다음 요청이 씀) */
+static void preconn_park(upconn_t *c)
+{
+  int keep;
+
+  pthread_mutex_lock(&origin_lock);
+  keep = pool_put_locked(c->origin, c);
+  stats.preconnect_parked += keep;
+  pthread_mutex_unlock(&origin_lock);
+  if (!keep) {
+    close(c->fd);
+    Free(c);
+  }
+}
+
+static void *preconnect_thread(void *vargp)
+{
+  preconn_t *p = vargp;
+  upconn_t *c;
+  int err;
+
+  Pthread_detach(pthread_self());
+  /* TFO 연결은 첫 write 까지 SYN 을 미루므로 미리 연결하는 의미가 없음 */
+  c = conn_open(p->o, 0);
+  err = errno;
+
+  pthread_mutex_lock(&origin_lock);
+  p->o->preconnecting--;
+  if (p->abandoned && p->slot)
+    slot_release_locked(p->o);
+  if (!p->abandoned) {
+    p->c = c;
+    p->err = err;
+    p->done = 1;
+    pthread_cond_signal(&p->cond);
+    pthread_mutex_unlock(&origin_lock);
+    return NULL;
+  }
+  pthread_mutex_unlock(&origin_lock);
+  pthread_cond_destroy(&p->cond);
+  Free(p);
+  if (c)
+    preconn_park(c);
+  return NULL;
+}
+
+/* 진행 중인 미리 연결이 없고 slot 을 바로 받을 수 있을 때만 시작. origin_lock 잡은 상태 */
+static preconn_t *preconnect_start_locked(origin_t *o, int abandoned)
+{
+  preconn_t *p;
+  pthread_t tid;
+
+  if (o->nidle > 0 || o->preconnecting > 0 || o->brk_state != BRK_CLOSED || !slot_try_locked(o))
+    return NULL;
+  p = Calloc(1, sizeof(preconn_t));
+  p->o = o;
+  p->abandoned = abandoned;
+  p->slot = 1;
+  pthread_cond_init(&p->cond, NULL);
+  if (pthread_create(&tid, NULL, preconnect_thread, p) != 0) {
+    pthread_cond_destroy(&p->cond);
+    Free(p);
+    slot_release_locked(o);
+    return NULL;
+  }
+  o->preconnecting++;
+  stats.preconnect_started++;
+  return p;
+}
+
+preconn_t *origin_preconnect(origin_t *o)
+{
+  preconn_t *p = NULL;
+
+  if (!conf.preconnect)
+    return NULL;
+  pthread_mutex_lock(&origin_lock);
+  p = preconnect_start_locked(o, 0);
+  pthread_mutex_unlock(&origin_lock);
+  return p;
+}
+
+void origin_preconnect_cancel(preconn_t *p)
+{
+  upconn_t *c = NULL;
+
+  if (!p)
+    return;
+  pthread_mutex_lock(&origin_lock);
+  if (!p->done) {
+    p->abandoned = 1;  /* 스레드가 끝나면 알아서 정리 */
+    pthread_mutex_unlock(&origin_lock);
+    return;
+  }
+  c = p->c;
+  if (p->slot)
+    slot_release_locked(p->o);
+  pthread_mutex_unlock(&origin_lock);
+  pthread_cond_destroy(&p->cond);
+  Free(p);
+  if (c)
+    preconn_park(c);
+}
+
+/* 요청 빈도 (1초 tumbling window) 를 세고, 빈도가 preconnect_rate 이상인데
+   풀이 비어 있으면 다음 요청용 연결을 하나 미리 만듦. origin_lock 잡은 상태 */
+static void predict_locked(origin_t *o, long long now)
+{
+  if (now - o->rate_start >= 1000) {
+    o->rate_last = now - o->rate_start < 2000 ? o->rate_count : 0;
+    o->rate_start = now;
+    o->rate_count = 0;
+  }
+  o->rate_count++;
+  if (conf.preconnect_rate > 0 && o->rate_last >= conf.preconnect_rate)
+    preconnect_start_locked(o, 1);
+}
+
+upconn_t *origin_checkout(origin_t *o, int flags)
+{
+  return origin_checkout_pre(o, flags, NULL);
+}
+
+upconn_t *origin_checkout_pre(origin_t *o, int flags, preconn_t *p)
+{
+  upconn_t *c, *dead = NULL;
+  long long now;
+  int err, got;
+
+  /* 미리 연결이 받아 둔 slot 은 이 요청이 넘겨받음 */
+  pthread_mutex_lock(&origin_lock);
+  got = p && p->o == o && p->slot;
+  if (got)
+    p->slot = 0;
+  pthread_mutex_unlock(&origin_lock);
+  if (!got && slot_acquire(o, flags & CHECKOUT_NOWAIT) < 0) {
+    origin_preconnect_cancel(p);
+    errno = EBUSY;
+    return NULL;
+  }
+
+  while (1) {
+    pthread_mutex_lock(&origin_lock);
+    now = msec_now();
+    sweep_locked(now, &dead);
+    c = NULL;
+    if ((flags & CHECKOUT_POOLED) && o->idle) {
+      c = o->idle;
+      o->idle = c->next;
+      o->nidle--;
+    }
+    if (!c && !(flags & CHECKOUT_NOWAIT))
+      predict_locked(o, now);
+    pthread_mutex_unlock(&origin_lock);
+    close_list(dead);
+    dead = NULL;
+
+    if (!c)
+      break;
+    if (conn_alive(c->fd)) {
+      pthread_mutex_lock(&origin_lock);
+      stats.hits++;
+      pthread_mutex_unlock(&origin_lock);
+      c->reused = 1;
+      c->next = NULL;
+      origin_preconnect_cancel(p);  /* 풀 연결이 더 빠름: 미리 연결한 건 풀로 */
+      return c;
+    }
+    pthread_mutex_lock(&origin_lock);
+    stats.stale++;
+    pthread_mutex_unlock(&origin_lock);
+    close(c->fd);
+    Free(c);
+  }
+
+  /* 풀에 쓸 만한 게 없으면 새로 연결. 미리 시작한 연결이 있으면 그게 끝나길 기다림 */
+  if (p) {
+    pthread_mutex_lock(&origin_lock);
+    while (!p->done)
+      pthread_cond_wait(&p->cond, &origin_lock);
+    c = p->c;
+    err = p->err;
+    if (c)
+      stats.preconnect_used++;
+    pthread_mutex_unlock(&origin_lock);
+    pthread_cond_destroy(&p->cond);
+    Free(p);
+    errno = err;
+  } else {
+    c = conn_open(o, conf.tfo_upstream);
+  }
+  pthread_mutex_lock(&origin_lock);
+  if (c)
+    stats.misses++;
+  else
+    slot_release_locked(o);
+  pthread_mutex_unlock(&origin_lock);
+  return c;
+}
+
+void origin_checkin(upconn_t *c)
+{
+  origin_t *o = c->origin;
+  int keep;
+
+  /* 응답 뒤에 남은 바이트가 있으면 프레이밍이 어긋난 연결이므로 재사용 불가 */
+  if (c->rio.rio_cnt > 0) {
+    origin_discard(c);
+    return;
+  }
+
+  pthread_mutex_lock(&origin_lock);
+  slot_release_locked(o);
+  keep = pool_put_locked(o, c);
+  pthread_mutex_unlock(&origin_lock);
+
+  if (!keep) {
+    close(c->fd);
+    Free(c);
+  }
+}
+
+void origin_discard(upconn_t *c)
+{
+  pthread_mutex_lock(&origin_lock);
+  slot_release_locked(c->origin);
+  pthread_mutex_unlock(&origin_lock);
+  close(c->fd);
+  Free(c);
+}
+
+void origin_note_tfo(upconn_t *c)
+{
+  struct tcp_info ti;
+  socklen_t len = sizeof(ti);
+  int syn_data;
+
+  if (!c->tfo)
+    return;
+  c->tfo = 0;
+  syn_data = getsockopt(c->fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == 0 &&
+             (ti.tcpi_options & TCPI_OPT_SYN_DATA);
+
+  pthread_mutex_lock(&origin_lock);
+  if (syn_data)
+    stats.tfo_syn_data++;
+  else
+    stats.tfo_fallback++;
+  pthread_mutex_unlock(&origin_lock);
+}
+
+int origin_queue_stats(char *buf, size_t size)
+{
+  size_t len = 0;
+  origin_t *o;
+  int i, b, n;
+
+  pthread_mutex_lock(&origin_lock);
+  for (i = 0; i < ORIGIN_NBUCKETS; i++) {
+    for (o = buckets[i]; o; o = o->hnext) {
+      if (!o->waits && !o->queue_rejected)
+        continue;
+      n = snprintf(buf + len, size - len, "queue %s:%s inflight %d waiting %d rejected %lld wait_ms",
+                   o->host, o->port, o->inflight, o->qlen, o->queue_rejected);
+      for (b = 0; b < LAT_NBUCKETS && n > 0 && len + n < size; b++)
+        if (o->wait_hist[b])
+          n += snprintf(buf + len + n, size - len - n, " <%d:%lld", 1 << b, o->wait_hist[b]);
+      if (n <= 0 || len + n + 1 >= size)
+        goto out;
+      len += n;
+      buf[len++] = '\n';
+      buf[len] = '\0';
+    }
+  }
+out:
+  pthread_mutex_unlock(&origin_lock);
+  return len;
+}
+
+int origin_inflight(origin_t *o)
+{
+  int n;
+
+  pthread_mutex_lock(&origin_lock);
+  n = o->inflight;
+  pthread_mutex_unlock(&origin_lock);
+  return n;
+}
+
+void origin_pool_stats(pool_stats_t *st)
+{
+  pthread_mutex_lock(&origin_lock);
+  *st = stats;
+  pthread_mutex_unlock(&origin_lock);
+}
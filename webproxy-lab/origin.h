@@ -0,0 +1,108 @@
+/*
+ * origin.h - origin(host:port)별 상태: keep-alive 연결 풀, circuit breaker, 동시 연결 제한
+ *
+ * origin 하나마다 놀고 있는 keep-alive 연결을 스택으로 들고 있다.
+ * checkout 은 풀에서 살아 있는 연결을 꺼내고, 없으면 새로 연결한다.
+ * 응답을 끝까지 정확히 읽은 연결만 checkin 으로 돌려놓고, 나머지는
+ * discard 로 닫는다. pool_idle_timeout_ms 보다 오래 논 연결은 버린다.
+ *
+ * 요청마다 origin_admit 으로 breaker 를 통과한 뒤 결과를 origin_result 로
+ * 알려준다. 최근 실패율이 높은 origin 은 잠시 연결 시도 없이 바로 거절해서
+ * 죽은 origin 이 워커 스레드를 타임아웃 동안 붙잡지 못하게 한다.
+ *
+ * origin_max_conns / upstream_max_conns 가 있으면 checkout 은 자리가 날 때까지
+ * origin 별 큐에서 기다린다. 자리는 기다리는 origin 들에 돌아가며 나눠 준다.
+ */
+#ifndef __ORIGIN_H__
+#define __ORIGIN_H__
+
+#include "csapp.h"
+
+typedef struct origin origin_t;
+typedef struct preconn preconn_t;
+
+/* origin 과의 연결 하나 */
+typedef struct upconn {
+  int fd;
+  rio_t rio;             /* 연결과 수명을 같이 하는 읽기 버퍼 */
+  origin_t *origin;
+  int reused;            /* 풀에서 꺼낸 연결이면 1 (stale 일 수 있음) */
+  int tfo;               /* Fast Open 으로 연결했고 아직 결과를 안 셌으면 1 */
+  long long idle_since;  /* 풀에 들어간 시각 */
+  struct upconn *next;   /* 풀 스택 */
+} upconn_t;
+
+/* 없으면 만든다. origin 은 해제되지 않으므로 포인터를 계속 들고 있어도 됨 */
+origin_t *origin_get(const char *host, const char *port);
+
+/* circuit breaker. 0이면 바로 거절 (OPEN, 또는 HALF_OPEN 인데 probe 가 나가 있음).
+   1을 받았으면 결과를 반드시 origin_result 로 한 번 알려야 한다 */
+int origin_admit(origin_t *o);
+
+/* ok: origin이 정상 응답했는지, latency_ms: 첫 바이트까지 걸린 시간 (-1이면 모름)
+   ok < 0: origin 에 보내지도 못함 (slot 대기 실패). 실패율에는 넣지 않음 */
+void origin_result(origin_t *o, int ok, long long latency_ms);
+
+/* hedging: 첫 요청이 이 시간(ms) 안에 첫 바이트를 못 받으면 두 번째 요청을 보낸다.
+   최근 첫 바이트 지연의 hedge_percentile 분위수. 꺼져 있거나 표본이 모자라면 -1.
+   eligible 한 요청마다 한 번 불러야 hedge 예산(hedge_budget_pct)이 쌓인다 */
+int origin_hedge_delay(origin_t *o);
+int origin_hedge_spend(void);  /* 예산이 있으면 1 (쓰고), 없으면 0 */
+void origin_hedge_won(void);   /* 두 번째 요청이 먼저 응답함 */
+
+/* checkout flags */
+#define CHECKOUT_POOLED 0x1  /* 풀의 연결을 써도 됨 (없으면 항상 새 연결: 재전송할 수 없는 본문) */
+#define CHECKOUT_NOWAIT 0x2  /* slot 이 바로 안 나면 기다리지 않고 실패 */
+
+/* 실패하면 NULL. errno 는 이름 해석이나 연결이 시간 안에 안 끝났으면 ETIMEDOUT,
+   slot 을 못 받았으면(큐 가득 참, 대기 시간 초과) EBUSY */
+upconn_t *origin_checkout(origin_t *o, int flags);
+
+/* 요청 줄만 보고 연결을 미리 시작 (별도 스레드에서 이름 해석 + 연결). 나머지
+   헤더를 읽는 동안 연결이 진행된다. 풀에 놀고 있는 연결이 있거나, preconnect 가
+   꺼져 있거나, breaker 가 닫혀 있지 않거나, 이 origin 에 이미 미리 연결이 진행
+   중이거나, 연결 자리(slot)를 기다리지 않고 바로 받을 수 없으면 NULL.
+   받은 slot 은 origin_checkout_pre 가 넘겨받는다.
+   받은 핸들은 origin_checkout_pre 에 넘기거나 origin_preconnect_cancel 로 돌려줌 */
+preconn_t *origin_preconnect(origin_t *o);
+
+/* origin_checkout 과 같지만, 풀에 쓸 연결이 없으면 p 의 연결을 기다려서 씀.
+   p 는 성공/실패와 상관없이 소비됨 (NULL 이면 origin_checkout 과 같음) */
+upconn_t *origin_checkout_pre(origin_t *o, int flags, preconn_t *p);
+
+/* 안 쓰게 된 미리 연결. 연결이 되면 풀로 들어가 다음 요청이 씀 */
+void origin_preconnect_cancel(preconn_t *p);
+void origin_checkin(upconn_t *c);
+void origin_discard(upconn_t *c);
+
+/* 지금 checkout 되어 있는 연결 수 (= 이 origin 에 나가 있는 요청 수) */
+int origin_inflight(origin_t *o);
+
+/* 새 연결의 첫 응답을 받은 뒤 호출: 요청이 SYN 에 실려 갔는지(TFO 성공)
+   아니면 일반 handshake 로 넘어갔는지 센다 */
+void origin_note_tfo(upconn_t *c);
+
+/* 풀 통계 */
+typedef struct {
+  long long hits;        /* 풀에서 꺼내 쓴 횟수 */
+  long long misses;      /* 새로 연결한 횟수 */
+  long long stale;       /* 꺼냈는데 이미 끊겨 있던 연결 */
+  long long evicted;     /* idle timeout/풀 가득 참으로 버린 연결 */
+  long long tfo_syn_data; /* 요청이 SYN 에 실려 간 연결 */
+  long long tfo_fallback; /* TFO 를 시도했지만 일반 handshake 가 된 연결 */
+  long long brk_opened;  /* circuit 이 열린 횟수 */
+  long long brk_rejected; /* circuit 이 열려 있어서 바로 거절한 요청 */
+  long long hedge_sent;  /* 보낸 hedge 요청 */
+  long long hedge_won;   /* 그중 원래 요청보다 먼저 응답한 것 */
+  long long preconnect_started; /* 시작한 미리 연결 (요청 줄 기준 + 빈도 예측) */
+  long long preconnect_used;    /* 시작한 요청이 그대로 쓴 것 */
+  long long preconnect_parked;  /* 안 쓰여서 풀로 들어간 것 */
+} pool_stats_t;
+
+void origin_pool_stats(pool_stats_t *st);
+
+/* slot 을 기다려 본 origin 마다 한 줄씩 /stats 형식으로 buf 에 (큐 길이, 대기 시간 분포).
+   쓴 길이 */
+int origin_queue_stats(char *buf, size_t size);
+
+#endif /* __ORIGIN_H__ */
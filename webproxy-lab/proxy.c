@@ -1,20 +1,135 @@
 #include <stdio.h>
 #include "csapp.h"
-
-/* Recommended max cache and object sizes */
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
+#include "conf.h"
+#include "relay.h"
+#include "cache.h"
+#include "tunnel.h"
+#include "origin.h"
+#include "dns.h"
+#include "backend.h"
+#include "h2.h"
+#include "httpparse.h"
 
 /* User-Agent header to send in requests */
 static const char *user_agent_hdr =
     "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
     "Firefox/10.0.3\r\n";
 
+/* 모든 요청에 똑같이 붙는 헤더 꼬리. main에서 한 번만 조립해둔다 */
+static char req_tail_hdr[MAXLINE];
+static size_t req_tail_len;
+
+/* 클라이언트 요청 헤더 중 프록시가 알아야 하는 것들 (hp_str_t 는 request_t.raw 안을 가리킴) */
+typedef struct {
+  char fwd[MAXBUF];   /* origin으로 그대로 넘길 나머지 헤더들 */
+  size_t fwdlen;
+  long long clen;     /* Content-Length (-1이면 없음) */
+  int chunked;        /* Transfer-Encoding: chunked 여부 */
+  int conn_close;     /* Connection(또는 Proxy-Connection): close */
+  int conn_keepalive; /* Connection(또는 Proxy-Connection): keep-alive */
+  int upgrade_h2c;    /* Upgrade: h2c (HTTP/2 로 바꾸자는 요청) */
+  hp_str_t h2_settings; /* HTTP2-Settings 값 */
+  hp_str_t host;      /* Host 값 (origin-form 요청을 h2 스트림으로 넘길 때만 씀) */
+  hp_str_t range;     /* Range 값 (origin에도 fwd로 그대로 넘김) */
+  hp_str_t if_range;  /* If-Range 값 */
+} reqhdrs_t;
+
+/* origin 응답 헤더 중 프록시가 알아야 하는 것들 */
+typedef struct {
+  char buf[MAXBUF];   /* 상태 줄 + 클라이언트로 넘길 헤더 + 빈 줄 */
+  size_t len;
+  int status;
+  long long clen;     /* Content-Length (-1이면 없음) */
+  int chunked;        /* Transfer-Encoding: chunked 여부 */
+  long long total;    /* Content-Range의 전체 길이 (206에서. -1이면 없거나 모름) */
+  int nobody;         /* 204/304 처럼 본문이 없는 응답 */
+  int keepalive;      /* 응답 뒤에도 origin 연결을 재사용할 수 있음 */
+} resphdrs_t;
+
+/* Range 미스 뒤에 객체 전체를 따로 받아 캐시에 채우는 작업 (range_fill_thread) */
+typedef struct {
+  origin_t *origin;
+  char key[MAXLINE];
+  char hostname[NI_MAXHOST];
+  char path[MAXLINE];
+  reqhdrs_t rh;       /* 클라이언트 요청 헤더에서 Range, If-Range를 뺀 것 */
+} rangefill_t;
+
+/* 응답 중계가 origin을 다 읽었을 때 연결을 풀에 돌려주기 위한 상태 */
+typedef struct {
+  upconn_t *uc;
+  int keepalive;
+} upstream_t;
+
+// doit 결과: 응답 뒤에 클라이언트 연결을 어떻게 할지
+#define DOIT_CLOSE  0  /* 닫음 */
+#define DOIT_TUNNEL 1  /* 터널 스레드 소유가 됨 (닫지 않음) */
+#define DOIT_KEEP   2  /* 같은 연결에서 다음 요청을 기다림 (keep-alive) */
+
+// 클라이언트 연결 하나의 응답 순서. pipelining된 요청들을 동시에 처리해도 (캐시 히트는 바로,
+// 미스는 각자 origin에) 클라이언트에는 요청 순서대로 하나씩 씀
+// origin 연결(slot)도 요청 순서대로 잡음: 뒤 요청이 slot을 쥔 채 응답 차례를 기다리는 동안
+// 앞 요청이 slot을 못 받아 서로 기다리는 일이 없도록
+typedef struct {
+  int fd;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int next_out;  /* 다음에 응답을 쓸 요청 번호 */
+  int next_up;   /* 다음에 origin 연결을 잡을 요청 번호 */
+  int closing;   /* 앞 응답이 연결을 닫기로 함: 뒤 요청들은 응답을 쓰지 않음 */
+} client_t;
+
+// 헤더까지 읽은 요청 하나. pipelining이면 워커 스레드로 넘어감
+typedef struct {
+  client_t *cl;
+  rio_t *rp;         /* 본문은 이 스레드(연결 스레드)에서만 읽음 */
+  int nreq;          /* 연결 안에서 몇 번째 요청인지 (1부터) */
+  int keepalive;     /* 클라이언트가 이 요청 뒤에도 연결을 유지하려 함 */
+  char raw[RIO_BUFSIZE]; /* 요청 줄과 헤더. rio 버퍼에서 파싱한 뒤 한 번에 복사 (pipelining이면
+                            rio 버퍼는 다음 요청이 덮어씀). hp 조각과 아래 문자열은 여기를 가리킴 */
+  hp_msg_t hp;       /* 파싱 결과 */
+  char *method, *uri, *version; /* raw 안의 요청 줄 (조각 끝을 NUL로 끊음) */
+  char *path;        /* URI의 path: uri의 꼬리라서 따로 끊지 않아도 됨 */
+  char hostname[NI_MAXHOST], port[NI_MAXSERV]; /* URI의 host, port (backend로 바꿔 쓰므로 복사) */
+  char key[MAXLINE]; /* 캐시 키 */
+  reqhdrs_t rh;
+  cache_obj_t *obj;  /* 헤더를 읽기 전에 찾은 캐시 객체 */
+  preconn_t *pre;    /* 헤더를 읽기 전에 시작한 origin 연결 */
+  int h2c;           /* HTTP/2 연결 서문 ("PRI * HTTP/2.0"): 헤더는 읽지 않았음 */
+} request_t;
+
 // 함수 선언부
-void doit(int fd);
-void read_requesthdrs(rio_t *rp);
-void parse_uri(char *uri, char *hostname, char *path, int *port);
+int read_request(client_t *cl, rio_t *rp, int nreq, request_t *rq);
+int doit(request_t *rq);
+void *pipeline_thread(void *vargp);
+int pipelinable(request_t *rq);
+int more_input(rio_t *rp);
+void client_init(client_t *cl, int fd);
+void client_wait(client_t *cl, int nreq);
+int client_closing(client_t *cl);
+void client_up_wait(client_t *cl, int nreq);
+void client_up_done(client_t *cl, int nreq);
+int client_turn(client_t *cl, int nreq);
+void client_done(client_t *cl, int nreq, int rc);
+int method_supported(char *method);
+int request_target(request_t *rq);
+char *raw_str(request_t *rq, hp_str_t s);
+void do_connect(int fd, rio_t *rp, char *hostname, char *port);
+int scan_requesthdrs(hp_msg_t *hp, reqhdrs_t *rh);
+int forward_body(rio_t *rp, int serverfd, reqhdrs_t *rh);
+int read_responsehdrs(rio_t *rp, resphdrs_t *rs, int head);
+int send_head(int fd, const char *hdrs, size_t len, const char *body, size_t bodylen, int keepalive);
+int has_clen(const char *hdrs, size_t len);
+int send_range(int fd, cache_obj_t *obj, reqhdrs_t *rh, int keepalive);
+void range_fill(origin_t *origin, char *key, char *hostname, char *path, reqhdrs_t *rh);
+void *range_fill_thread(void *vargp);
+void build_request(hdr_t *hp, char *method, char *path, char *version, char *hostname, reqhdrs_t *rh);
+upconn_t *hedge(origin_t *origin, upconn_t *uc, int delay, hdr_t *req);
+void upstream_done(void *arg, int ok);
+void serve_stats(int fd);
+void sock_timeout(int fd, int opt, int ms);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg);
+void serve_h2c(int fd, rio_t *rp, request_t *rq);
 void *thread(void *vargp);
 
 int main(int argc, char **argv)
@@ -23,14 +138,44 @@ int main(int argc, char **argv)
   char hostname[MAXLINE], port[MAXLINE]; // 클라이언트 호스트명과 포트 저장
   socklen_t clientlen;
   struct sockaddr_storage clientaddr; // 클라이언트 주소 정보 저장 구조체
+  int opt; // getopt 결과
+
+  // -o key=value 설정 옵션 처리 (conf.h 참고)
+  while ((opt = getopt(argc, argv, "o:")) != -1) {
+    if (opt != 'o' || conf_set(optarg) < 0) {
+      fprintf(stderr, "usage: %s [-o key=value]... <port>\n", argv[0]);
+      conf_usage(stderr);
+      exit(1);
+    }
+  }
 
   // 포트번호 인자 체크
-  if (argc != 2) {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+  if (argc - optind != 1) {
+    fprintf(stderr, "usage: %s [-o key=value]... <port>\n", argv[0]);
     exit(1);
   }
 
-  listenfd = Open_listenfd(argv[1]); // 서버 listen 소켓 열기
+  // 클라이언트가 먼저 끊어도 SIGPIPE로 프록시 전체가 죽지 않도록 무시
+  Signal(SIGPIPE, SIG_IGN);
+
+  // 고정 요청 헤더 템플릿 조립 (요청마다 strcat 하지 않도록)
+  req_tail_len = snprintf(req_tail_hdr, sizeof(req_tail_hdr), "%s%s",
+                          user_agent_hdr,
+                          "Connection: keep-alive\r\n"
+                          "\r\n");
+
+  cache_init(); // 웹 객체 캐시 초기화
+  tunnel_init(); // CONNECT 터널 스레드 시작
+  dns_init(); // 이름 해석 스레드 시작
+  h2_init(thread); // h2 스트림은 socketpair 를 거쳐 이 연결 처리 함수가 처리
+  if (backend_init() < 0) { // 리버스 프록시 모드 backend 풀
+    fprintf(stderr, "bad backends/backend_policy setting\n");
+    exit(1);
+  }
+
+  // 서버 listen 소켓 열기 (설정에 따라 TCP Fast Open 허용)
+  if ((listenfd = open_listenfd_flags(argv[optind], conf.tfo_listen ? OPEN_TFO : 0)) < 0)
+    unix_error("Open_listenfd error");
 
   while (1) {
     clientlen = sizeof(clientaddr);  // 클라이언트 주소 구조체 크기 설정
@@ -54,172 +199,1086 @@ int main(int argc, char **argv)
 
 void *thread(void *vargp) {
   int connfd = *((int *)vargp); // 전달받은 인자를 정수형 포인터로 변환하여 클라이언트 소켓 파일 디스크립터(connfd) 추출
+  rio_t rio; // 클라이언트 RIO 버퍼: 파이프라인된 다음 요청이 미리 읽혀 있을 수 있으므로 연결과 수명을 같이 함
+  client_t cl; // 응답 순서
+  request_t *rq;
+  pthread_t tid;
+  int nreq, rc = DOIT_KEEP;
   Pthread_detach(pthread_self()); // 현재 스레드를 분리(detach) 상태로 설정 → 스레드 종료 시 자원 자동 회수 (join 불필요, 메모리 누수 방지)
   Free(vargp);  // heap에서 할당한 인자 메모리 해제 (connfd 저장한 메모리)
-  doit(connfd); // 클라이언트 요청 처리 함수 호출
-  Close(connfd);  // 클라이언트 소켓 닫기
+
+  // keep-alive: 요청을 이만큼 기다려도 안 오면(또는 요청 중간에 멈추면) 연결을 닫음
+  Rio_readinitb(&rio, connfd);
+  sock_timeout(connfd, SO_RCVTIMEO, conf.client_idle_timeout_ms);
+  client_init(&cl, connfd);
+  for (nreq = 1; rc == DOIT_KEEP && !client_closing(&cl); nreq++) {
+    rq = Malloc(sizeof(request_t));
+    if (read_request(&cl, &rio, nreq, rq) < 0) {
+      Free(rq);
+      rc = DOIT_CLOSE;
+      break;
+    }
+    rc = rq->keepalive ? DOIT_KEEP : DOIT_CLOSE;
+
+    // 첫 요청이 HTTP/2 서문이거나 Upgrade: h2c 면 이 연결의 나머지는 HTTP/2 로
+    if (nreq == 1 && conf.h2c && (rq->h2c || (rq->rh.upgrade_h2c && pipelinable(rq)))) {
+      serve_h2c(connfd, &rio, rq);
+      Free(rq);
+      rc = DOIT_CLOSE;
+      break;
+    }
+
+    // 다음 요청이 벌써 와 있으면(pipelining) 본문 없는 GET은 워커 스레드에 맡기고 바로 다음 요청을 읽음
+    // 동시에 처리하는 요청은 client_pipeline_depth 개까지. 응답 순서는 client_t가 지킴
+    if (conf.client_pipeline_depth > 1 && pipelinable(rq) && more_input(&rio)) {
+      client_wait(&cl, nreq - conf.client_pipeline_depth + 1);
+      Pthread_create(&tid, NULL, pipeline_thread, rq);
+      continue;
+    }
+
+    // 나머지는 이 스레드에서 처리. 본문이 있거나 부수효과가 있을 수 있는 요청은 앞 요청이 다 끝난 뒤에 보냄
+    if (!pipelinable(rq))
+      client_wait(&cl, nreq);
+    rc = doit(rq); // 클라이언트 요청 처리 함수 호출
+    client_done(&cl, nreq, rc);
+    Free(rq);
+  }
+  client_wait(&cl, nreq); // 워커 스레드의 응답까지 다 나간 뒤에 닫음
+  if (rc != DOIT_TUNNEL)
+    Close(connfd);  // 클라이언트 소켓 닫기 (터널로 넘어간 소켓은 터널 스레드가 닫음)
   return NULL;  // 스레드 종료 (반환값 없음)
 }
 
-// 클라이언트 요청을 처리하는 함수
-void doit(int fd)
+// 클라이언트 연결의 nreq번째 요청 줄과 헤더를 읽어 rq에 채움
+// rio 버퍼 안에서 그대로 파싱하고, 헤더 블록이 덜 왔으면 버퍼를 더 채워서 이어서 파싱
+// 요청 줄이 끝나는 대로 캐시를 찾아보고, 없으면 origin 연결(이름 해석 포함)을 미리 시작
+// 성공 0, 클라이언트가 닫았거나 idle timeout이 지났거나 요청이 이상하면(400/431을 보내고) -1
+int read_request(client_t *cl, rio_t *rp, int nreq, request_t *rq)
 {
-  // 클라이언트로부터 받은 요청과 서버로 전송할 요청 및 응답을 저장할 버퍼들
-  char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE]; 
-  rio_t rio; // Robust I/O 버퍼 (클라이언트용)
-  char hostname[MAXLINE], path[MAXLINE], port[MAXLINE]; // URI 파싱 결과
-  int serverfd; // 서버와의 연결 소켓
-  rio_t server_rio; // Robust I/O 버퍼 (서버용)
-  char request_hdr[MAXLINE]; // 서버에 보낼 요청 헤더
-  size_t n; // 읽은 바이트 수
+  hp_msg_t *hp = &rq->hp;
+  int n, started = 0;
 
-  // 클라이언트 소켓을 위한 RIO 버퍼 초기화
-  Rio_readinitb(&rio, fd);
+  rq->cl = cl;
+  rq->rp = rp;
+  rq->nreq = nreq;
+  rq->obj = NULL;
+  rq->pre = NULL;
+  rq->h2c = 0;
 
-  // 요청의 첫 번째 라인 (예: "GET http://host/path HTTP/1.1") 읽기
-  Rio_readlineb(&rio, buf, MAXLINE);
+  hp_init(hp);
+  while (1) {
+    n = hp_parse_request(hp, rp->rio_bufptr, rp->rio_cnt);
+    if (!started && hp->version.len > 0 && n != HP_ERROR) {
+      started = 1;
+      if (request_target(rq) < 0)
+        n = HP_ERROR;
+    }
+    if (n != HP_AGAIN)
+      break;
+    // 클라이언트가 닫았거나 idle timeout이 지났으면 조용히 닫음. 헤더가 rio 버퍼보다 크면 431
+    if (rio_fillb(rp) <= 0) {
+      n = errno == ENOBUFS && rp->rio_cnt == RIO_BUFSIZE ? HP_TOOMANY : 0;
+      break;
+    }
+  }
+  if (n <= 0) {
+    if (n == HP_ERROR)
+      clienterror(client_turn(cl, nreq), "request", "400", "Bad Request", "Proxy could not parse the request");
+    else if (n == HP_TOOMANY)
+      clienterror(client_turn(cl, nreq), "request", "431", "Request Header Fields Too Large", "Proxy could not take this many headers");
+    origin_preconnect_cancel(rq->pre);
+    if (rq->obj)
+      cache_release(rq->obj);
+    return -1;
+  }
+
+  // 헤더 블록을 rq로 옮기고 요청 줄은 C 문자열로 끊음
+  memcpy(rq->raw, rp->rio_bufptr, n);
+  hp_rebase(hp, rq->raw);
+  rp->rio_bufptr += n;
+  rp->rio_cnt -= n;
+  rq->method = raw_str(rq, hp->method);
+  rq->uri = raw_str(rq, hp->uri);
+  rq->version = raw_str(rq, hp->version);
+  rq->path = hp->path.len ? rq->raw + (hp->path.p - rq->raw) : "/";
 
-  // 요청 라인을 파싱해서 메서드(GET 등), URI, HTTP 버전 추출
-  sscanf(buf, "%s %s %s", method, uri, version);
+  // HTTP/2 prior knowledge: 서문의 앞부분("PRI * HTTP/2.0\r\n\r\n")은 헤더 없는 요청으로 읽힘
+  if (conf.h2c && nreq == 1 && !strcmp(rq->method, "PRI") && !strcmp(rq->uri, "*") &&
+      !strcmp(rq->version, "HTTP/2.0") && hp->nhdr == 0) {
+    rq->h2c = 1;
+    rq->keepalive = 0;
+    return 0;
+  }
 
-  // 나머지 요청 헤더는 무시 (필수 헤더는 우리가 따로 추가함)
-  read_requesthdrs(&rio);
+  // 나머지 요청 헤더: Host 등 우리가 다시 만드는 것은 버리고, 나머지는 전달용으로 모음
+  if (scan_requesthdrs(hp, &rq->rh) < 0) {
+    clienterror(client_turn(cl, nreq), rq->method, "400", "Bad Request", "Proxy could not parse the request headers");
+    origin_preconnect_cancel(rq->pre);
+    if (rq->obj)
+      cache_release(rq->obj);
+    return -1;
+  }
 
   // 요청 정보 출력 (디버깅용)
-  printf("Parsed request: %s %s %s\n", method, uri, version);
+  printf("Parsed request: %s %s %s\n", rq->method, rq->uri, rq->version);
 
-  // GET 메서드만 지원하며, 다른 메서드는 에러 응답
-  if (strcasecmp(method, "GET")) {
-    clienterror(fd, method, "501", "Not Implemented", "Proxy does not implement this method");
-    return;
+  // 클라이언트 keep-alive: HTTP/1.1은 close라고 하지 않는 한, 1.0은 keep-alive라고 했을 때만
+  // 연결당 요청 수 상한에 닿으면 이번 응답에 Connection: close를 붙이고 닫음
+  rq->keepalive = !rq->rh.conn_close &&
+                  (rq->rh.conn_keepalive || !strcasecmp(rq->version, "HTTP/1.1")) &&
+                  nreq < conf.client_max_requests;
+  return 0;
+}
+
+// 요청 줄을 읽은 직후 (헤더는 아직 오는 중일 수 있음, 조각은 rio 버퍼 안): 목적지와 캐시 키를 정하고
+// 캐시에 없으면 origin 연결을 미리 시작. host/port가 너무 길면 -1
+int request_target(request_t *rq)
+{
+  hp_msg_t *hp = &rq->hp;
+  hp_str_t path = hp->path;
+
+  if (!path.len)
+    path.p = "/", path.len = 1;
+
+  // 리버스 프록시 모드의 origin-form 요청(GET /path)은 backend 풀 전체가 하나의 origin
+  // 캐시는 풀 앞에 있으므로 키는 "backends/path", 어느 backend로 갈지는 미스일 때 정함
+  if (backend_enabled() && hp->uri.p[0] == '/') {
+    snprintf(rq->key, sizeof(rq->key), "backends%.*s", (int)path.len, path.p);
+    return 0;
+  }
+
+  // URI의 host, port (기본 포트는 80, CONNECT는 443)
+  if (hp->host.len >= sizeof(rq->hostname) || hp->port.len >= sizeof(rq->port))
+    return -1;
+  memcpy(rq->hostname, hp->host.p, hp->host.len);
+  rq->hostname[hp->host.len] = '\0';
+  if (hp->port.len) {
+    memcpy(rq->port, hp->port.p, hp->port.len);
+    rq->port[hp->port.len] = '\0';
+  } else {
+    strcpy(rq->port, hp_eq(hp->method, "CONNECT") ? "443" : "80");
   }
+  if (hp_eq(hp->method, "CONNECT"))
+    return 0;
+  printf("Parsed URI → host: %s, path: %.*s, port: %s\n", rq->hostname, (int)path.len, path.p, rq->port);
 
-  // URI에서 hostname, path, port 추출
-  parse_uri(uri, hostname, path, port);
-  printf("Parsed URI → host: %s, path: %s, port: %s\n", hostname, path, port);
+  // 캐시 키는 "host:port/path"
+  snprintf(rq->key, sizeof(rq->key), "%s:%s%.*s", rq->hostname, rq->port, (int)path.len, path.p);
 
-  // 서버와 연결 시도 (실패 시 에러 처리)
-  serverfd = Open_clientfd(hostname, port);
-  if (serverfd < 0) {
-    clienterror(fd, hostname, "502", "Bad Gateway", "Proxy failed to connect to end server");
-    Close(fd);
-    return;
+  // 캐시에 없으면 나머지 헤더를 읽는 동안 origin 연결(이름 해석 포함)을 미리 시작
+  if (hp->uri.p[0] != '/' && (hp_eq(hp->method, "GET") || hp_eq(hp->method, "HEAD") ||
+                              hp_eq(hp->method, "POST") || hp_eq(hp->method, "PUT") ||
+                              hp_eq(hp->method, "PATCH") || hp_eq(hp->method, "DELETE"))) {
+    if (hp_eq(hp->method, "GET") || hp_eq(hp->method, "HEAD"))
+      rq->obj = cache_lookup(rq->key);
+    if (!rq->obj)
+      rq->pre = origin_preconnect(origin_get(rq->hostname, rq->port));
   }
+  return 0;
+}
 
-  // 서버 소켓을 위한 RIO 버퍼 초기화
-  Rio_readinitb(&server_rio, serverfd);
+// raw 안의 조각을 NUL로 끊어 C 문자열로 (요청 줄의 조각 바로 뒤는 공백이나 줄바꿈이라 덮어써도 됨)
+char *raw_str(request_t *rq, hp_str_t s)
+{
+  char *p = rq->raw + (s.p - rq->raw);
 
-  // 서버에 보낼 HTTP 요청 헤더 구성 시작
-  request_hdr[0] = '\0'; // 문자열 초기화
+  p[s.len] = '\0';
+  return p;
+}
 
-  // 요청 라인: GET {path} HTTP/1.0
-  sprintf(buf, "GET %s HTTP/1.0\r\n", path);
-  strcat(request_hdr, buf);
+// 헤더까지 읽은 요청 하나를 처리하는 함수. 연결을 어떻게 할지(DOIT_*)를 돌려줌
+// 클라이언트에 쓰기 직전에 client_turn으로 앞 요청들의 응답이 다 나가기를 기다림
+int doit(request_t *rq)
+{
+  client_t *cl = rq->cl;
+  rio_t *rp = rq->rp;
+  int nreq = rq->nreq;
+  char *method = rq->method, *uri = rq->uri, *version = rq->version;
+  char *hostname = rq->hostname, *path = rq->path, *port = rq->port;
+  char *key = rq->key; // 캐시 키
+  reqhdrs_t *rh = &rq->rh; // 클라이언트 요청 헤더 요약
+  cache_obj_t *obj = rq->obj; // 캐시 히트 객체
+  preconn_t *pre = rq->pre; // 헤더를 읽기 전에 시작한 origin 연결
+  origin_t *origin; // origin별 상태 (연결 풀, circuit breaker)
+  backend_t *be = NULL, *next; // 리버스 프록시 모드에서 고른 backend
+  upconn_t *uc; // origin 연결 (풀에서 꺼냈거나 새로 연결)
+  upstream_t up; // 응답을 다 읽은 뒤 연결 반납용
+  resphdrs_t rs; // origin 응답 헤더 요약
+  hdr_t hdr; // 서버에 보낼 요청 헤더 (iovec 조각 모음)
+  relay_t rel; // 응답 중계 상태
+  cache_fill_t fill; // 캐시 채우기 상태
+  int fd; // 클라이언트 소켓 (응답 차례가 된 뒤에 받음)
+  int cacheable; // 캐시 대상 여부 (본문 없는 GET, HEAD만)
+  int head; // HEAD 요청: 응답 본문 없음
+  int keepalive = rq->keepalive; // 응답 뒤에 클라이언트 연결을 유지할지
+  int rc; // 중계 결과
+  int has_body; // 요청 본문 여부 (본문이 있으면 재전송할 수 없음)
+  int attempt; // 전송 시도 횟수
+  int stale; // 재사용한 연결이 이미 끊겨 있었음
+  int delay; // hedge 요청을 보내기 전까지 기다릴 시간 (ms)
+  long long started; // origin에 요청을 시작한 시각 (첫 바이트 지연 측정용)
 
-  // Host 헤더
-  sprintf(buf, "Host: %s\r\n", hostname);
-  strcat(request_hdr, buf);
+  // 프록시 자신에게 온 요청 (origin-form): 내부 카운터 조회. 리버스 프록시 모드에서는 origin-form이
+  // 실제 요청이므로 stats_path로 켰을 때만, 그 경로만 가로챔
+  if (conf.stats_path && *conf.stats_path && !strcasecmp(method, "GET") && !strcmp(uri, conf.stats_path)) {
+    serve_stats(client_turn(cl, nreq));
+    return DOIT_CLOSE;
+  }
 
-  // User-Agent 헤더 (지정된 고정 값)
-  strcat(request_hdr, user_agent_hdr);
+  // CONNECT: origin과 연결한 뒤 양방향 중계는 터널 스레드에 맡김
+  if (!strcasecmp(method, "CONNECT")) {
+    if ((fd = client_turn(cl, nreq)) < 0)
+      return DOIT_CLOSE;
+    do_connect(fd, rp, hostname, port);
+    return DOIT_TUNNEL;
+  }
 
-  // 연결 종료 명시
-  strcat(request_hdr, "Connection: close\r\n");
-  strcat(request_hdr, "Proxy-Connection: close\r\n");
+  // 본문이 없는 GET, HEAD와 본문을 가질 수 있는 메서드(POST, PUT, PATCH, DELETE)를 지원
+  if (!method_supported(method)) {
+    clienterror(client_turn(cl, nreq), method, "501", "Not Implemented", "Proxy does not implement this method");
+    return DOIT_CLOSE;
+  }
+  head = !strcasecmp(method, "HEAD");
+  cacheable = (!strcasecmp(method, "GET") || head) && !rh->chunked && rh->clen <= 0;
 
-  // 헤더 종료를 알리는 빈 줄
-  strcat(request_hdr, "\r\n");
+  // 캐시 히트면 origin에 가지 않고 바로 응답 (본문이 붙은 GET은 캐시 대상 아님)
+  // HEAD는 같은 URI의 GET 객체에서 헤더만 보냄 (GET 객체가 없으면 origin에 HEAD를 그대로 보냄)
+  if (cacheable && !obj)
+    obj = cache_lookup(key);
+  // Range 요청이면 캐시된 본문에서 구간만 잘라 206 (따를 수 없는 Range면 전체)
+  if (obj && cacheable) {
+    printf("Cache hit: %s (%zu bytes)\n", obj->key, obj->size);
+    origin_preconnect_cancel(pre);
+    fd = client_turn(cl, nreq);
+    if (head)
+      rc = send_head(fd, obj->data, obj->hdrlen, NULL, 0, keepalive);
+    else
+      rc = rh->range.len ? send_range(fd, obj, rh, keepalive) : 1;
+    if (rc > 0) {
+      keepalive = keepalive && has_clen(obj->data, obj->hdrlen);
+      rc = send_head(fd, obj->data, obj->hdrlen, obj->data + obj->hdrlen, obj->size - obj->hdrlen,
+                     keepalive);
+    }
+    if (rc < 0)
+      keepalive = 0;
+    cache_release(obj);
+    return keepalive ? DOIT_KEEP : DOIT_CLOSE;
+  }
+  if (obj)
+    cache_release(obj);
 
-  // 생성된 헤더 출력 (디버깅용)
-  printf("Request header built:\n%s", request_hdr);
+  // 최근에 계속 실패한 origin이면(circuit open) 연결을 시도하지 않고 바로 503
+  if (uri[0] == '/' && backend_enabled()) {
+    be = backend_pick();
+    strcpy(hostname, be->host);
+    strcpy(port, be->port);
+    origin = be->origin;
+  } else {
+    origin = origin_get(hostname, port);
+  }
+  if (!origin_admit(origin)) {
+    origin_preconnect_cancel(pre);
+    clienterror(client_turn(cl, nreq), hostname, "503", "Service Unavailable", "End server is failing; not trying it for now");
+    return DOIT_CLOSE;
+  }
+  started = msec_now();
 
-  // 서버에 요청 전송
-  Rio_writen(serverfd, request_hdr, strlen(request_hdr));
+  // origin 연결: 풀에 놀고 있는 keep-alive 연결이 있으면 재사용
+  // 재사용한 연결은 origin이 그새 닫았을 수 있으므로, 응답 첫 바이트도 못 받고 끊기면
+  // 새 연결로 한 번만 다시 보냄. 본문이 있는 요청은 재전송할 수 없으니 처음부터 새 연결
+  has_body = rh->chunked || rh->clen > 0;
+  for (attempt = 0; ; attempt++) {
+    client_up_wait(cl, nreq);  // pipelining: origin 연결은 요청 순서대로 잡음 (client_t 참고)
+    uc = origin_checkout_pre(origin, !has_body && attempt == 0 ? CHECKOUT_POOLED : 0, pre);
+    client_up_done(cl, nreq);
+    pre = NULL;
+    if (uc == NULL && errno == EBUSY) {
+      // origin이 받을 수 있는 만큼 이미 나가 있고 큐도 찼거나 너무 오래 기다림
+      origin_result(origin, -1, -1);
+      clienterror(client_turn(cl, nreq), hostname, "503", "Service Unavailable", "Too many requests to end server");
+      return DOIT_CLOSE;
+    }
+    if (be)
+      backend_result(be, uc != NULL);
+    if (uc == NULL) {
+      origin_result(origin, 0, -1);
+      // 요청은 아직 한 바이트도 안 보냈으니 다른 backend로 한 번 더 시도
+      if (be && attempt == 0 && (next = backend_pick()) != be && origin_admit(next->origin)) {
+        printf("Backend %s:%s unreachable, trying %s:%s\n", hostname, port, next->host, next->port);
+        be = next;
+        strcpy(hostname, be->host);
+        strcpy(port, be->port);
+        origin = be->origin;
+        continue;
+      }
+      if (errno == ETIMEDOUT)
+        clienterror(client_turn(cl, nreq), hostname, "504", "Gateway Timeout", "Proxy timed out connecting to end server");
+      else
+        clienterror(client_turn(cl, nreq), hostname, "502", "Bad Gateway", "Proxy failed to connect to end server");
+      return DOIT_CLOSE;
+    }
+
+    // 요청 전송 (writev 한 번) → 본문 스트리밍 → 응답 헤더 읽기
+    // origin이 멈춰도 스레드가 영원히 묶이지 않도록 소켓에 쓰기/첫 바이트 타임아웃을 걸어둠
+    build_request(&hdr, method, path, version, hostname, rh);
+    sock_timeout(uc->fd, SO_SNDTIMEO, conf.upstream_idle_timeout_ms);
+    sock_timeout(uc->fd, SO_RCVTIMEO, conf.upstream_first_byte_timeout_ms);
+    if (hdr_writev(uc->fd, &hdr) < 0)
+      rc = errno == EAGAIN || errno == EWOULDBLOCK ? -3 : -2;
+    else if (forward_body(rp, uc->fd, rh) < 0)
+      rc = errno == EAGAIN || errno == EWOULDBLOCK ? -3 : -1;  // origin이 본문을 받지 않아 쓰기 타임아웃
+    else {
+      // 캐시 가능한 GET(과 HEAD)은 몇 번 보내도 같으므로, 평소보다 느리면 다른 연결로 한 번 더 보냄
+      if (cacheable && attempt == 0 && (delay = origin_hedge_delay(origin)) >= 0) {
+        build_request(&hdr, method, path, version, hostname, rh);
+        uc = hedge(origin, uc, delay, &hdr);
+      }
+      rc = read_responsehdrs(&uc->rio, &rs, head);
+    }
+    if (rc == 0) {
+      origin_note_tfo(uc);
+      // 게이트웨이 계열 5xx는 origin 장애로 봄
+      origin_result(origin, rs.status < 502 || rs.status > 504, msec_now() - started);
+      break;
+    }
+
+    stale = rc == -2 && uc->reused;
+    origin_discard(uc);
+    if (stale && attempt == 0) {
+      printf("Stale pooled connection to %s:%s, retrying\n", hostname, port);
+      continue;
+    }
+    printf("Failed to forward request to %s:%s\n", hostname, port);
+    origin_result(origin, 0, -1);
+    if (rc == -3)
+      clienterror(client_turn(cl, nreq), hostname, "504", "Gateway Timeout", "End server did not respond in time");
+    else
+      clienterror(client_turn(cl, nreq), hostname, "502", "Bad Gateway", "Proxy got no valid response from end server");
+    return DOIT_CLOSE;
+  }
+
+  // HEAD 응답은 본문이 없으므로 캐시에 넣지 않음 (HEAD 히트는 GET 객체로만)
+  if (head)
+    cacheable = 0;
+
+  // Range 미스에 origin이 206으로 답했으면 클라이언트에는 그대로 중계하고, 객체 전체는 따로 받아
+  // 캐시에 채움 (다음 Range 요청부터는 캐시에서 자름). 전체가 캐시에 안 들어갈 크기면 받지 않음
+  if (cacheable && rh->range.len && rs.status == 206 && rs.total >= 0 && rs.total < MAX_OBJECT_SIZE)
+    range_fill(origin, key, hostname, path, rh);
+
+  // 응답 헤더를 먼저 보냄. 캐시에도 클라이언트에 보낸 헤더(Connection 계열 제외) 그대로 저장
+  if (rs.chunked)
+    cacheable = 0;  // chunked 응답은 캐시하지 않음
+  if (cacheable) {
+    cache_fill_init(&fill, key);
+    cache_fill_tap(&fill, rs.buf, rs.len);
+  }
+  // 클라이언트가 응답 끝을 알 수 있어야(길이/chunked/본문 없음) 연결을 유지할 수 있음
+  keepalive = keepalive && (rs.nobody || rs.chunked || rs.clen >= 0);
+  fd = client_turn(cl, nreq);
+  if (send_head(fd, rs.buf, rs.len, NULL, 0, keepalive) < 0) {
+    if (cacheable)
+      cache_fill_finish(&fill, 0);
+    origin_discard(uc);
+    return DOIT_CLOSE;
+  }
 
-  // 서버로부터 응답을 읽어 클라이언트에게 전달
-  while ((n = Rio_readlineb(&server_rio, buf, MAXLINE)) > 0) {
-    Rio_writen(fd, buf, n);
+  // 본문은 프레이밍(Content-Length / chunked / 본문 없음 / EOF)에 맞춰 정확히 응답 끝까지만 읽음
+  // 느린 클라이언트 때문에 스레드가 묶이지 않도록 bounded 버퍼 + watermark로 중계
+  // origin을 다 읽는 순간 연결을 풀에 돌려주므로, 클라이언트 전송이 끝날 때까지 잡고 있지 않음
+  relay_init(&rel, uc->fd, &uc->rio, fd);
+  rel.src_timeout_ms = conf.upstream_idle_timeout_ms;
+  if (rs.nobody)
+    rel.limit = 0;
+  else if (rs.chunked)
+    rel.chunked = 1;
+  else
+    rel.limit = rs.clen;
+  up.uc = uc;
+  up.keepalive = rs.keepalive;
+  rel.src_done = upstream_done;
+  rel.done_arg = &up;
+  if (cacheable) {
+    rel.tap = cache_fill_tap;
+    rel.tap_arg = &fill;
   }
+  rc = relay(&rel);
+  if (cacheable)
+    cache_fill_finish(&fill, rc == RELAY_OK);
+  if (rc != RELAY_OK)
+    printf("Relay ended early (%d): %lld/%lld bytes, %d pauses, %lld spilled\n",
+           rc, rel.nwritten, rel.nread, rel.npauses, rel.nspilled);
+  return keepalive && rc == RELAY_OK ? DOIT_KEEP : DOIT_CLOSE;
+}
+
+// pipelining된 요청 하나를 처리하는 워커 스레드
+void *pipeline_thread(void *vargp)
+{
+  request_t *rq = vargp;
 
-  // 서버 연결 종료
-  Close(serverfd);
+  Pthread_detach(pthread_self());
+  client_done(rq->cl, rq->nreq, doit(rq));
+  Free(rq);
+  return NULL;
 }
 
-// 클라이언트에게 오류 응답을 보냄
-void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
+// 다른 요청과 동시에 처리해도 되는 요청: 본문 없는 GET, HEAD (클라이언트 본문을 읽지 않고, 부수효과 없음)
+int pipelinable(request_t *rq)
+{
+  return (!strcasecmp(rq->method, "GET") || !strcasecmp(rq->method, "HEAD")) &&
+         !rq->rh.chunked && rq->rh.clen <= 0;
+}
+
+// 클라이언트가 다음 요청을 벌써 보냈는지 (RIO 버퍼에 남아 있거나 소켓에 와 있음)
+int more_input(rio_t *rp)
+{
+  struct pollfd pfd;
+
+  pfd.fd = rp->rio_fd;
+  pfd.events = POLLIN;
+  return rp->rio_cnt > 0 || poll(&pfd, 1, 0) > 0;
+}
+
+void client_init(client_t *cl, int fd)
+{
+  cl->fd = fd;
+  pthread_mutex_init(&cl->mutex, NULL);
+  pthread_cond_init(&cl->cond, NULL);
+  cl->next_out = cl->next_up = 1;
+  cl->closing = 0;
+}
+
+// nreq번보다 앞의 요청들이 모두 끝날 때까지 기다림
+void client_wait(client_t *cl, int nreq)
+{
+  pthread_mutex_lock(&cl->mutex);
+  while (cl->next_out < nreq)
+    pthread_cond_wait(&cl->cond, &cl->mutex);
+  pthread_mutex_unlock(&cl->mutex);
+}
+
+// 앞 응답이 연결을 닫기로 했으면 1 (더 읽지 않음)
+int client_closing(client_t *cl)
+{
+  int closing;
+
+  pthread_mutex_lock(&cl->mutex);
+  closing = cl->closing;
+  pthread_mutex_unlock(&cl->mutex);
+  return closing;
+}
+
+// 앞 요청들이 모두 origin 연결을 잡았거나(또는 필요 없어졌거나) 끝날 때까지 기다림
+void client_up_wait(client_t *cl, int nreq)
 {
-  char buf[MAXLINE], body[MAXBUF];
+  pthread_mutex_lock(&cl->mutex);
+  while (cl->next_up < nreq)
+    pthread_cond_wait(&cl->cond, &cl->mutex);
+  pthread_mutex_unlock(&cl->mutex);
+}
+
+// nreq번 요청은 더 이상 origin 연결을 기다리지 않음: 다음 요청이 잡을 차례
+void client_up_done(client_t *cl, int nreq)
+{
+  pthread_mutex_lock(&cl->mutex);
+  while (cl->next_up < nreq)
+    pthread_cond_wait(&cl->cond, &cl->mutex);
+  if (cl->next_up == nreq) {
+    cl->next_up++;
+    pthread_cond_broadcast(&cl->cond);
+  }
+  pthread_mutex_unlock(&cl->mutex);
+}
 
-  sprintf(body, "<html><title>Tiny Error</title>");
-  sprintf(body, "%s<body bgcolor=\"ffffff\">\r\n", body);
-  sprintf(body, "%s%s : %s\r\n", body, errnum, shortmsg);
-  sprintf(body, "%s<p>%s : %s\r\n", body, longmsg, cause);
-  sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body);
+// nreq번 요청이 응답을 쓸 차례(앞 응답이 다 나감)를 기다려 클라이언트 fd를 돌려줌
+// 앞 응답이 연결을 닫기로 했으면 -1: 쓰기가 실패하므로 클라이언트가 떠난 것처럼 정리됨
+int client_turn(client_t *cl, int nreq)
+{
+  int fd;
 
-  sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
-  Rio_writen(fd, buf, strlen(buf));
-  sprintf(buf, "Content-type: text/html\r\n");
-  Rio_writen(fd, buf, strlen(buf));
-  sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body));
-  Rio_writen(fd, buf, strlen(buf));
-  Rio_writen(fd, body, strlen(body));
+  client_up_done(cl, nreq);  // 캐시 히트나 오류처럼 origin 연결 없이 응답하는 경우
+  pthread_mutex_lock(&cl->mutex);
+  while (cl->next_out < nreq)
+    pthread_cond_wait(&cl->cond, &cl->mutex);
+  fd = cl->closing ? -1 : cl->fd;
+  pthread_mutex_unlock(&cl->mutex);
+  return fd;
 }
 
-// URI에서 hostname, path, port를 파싱하는 함수
-void parse_uri(char *uri, char *hostname, char *path, int *port)
+// nreq번 요청의 응답이 끝남 (rc: doit 결과). 다음 요청이 응답을 쓸 차례
+void client_done(client_t *cl, int nreq, int rc)
 {
-  char *hostbegin, *hostend, *pathbegin, *portbegin;
+  client_turn(cl, nreq);
+  pthread_mutex_lock(&cl->mutex);
+  if (rc != DOIT_KEEP)
+    cl->closing = 1;
+  cl->next_out++;
+  pthread_cond_broadcast(&cl->cond);
+  pthread_mutex_unlock(&cl->mutex);
+}
 
-  // URI가 "http://"로 시작하는 경우 이를 건너뛰고 host 정보 시작 위치 지정
-  if (strncasecmp(uri, "http://", 7) == 0)
-    hostbegin = uri + 7;
+// 프록시가 처리하는 메서드: 본문 없는 GET, 본문을 가질 수 있는 POST, PUT, PATCH, DELETE
+int method_supported(char *method)
+{
+  return !strcasecmp(method, "GET") || !strcasecmp(method, "HEAD") ||
+         !strcasecmp(method, "POST") || !strcasecmp(method, "PUT") ||
+         !strcasecmp(method, "PATCH") || !strcasecmp(method, "DELETE");
+}
+
+// 서버에 보낼 HTTP 요청 헤더 구성: 동적 필드(요청 라인, Host, 본문 길이)만 포맷하고
+// 클라이언트가 보낸 나머지 헤더와 고정 꼬리(User-Agent, Connection, 빈 줄)는 그대로 붙임
+// 클라이언트가 HTTP/1.1이거나 chunked 본문이 있으면 HTTP/1.1, 아니면 HTTP/1.0으로 보냄
+void build_request(hdr_t *hp, char *method, char *path, char *version, char *hostname, reqhdrs_t *rh)
+{
+  hdr_init(hp);
+  hdr_printf(hp, "%s %s HTTP/1.%d\r\nHost: %s\r\n", method, path,
+             rh->chunked || !strcasecmp(version, "HTTP/1.1"), hostname);
+  if (rh->chunked)
+    hdr_static(hp, "Transfer-Encoding: chunked\r\n");
+  else if (rh->clen >= 0)
+    hdr_printf(hp, "Content-Length: %lld\r\n", rh->clen);
+  hdr_add(hp, rh->fwd, rh->fwdlen);
+  hdr_add(hp, req_tail_hdr, req_tail_len);
+}
+
+// hedged request: uc로 보낸 요청이 delay 안에 첫 바이트를 못 받으면 (예산이 남아 있을 때)
+// 같은 요청(req)을 다른 연결로 한 번 더 보내고, 먼저 응답이 오기 시작한 쪽을 돌려줌
+// 진 쪽 연결은 닫아서 요청을 취소. 둘 다 안 오면 원래 연결을 돌려줌 (read에서 504 처리)
+upconn_t *hedge(origin_t *origin, upconn_t *uc, int delay, hdr_t *req)
+{
+  struct pollfd pfd[2];
+  upconn_t *uc2;
+  int n, timeout = -1;
+
+  pfd[0].fd = uc->fd;
+  pfd[0].events = POLLIN;
+  if (uc->rio.rio_cnt > 0 || poll(pfd, 1, delay) != 0)
+    return uc;  // 제때 응답이 오기 시작했음 (또는 에러: read 쪽에서 처리)
+  if (!origin_hedge_spend())
+    return uc;
+  if ((uc2 = origin_checkout(origin, CHECKOUT_POOLED | CHECKOUT_NOWAIT)) == NULL)
+    return uc;
+  sock_timeout(uc2->fd, SO_SNDTIMEO, conf.upstream_idle_timeout_ms);
+  sock_timeout(uc2->fd, SO_RCVTIMEO, conf.upstream_first_byte_timeout_ms);
+  if (hdr_writev(uc2->fd, req) < 0) {
+    origin_discard(uc2);
+    return uc;
+  }
+
+  pfd[1].fd = uc2->fd;
+  pfd[1].events = POLLIN;
+  if (conf.upstream_first_byte_timeout_ms > 0)
+    timeout = conf.upstream_first_byte_timeout_ms > delay ? conf.upstream_first_byte_timeout_ms - delay : 0;
+  n = poll(pfd, 2, timeout);
+  if (n > 0 && pfd[1].revents && !pfd[0].revents) {
+    origin_hedge_won();
+    origin_discard(uc);
+    return uc2;
+  }
+  origin_discard(uc2);
+  if (n == 0)
+    sock_timeout(uc->fd, SO_RCVTIMEO, 1);  // 첫 바이트 시간은 이미 다 씀: read가 바로 타임아웃
+  return uc;
+}
+
+// relay_done_t: origin 응답을 끝까지 정확히 읽었고 origin도 연결을 유지하면 풀에 반납
+void upstream_done(void *arg, int ok)
+{
+  upstream_t *up = arg;
+
+  if (ok && up->keepalive)
+    origin_checkin(up->uc);
   else
-    hostbegin = uri;
-
-  // '/' 문자가 있는 경우 → 경로(path) 시작 부분 찾기
-  pathbegin = strchr(hostbegin, '/');
-  if (pathbegin) {
-    // path 복사
-    strcpy(path, pathbegin);
-    // host 부분만 추출하기 위해 '/' 위치를 널 문자로 끊음
-    *pathbegin = '\0';
-  } else {
-    // '/'가 없다면 path는 빈 문자열
-    path[0] = '\0';
+    origin_discard(up->uc);
+}
+
+// GET <stats_path>: 연결 풀, DNS 캐시, 터널, backend, origin 대기 큐 카운터를 text/plain 으로
+void serve_stats(int fd)
+{
+  char body[MAXBUF * 2];
+  pool_stats_t ps;
+  dns_stats_t ds;
+  hdr_t hdr;
+  long long h2c, h2s;
+  int len;
+
+  origin_pool_stats(&ps);
+  dns_stats(&ds);
+  h2_stats(&h2c, &h2s);
+  len = snprintf(body, sizeof(body),
+                 "pool_hits %lld\npool_misses %lld\npool_stale %lld\npool_evicted %lld\n"
+                 "tfo_syn_data %lld\ntfo_fallback %lld\nbreaker_opened %lld\nbreaker_rejected %lld\n"
+                 "hedge_sent %lld\nhedge_won %lld\n"
+                 "preconnect_started %lld\npreconnect_used %lld\npreconnect_parked %lld\n"
+                 "dns_hits %lld\ndns_neg_hits %lld\ndns_misses %lld\ndns_joins %lld\n"
+                 "dns_timeouts %lld\ndns_entries %lld\n"
+                 "tunnels %d\nh2_connections %lld\nh2_streams %lld\n",
+                 ps.hits, ps.misses, ps.stale, ps.evicted, ps.tfo_syn_data, ps.tfo_fallback,
+                 ps.brk_opened, ps.brk_rejected, ps.hedge_sent, ps.hedge_won,
+                 ps.preconnect_started, ps.preconnect_used, ps.preconnect_parked,
+                 ds.hits, ds.neg_hits, ds.misses, ds.joins, ds.timeouts, ds.entries,
+                 tunnel_count(), h2c, h2s);
+  len += backend_stats(body + len, sizeof(body) - len);
+  len += origin_queue_stats(body + len, sizeof(body) - len);
+
+  hdr_init(&hdr);
+  hdr_static(&hdr, "HTTP/1.0 200 OK\r\nContent-type: text/plain\r\n");
+  hdr_printf(&hdr, "Content-length: %d\r\nConnection: close\r\n\r\n", len);
+  hdr_add(&hdr, body, len);
+  hdr_writev(fd, &hdr);
+}
+
+// 연결을 HTTP/2 로 넘김. Upgrade 요청은 그대로 스트림 1 이 되므로 미리 해둔 캐시 조회와
+// origin 연결은 돌려줌 (origin 연결은 풀에 남아 스트림 1 이 씀)
+void serve_h2c(int fd, rio_t *rp, request_t *rq)
+{
+  char req[MAXBUF + MAXLINE * 3], settings[256];
+  int len;
+
+  if (rq->h2c) {
+    h2_serve(fd, rp, NULL, 0, NULL);
+    return;
   }
+  origin_preconnect_cancel(rq->pre);
+  if (rq->obj)
+    cache_release(rq->obj);
+  len = snprintf(req, sizeof(req), "%s %s HTTP/1.1\r\nHost: %.*s\r\n%.*sConnection: close\r\n\r\n",
+                 rq->method, rq->uri, (int)rq->rh.host.len, rq->rh.host.p, (int)rq->rh.fwdlen, rq->rh.fwd);
+  snprintf(settings, sizeof(settings), "%.*s", (int)rq->rh.h2_settings.len, rq->rh.h2_settings.p);
+  h2_serve(fd, rp, req, len, settings[0] ? settings : NULL);
+}
+
+// 소켓 읽기/쓰기 타임아웃 (opt: SO_RCVTIMEO 또는 SO_SNDTIMEO). ms가 0 이하면 끔
+void sock_timeout(int fd, int opt, int ms)
+{
+  struct timeval tv;
+
+  if (ms < 0)
+    ms = 0;
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  setsockopt(fd, SOL_SOCKET, opt, &tv, sizeof(tv));
+}
+
+// 응답 헤더(빈 줄로 끝남)를 클라이언트에 보냄. 마지막 빈 줄 앞에 클라이언트 연결을
+// 유지할지(Connection: keep-alive / close)를 끼워 넣고, 본문이 있으면 같은 writev로 보냄
+int send_head(int fd, const char *hdrs, size_t len, const char *body, size_t bodylen, int keepalive)
+{
+  hdr_t hdr;
+
+  hdr_init(&hdr);
+  hdr_add(&hdr, hdrs, len - 2);
+  if (keepalive)
+    hdr_static(&hdr, "Connection: keep-alive\r\n\r\n");
+  else
+    hdr_static(&hdr, "Connection: close\r\n\r\n");
+  if (bodylen > 0)
+    hdr_add(&hdr, body, bodylen);
+  return hdr_writev(fd, &hdr) < 0 ? -1 : 0;
+}
+
+// 저장된 응답 헤더에 Content-Length가 있는지 (캐시 히트 응답을 keep-alive로 보낼 수 있는지)
+int has_clen(const char *hdrs, size_t len)
+{
+  const char *p = hdrs, *end = hdrs + len, *nl;
+
+  while (p < end && (nl = memchr(p, '\n', end - p)) != NULL) {
+    if (nl - p >= 15 && !strncasecmp(p, "Content-Length:", 15))
+      return 1;
+    p = nl + 1;
+  }
+  return 0;
+}
+
+// 캐시된 객체의 본문에서 Range 구간만 잘라 206으로. 본문은 복사하지 않고 obj->data 안을 가리키는
+// iovec으로 보냄. 구간이 여럿이면 multipart/byteranges, 만족하는 구간이 없으면 416
+// 보냈으면 0, 쓰기 실패 -1, Range를 따르지 않으면 1 (형식이 틀렸거나 If-Range가 안 맞음: 전체를 보냄)
+int send_range(int fd, cache_obj_t *obj, reqhdrs_t *rh, int keepalive)
+{
+  static const char boundary[] = "3d6b6a416f9b5c1e";
+  static const char part_fmt[] = "\r\n--%s\r\nContent-Type: %.*s\r\nContent-Range: bytes %lld-%lld/%lld\r\n\r\n";
+  const char *body = obj->data + obj->hdrlen;
+  long long size = obj->size - obj->hdrlen, clen;
+  hp_str_t ctype = { "application/octet-stream", 24 }, etag = { "", 0 }, lastmod = { "", 0 }, v;
+  hp_range_t rg[HP_MAXRANGES];
+  hp_msg_t hp;
+  hp_hdr_t *h;
+  hdr_t hdr;
+  int n, k;
 
-  // ':' 문자가 있는 경우 → 포트 번호가 명시된 경우
-  portbegin = strchr(hostbegin, ':');
-  if (portbegin) {
-    *portbegin = '\0';            // host와 port를 구분
-    strcpy(hostname, hostbegin);  // host 복사
-    strcpy(port, portbegin + 1);  // ':' 다음 포트 복사
+  // 저장된 헤더는 read_responsehdrs가 한 번 통과시킨 것이라 다시 파싱해도 실패하지 않음
+  hp_init(&hp);
+  if (hp_parse_response(&hp, obj->data, obj->hdrlen) != (int)obj->hdrlen)
+    return 1;
+  for (k = 0; k < hp.nhdr; k++) {
+    h = &hp.hdr[k];
+    switch (h->id) {
+    case HN_CONTENT_TYPE:  ctype = h->value; break;
+    case HN_ETAG:          etag = h->value; break;
+    case HN_LAST_MODIFIED: lastmod = h->value; break;
+    default:               break;
+    }
+  }
+
+  // If-Range: 클라이언트가 가진 조각이 이 객체의 것일 때만 구간을 줌. 엔터티 태그는 강한 비교
+  // (W/ 태그는 안 맞음), 날짜는 Last-Modified와 글자 그대로 같아야 함
+  if (rh->if_range.len) {
+    v = rh->if_range.p[0] == '"' || !strncmp(rh->if_range.p, "W/", 2) ? etag : lastmod;
+    if (v.len != rh->if_range.len || memcmp(v.p, rh->if_range.p, v.len) || !strncmp(v.p, "W/", 2))
+      return 1;
+  }
+  if ((n = hp_range(rh->range, size, rg, HP_MAXRANGES)) < 0)
+    return 1;
+
+  hdr_init(&hdr);
+  if (n == 0) {
+    hdr_printf(&hdr, "%.*s 416 Range Not Satisfiable\r\nContent-Range: bytes */%lld\r\n"
+               "Content-Length: 0\r\n", (int)hp.version.len, hp.version.p, size);
   } else {
-    // 포트가 명시되지 않았다면 기본 포트는 80
-    strcpy(hostname, hostbegin);
-    strcpy(port, "80");
+    // 저장된 헤더 중 길이(와 여러 구간이면 Content-Type)만 바꿔 씀. 나머지 줄은 obj->data를 그대로 가리킴
+    hdr_printf(&hdr, "%.*s 206 Partial Content\r\n", (int)hp.version.len, hp.version.p);
+    for (k = 0; k < hp.nhdr; k++) {
+      h = &hp.hdr[k];
+      if (h->id != HN_CONTENT_LENGTH && (n == 1 || h->id != HN_CONTENT_TYPE))
+        hdr_add(&hdr, h->line.p, h->line.len);
+    }
+    if (n == 1) {
+      hdr_printf(&hdr, "Content-Range: bytes %lld-%lld/%lld\r\nContent-Length: %lld\r\n",
+                 rg[0].first, rg[0].last, size, rg[0].last - rg[0].first + 1);
+    } else {
+      // 본문 길이: 구간마다 (구분자 + 부분 헤더 + 조각) + 끝 구분자
+      clen = 8 + sizeof(boundary) - 1;
+      for (k = 0; k < n; k++)
+        clen += snprintf(NULL, 0, part_fmt, boundary, (int)ctype.len, ctype.p,
+                         rg[k].first, rg[k].last, size) + rg[k].last - rg[k].first + 1;
+      hdr_printf(&hdr, "Content-Type: multipart/byteranges; boundary=%s\r\nContent-Length: %lld\r\n",
+                 boundary, clen);
+    }
+  }
+  if (keepalive)
+    hdr_static(&hdr, "Connection: keep-alive\r\n\r\n");
+  else
+    hdr_static(&hdr, "Connection: close\r\n\r\n");
+  for (k = 0; k < n; k++) {
+    if (n > 1)
+      hdr_printf(&hdr, part_fmt, boundary, (int)ctype.len, ctype.p, rg[k].first, rg[k].last, size);
+    hdr_add(&hdr, body + rg[k].first, rg[k].last - rg[k].first + 1);
   }
+  if (n > 1)
+    hdr_printf(&hdr, "\r\n--%s--\r\n", boundary);
+  return hdr_writev(fd, &hdr) < 0 ? -1 : 0;
 }
 
-// 요청 헤더를 읽어들이는 함수. 불필요한 헤더는 무시함
-void read_requesthdrs(rio_t *rp) {
-  char buf[MAXLINE];
+// Range 미스 뒤에 객체 전체를 받아 캐시에 채우는 스레드를 띄움
+// 같은 키를 이미 채우는 중이거나 예전에 캐시에 안 들어갔던 키면 띄우지 않음
+void range_fill(origin_t *origin, char *key, char *hostname, char *path, reqhdrs_t *rh)
+{
+  const char *p, *end, *nl, *c;
+  rangefill_t *rf;
+  pthread_t tid;
+  hname_t id;
 
-  while (1) {
-    // 한 줄씩 요청 헤더를 읽는다
-    Rio_readlineb(rp, buf, MAXLINE);
+  if (strlen(path) >= sizeof(rf->path) || cache_too_large(key) || !cache_fill_claim(key))
+    return;
+  rf = Malloc(sizeof(rangefill_t));
+  rf->origin = origin;
+  strcpy(rf->key, key);
+  strcpy(rf->hostname, hostname);
+  strcpy(rf->path, path);
+  rf->rh.clen = -1;
+  rf->rh.chunked = 0;
+  rf->rh.range.len = rf->rh.if_range.len = 0;
+
+  // 요청 헤더는 구간과 조건(If-*)만 빼고 그대로: origin이 같은 표현 전체를 200으로 주도록
+  rf->rh.fwdlen = 0;
+  for (p = rh->fwd, end = rh->fwd + rh->fwdlen; p < end; p = nl + 1) {
+    if ((nl = memchr(p, '\n', end - p)) == NULL)
+      break;
+    c = memchr(p, ':', nl - p);
+    id = c ? hname_lookup(p, c - p) : HN_OTHER;
+    if (id == HN_RANGE || id == HN_IF_RANGE || id == HN_IF_MATCH || id == HN_IF_NONE_MATCH ||
+        id == HN_IF_MODIFIED_SINCE || id == HN_IF_UNMODIFIED_SINCE)
+      continue;
+    memcpy(rf->rh.fwd + rf->rh.fwdlen, p, nl + 1 - p);
+    rf->rh.fwdlen += nl + 1 - p;
+  }
+
+  if (pthread_create(&tid, NULL, range_fill_thread, rf) != 0) {
+    cache_fill_unclaim(key);
+    Free(rf);
+  }
+}
+
+// range_fill이 띄운 스레드: Range 없이 GET을 보내 200 응답 전체를 캐시에 채움
+// 기다리는 클라이언트가 없으므로 origin slot이 바로 안 나면 포기하고, 캐시에 안 들어갈
+// 크기로 밝혀지면 그 자리에서 그만둠
+void *range_fill_thread(void *vargp)
+{
+  rangefill_t *rf = vargp;
+  char buf[MAXBUF];
+  resphdrs_t rs;
+  cache_fill_t fill;
+  upconn_t *uc;
+  hdr_t hdr;
+  long long left = 0;
+  ssize_t n = -1;
+  int ok = 0;
+
+  Pthread_detach(pthread_self());
+  if ((uc = origin_checkout(rf->origin, CHECKOUT_POOLED | CHECKOUT_NOWAIT)) != NULL) {
+    build_request(&hdr, "GET", rf->path, "HTTP/1.1", rf->hostname, &rf->rh);
+    sock_timeout(uc->fd, SO_SNDTIMEO, conf.upstream_idle_timeout_ms);
+    sock_timeout(uc->fd, SO_RCVTIMEO, conf.upstream_first_byte_timeout_ms);
+    if (hdr_writev(uc->fd, &hdr) >= 0 && read_responsehdrs(&uc->rio, &rs, 0) == 0 &&
+        rs.status == 200 && !rs.chunked) {
+      cache_fill_init(&fill, rf->key);
+      cache_fill_tap(&fill, rs.buf, rs.len);
+      // Content-Length가 없으면 EOF까지
+      for (left = rs.clen; left != 0 && !fill.bypass; left -= n) {
+        n = rio_readnb(&uc->rio, buf, left > 0 && left < (long long)sizeof(buf) ? left : sizeof(buf));
+        if (n <= 0)
+          break;
+        cache_fill_tap(&fill, buf, n);
+      }
+      ok = left == 0 || (rs.clen < 0 && n == 0);
+      cache_fill_finish(&fill, ok);
+    }
+    if (ok && rs.keepalive)
+      origin_checkin(uc);
+    else
+      origin_discard(uc);
+  }
+  cache_fill_unclaim(rf->key);
+  Free(rf);
+  return NULL;
+}
+
+// CONNECT host:port 처리. 이름 해석과 연결은 터널 스레드가 이어서 하므로(tunnel_connect)
+// 이 스레드는 기다리지 않음. fd는 바로 터널 쪽 소유가 되고, 실패 응답도 터널 쪽에서 보냄
+void do_connect(int fd, rio_t *rp, char *hostname, char *port)
+{
+  printf("CONNECT → host: %s, port: %s\n", hostname, port);
+  tunnel_connect(fd, rp, hostname, port);
+}
+
+// 클라이언트에게 오류 응답을 보냄 (헤더 + 본문을 writev 한 번으로)
+void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
+{
+  char body[MAXBUF];
+  int bodylen;
+  hdr_t hdr;
+
+  bodylen = snprintf(body, sizeof(body),
+                     "<html><title>Tiny Error</title>"
+                     "<body bgcolor=\"ffffff\">\r\n"
+                     "%s : %s\r\n"
+                     "<p>%s : %s\r\n"
+                     "<hr><em>The Tiny Web server</em>\r\n",
+                     errnum, shortmsg, longmsg, cause);
+  if (bodylen >= sizeof(body))
+    bodylen = sizeof(body) - 1;
+
+  hdr_init(&hdr);
+  hdr_printf(&hdr, "HTTP/1.0 %s %s\r\n", errnum, shortmsg);
+  hdr_static(&hdr, "Content-type: text/html\r\n");
+  hdr_printf(&hdr, "Content-length: %d\r\nConnection: close\r\n\r\n", bodylen);
+  hdr_add(&hdr, body, bodylen);
+  hdr_writev(fd, &hdr);  // 클라이언트가 이미 떠났어도 프록시는 계속 (연결은 어차피 닫음)
+}
+
+// 파싱한 요청 헤더를 훑는 함수. 프록시가 다시 만드는 헤더는 버리고 나머지는 rh->fwd에 모음
+// 성공 0, 값이 이상하면 -1
+int scan_requesthdrs(hp_msg_t *hp, reqhdrs_t *rh) {
+  hp_hdr_t *h;
+  int k;
+
+  rh->fwdlen = 0;
+  rh->clen = -1;
+  rh->chunked = 0;
+  rh->conn_close = rh->conn_keepalive = 0;
+  rh->upgrade_h2c = 0;
+  rh->h2_settings.len = rh->host.len = 0;
+  rh->range.len = rh->if_range.len = 0;
 
-    // 빈 줄이면 헤더 끝 (HTTP에서 헤더 끝은 빈 줄로 표시)
-    if (!strcmp(buf, "\r\n")) break;
+  for (k = 0; k < hp->nhdr; k++) {
+    h = &hp->hdr[k];
+
+    switch (h->id) {
+    // 클라이언트 연결 유지 여부는 기억만 하고, origin 쪽 Connection은 프록시가 다시 씀
+    case HN_CONNECTION:
+    case HN_PROXY_CONNECTION:
+      if (hp_has(h->value, "close"))
+        rh->conn_close = 1;
+      if (hp_has(h->value, "keep-alive"))
+        rh->conn_keepalive = 1;
+      continue;
+
+    // HTTP/2 로 바꾸자는 요청은 프록시가 받음 (origin에는 넘기지 않음)
+    case HN_UPGRADE:
+      if (!hp_has(h->value, "h2c"))
+        break;
+      rh->upgrade_h2c = 1;
+      continue;
+    case HN_HTTP2_SETTINGS:
+      rh->h2_settings = h->value;
+      continue;
 
     // 아래의 헤더는 우리가 프록시에서 직접 구성하므로 무시
-    if (!strncasecmp(buf, "Host:", 5) ||
-        !strncasecmp(buf, "User-Agent:", 11) ||
-        !strncasecmp(buf, "Connection:", 11) ||
-        !strncasecmp(buf, "Proxy-Connection:", 17)) continue;
+    case HN_HOST:
+      rh->host = h->value;
+      continue;
+    case HN_USER_AGENT:
+    case HN_KEEP_ALIVE:
+      continue;
+
+    // 본문 길이 관련 헤더는 값만 기억하고 요청을 보낼 때 다시 씀
+    case HN_CONTENT_LENGTH:
+      if ((rh->clen = hp_clen(h->value)) < 0)
+        return -1;
+      continue;
+    case HN_TRANSFER_ENCODING:
+      if (hp_has(h->value, "chunked"))
+        rh->chunked = 1;
+      continue;
+
+    // 캐시 히트면 프록시가 답하므로 기억해 둠 (미스면 origin에 그대로)
+    case HN_RANGE:
+      rh->range = h->value;
+      break;
+    case HN_IF_RANGE:
+      rh->if_range = h->value;
+      break;
+
+    default:
+      break;
+    }
+
+    // 그 외의 다른 헤더들은 origin에 그대로 전달 (버퍼를 넘으면 버림)
+    if (rh->fwdlen + h->line.len <= sizeof(rh->fwd)) {
+      memcpy(rh->fwd + rh->fwdlen, h->line.p, h->line.len);
+      rh->fwdlen += h->line.len;
+    }
+  }
+  return 0;
+}
 
-    // 그 외의 다른 헤더들도 현재 구현에서는 무시
+// origin 응답의 상태 줄과 헤더를 읽어 rs에 요약. 연결 관리 헤더(Connection, Keep-Alive,
+// Proxy-Connection)는 hop-by-hop이므로 빼고, 100 Continue 같은 중간 응답은 버림
+// 성공 0, 응답이 이상하면 -1, 첫 바이트도 받기 전에 끊기면 -2 (stale 연결이면 재시도 가능),
+// 소켓 타임아웃(SO_RCVTIMEO)이 지나면 -3. head면 HEAD 요청의 응답이라 상태와 상관없이 본문이 없음
+int read_responsehdrs(rio_t *rp, resphdrs_t *rs, int head)
+{
+  hp_msg_t hp;
+  hp_hdr_t *h;
+  size_t i;
+  int n, k, got_any = 0;
+
+  do {
+    // 상태 줄부터 빈 줄까지를 rio 버퍼 위에서 파싱 (모자라면 더 읽음)
+    hp_init(&hp);
+    while (1) {
+      n = hp_parse_response(&hp, rp->rio_bufptr, rp->rio_cnt);
+      if (rp->rio_cnt > 0 && !got_any) {  // 첫 바이트가 왔으니 이제부터는 바이트 사이 공백만 제한
+        sock_timeout(rp->rio_fd, SO_RCVTIMEO, conf.upstream_idle_timeout_ms);
+        got_any = 1;
+      }
+      if (n != HP_AGAIN)
+        break;
+      if ((k = rio_fillb(rp)) <= 0)
+        return k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? -3 : got_any ? -1 : -2;
+    }
+    if (n < 0 || hp.version.len != 8 || strncmp(hp.version.p, "HTTP/1.", 7) ||
+        !isdigit((unsigned char)hp.version.p[7]) || n >= sizeof(rs->buf))
+      return -1;
+    rs->status = hp.status;
+    memcpy(rs->buf, hp.line.p, hp.line.len);
+    rs->len = hp.line.len;
+    rs->clen = -1;
+    rs->chunked = 0;
+    rs->total = -1;
+    rs->keepalive = hp.version.p[7] >= '1';  // HTTP/1.1은 기본이 keep-alive, 1.0은 명시해야 함
+
+    for (k = 0; k < hp.nhdr; k++) {
+      h = &hp.hdr[k];
+      switch (h->id) {
+      case HN_CONNECTION:
+        if (hp_has(h->value, "close"))
+          rs->keepalive = 0;
+        else if (hp_has(h->value, "keep-alive"))
+          rs->keepalive = 1;
+        continue;
+      case HN_KEEP_ALIVE:
+      case HN_PROXY_CONNECTION:
+        continue;
+      case HN_CONTENT_LENGTH:
+        if ((rs->clen = hp_clen(h->value)) < 0)
+          return -1;
+        break;
+      case HN_TRANSFER_ENCODING:
+        if (hp_has(h->value, "chunked"))
+          rs->chunked = 1;
+        break;
+      case HN_CONTENT_RANGE:  // "bytes 0-99/1234" 의 1234
+        for (i = h->value.len; i > 0 && h->value.p[i - 1] != '/'; i--)
+          ;
+        if (i > 0)
+          rs->total = hp_clen((hp_str_t){ h->value.p + i, h->value.len - i });
+        break;
+      default:
+        break;
+      }
+
+      // 나머지 헤더는 클라이언트로 그대로 (헤더 블록이 rs->buf 보다 작으므로 넘치지 않음)
+      memcpy(rs->buf + rs->len, h->line.p, h->line.len);
+      rs->len += h->line.len;
+    }
+    memcpy(rs->buf + rs->len, "\r\n", 2);
+    rs->len += 2;
+    rp->rio_bufptr += n;
+    rp->rio_cnt -= n;
+  } while (rs->status >= 100 && rs->status < 200 && rs->status != 101);
+
+  // 본문 길이를 알 수 없으면(EOF까지 읽어야 함) 응답 뒤에 연결을 쓸 수 없음
+  rs->nobody = head || rs->status == 204 || rs->status == 304;
+  if (!rs->nobody && !rs->chunked && rs->clen < 0)
+    rs->keepalive = 0;
+  return 0;
+}
+
+// 요청 본문을 origin으로 스트리밍. 전체를 버퍼에 모으지 않으므로 메모리는 본문 크기와 무관
+// 성공 0, 실패 -1
+int forward_body(rio_t *rp, int serverfd, reqhdrs_t *rh)
+{
+  char line[MAXLINE];
+  long long size;
+  ssize_t n;
+  char *end;
+
+  // Content-Length: 정해진 바이트만큼 그대로 (큰 본문은 splice)
+  if (!rh->chunked)
+    return rh->clen > 0 ? relay_copy(serverfd, rp, rh->clen) : 0;
+
+  // chunked: 청크 크기 줄 → 데이터 + CRLF 를 반복, 크기 0이면 trailer까지 전달
+  while (1) {
+    if ((n = rio_readlineb(rp, line, MAXLINE)) <= 0)
+      return -1;
+    size = strtoll(line, &end, 16);
+    if (size < 0 || end == line)
+      return -1;
+    if (rio_writen(serverfd, line, n) != n)
+      return -1;
+    if (size == 0)
+      break;
+    if (relay_copy(serverfd, rp, size + 2) < 0)
+      return -1;
   }
+  do {
+    if ((n = rio_readlineb(rp, line, MAXLINE)) <= 0)
+      return -1;
+    if (rio_writen(serverfd, line, n) != n)
+      return -1;
+  } while (strcmp(line, "\r\n"));
+  return 0;
 }
 
 /*     병렬처리 프록시 구현에서의 흐름	
@@ -0,0 +1,453 @@
+/*
+ * relay.c - origin → 클라이언트 응답 중계 (backpressure 포함)
+ *
+ * 흐름:
+ *   1. origin이 읽을 수 있고 링 버퍼에 여유가 있으면 origin에서 읽는다
+ *   2. 링 버퍼에 데이터가 있으면 클라이언트로 non-blocking writev
+ *   3. 버퍼가 high watermark 이상이면 origin 읽기를 멈춘다 (spill 모드면
+ *      임시 파일에 계속 받아서 origin을 최대한 빨리 놓아준다)
+ *   4. low watermark 아래로 빠지면 다시 읽는다 (임시 파일 → 링 버퍼 먼저)
+ *   5. 데이터가 쌓여 있는데 클라이언트가 write deadline 동안 못 받으면 중단
+ */
+#include <limits.h>
+#include <poll.h>
+#include "relay.h"
+#include "conf.h"
+#include "zcopy.h"
+
+/* 연결당 고정 크기 링 버퍼 */
+typedef struct {
+  char *buf;
+  size_t size;
+  size_t head;   /* 다음에 클라이언트로 보낼 위치 */
+  size_t len;    /* 쌓여 있는 바이트 수 */
+} ring_t;
+
+/* 쌓인 데이터 구간을 iovec 최대 2개로 */
+static int ring_data_iov(ring_t *rb, struct iovec *iov)
+{
+  size_t first = rb->size - rb->head;
+
+  if (rb->len == 0)
+    return 0;
+  iov[0].iov_base = rb->buf + rb->head;
+  if (rb->len <= first) {
+    iov[0].iov_len = rb->len;
+    return 1;
+  }
+  iov[0].iov_len = first;
+  iov[1].iov_base = rb->buf;
+  iov[1].iov_len = rb->len - first;
+  return 2;
+}
+
+/* 빈 구간을 iovec 최대 2개로, 전체 길이는 max 이하로 자름 */
+static int ring_free_iov(ring_t *rb, struct iovec *iov, size_t max)
+{
+  size_t tail = (rb->head + rb->len) % rb->size;
+  size_t room = rb->size - rb->len;
+  size_t first = rb->size - tail;
+
+  if (room > max)
+    room = max;
+  if (room == 0)
+    return 0;
+  iov[0].iov_base = rb->buf + tail;
+  if (room <= first) {
+    iov[0].iov_len = room;
+    return 1;
+  }
+  iov[0].iov_len = first;
+  iov[1].iov_base = rb->buf;
+  iov[1].iov_len = room - first;
+  return 2;
+}
+
+/* origin에서 이번에 더 읽어도 되는 바이트 수 (limit 반영) */
+static size_t src_allow(relay_t *r, size_t room)
+{
+  long long left;
+
+  if (r->limit < 0)
+    return room;
+  left = r->limit - r->nread;
+  return left < (long long)room ? (size_t)left : room;
+}
+
+/* origin에서 읽기. rio 버퍼에 이미 들어와 있는 바이트가 있으면 그것부터 */
+static ssize_t src_readv(relay_t *r, struct iovec *iov, int iovcnt)
+{
+  rio_t *rp = r->src_rio;
+  ssize_t n = 0;
+  size_t c;
+  int i;
+
+  if (rp && rp->rio_cnt > 0) {
+    for (i = 0; i < iovcnt && rp->rio_cnt > 0; i++) {
+      c = iov[i].iov_len < (size_t)rp->rio_cnt ? iov[i].iov_len : (size_t)rp->rio_cnt;
+      memcpy(iov[i].iov_base, rp->rio_bufptr, c);
+      rp->rio_bufptr += c;
+      rp->rio_cnt -= c;
+      n += c;
+    }
+    return n;
+  }
+  while ((n = readv(r->src_fd, iov, iovcnt)) < 0 && errno == EINTR)
+    ;
+  return n;
+}
+
+static void tap_iov(relay_t *r, struct iovec *iov, int iovcnt, size_t n)
+{
+  size_t c;
+  int i;
+
+  if (!r->tap)
+    return;
+  for (i = 0; i < iovcnt && n > 0; i++) {
+    c = iov[i].iov_len < n ? iov[i].iov_len : n;
+    r->tap(r->tap_arg, iov[i].iov_base, c);
+    n -= c;
+  }
+}
+
+/* chunked 디코더 상태 */
+enum { CH_SIZE, CH_EXT, CH_DATA, CH_DATA_END, CH_TRAILER, CH_DONE };
+
+static int hexval(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+/* buf[0..n)을 디코더에 먹임. 메시지 끝에 닿으면 끝 바로 뒤 오프셋, 아니면 n.
+   형식이 틀리면 -1 */
+static ssize_t chunk_scan(chunk_dec_t *d, const char *buf, size_t n)
+{
+  size_t i = 0, c;
+  int x;
+
+  while (i < n && d->state != CH_DONE) {
+    switch (d->state) {
+    case CH_SIZE:
+      if ((x = hexval(buf[i])) >= 0) {
+        if (d->left > (LLONG_MAX >> 4))
+          return -1;
+        d->left = d->left * 16 + x;
+        d->ndigits++;
+        i++;
+      } else if (!d->ndigits) {
+        return -1;
+      } else {
+        d->state = CH_EXT;
+      }
+      break;
+    case CH_EXT:       /* chunk-ext, 공백, CR은 건너뛰고 LF에서 크기 줄 끝 */
+      if (buf[i++] == '\n') {
+        d->state = d->left ? CH_DATA : CH_TRAILER;
+        d->linelen = 0;
+      }
+      break;
+    case CH_DATA:
+      c = (long long)(n - i) < d->left ? n - i : (size_t)d->left;
+      i += c;
+      if ((d->left -= c) == 0)
+        d->state = CH_DATA_END;
+      break;
+    case CH_DATA_END:  /* 데이터 뒤의 CRLF */
+      if (buf[i++] == '\n') {
+        d->state = CH_SIZE;
+        d->ndigits = 0;
+      }
+      break;
+    case CH_TRAILER:   /* 빈 줄이 나올 때까지 trailer 줄들 */
+      if (buf[i] == '\n') {
+        if (!d->linelen)
+          d->state = CH_DONE;
+        d->linelen = 0;
+      } else if (buf[i] != '\r') {
+        d->linelen++;
+      }
+      i++;
+      break;
+    }
+  }
+  return i;
+}
+
+/* iovec 으로 읽은 n 바이트를 디코더에 먹임. 반환값은 chunk_scan 과 같음 */
+static ssize_t chunk_scan_iov(chunk_dec_t *d, struct iovec *iov, int iovcnt, size_t n)
+{
+  size_t c, used = 0;
+  ssize_t k;
+  int i;
+
+  for (i = 0; i < iovcnt && used < n; i++) {
+    c = iov[i].iov_len < n - used ? iov[i].iov_len : n - used;
+    if ((k = chunk_scan(d, iov[i].iov_base, c)) < 0)
+      return -1;
+    used += k;
+    if (d->state == CH_DONE)
+      break;
+  }
+  return used;
+}
+
+static void finish_src(relay_t *r, int *src_done, int ok)
+{
+  if (*src_done)
+    return;
+  *src_done = 1;
+  if (r->src_done)
+    r->src_done(r->done_arg, ok);
+}
+
+void relay_init(relay_t *r, int src_fd, rio_t *src_rio, int dst_fd)
+{
+  memset(r, 0, sizeof(*r));
+  r->src_fd = src_fd;
+  r->src_rio = src_rio;
+  r->dst_fd = dst_fd;
+  r->limit = -1;
+}
+
+int relay(relay_t *r)
+{
+  ring_t rb;
+  struct iovec iov[2];
+  struct pollfd pfd[2];
+  char chunk[MAXBUF];
+  size_t high, low;
+  off_t spill_rd = 0, spill_wr = 0;
+  int spillfd = -1, iovcnt, flags, timeout, to_spill, want_read, buffered;
+  int src_eof = 0, src_err = 0, src_done = 0, paused = 0, rc = RELAY_OK;
+  long long last_progress, last_src, now;
+  ssize_t n, k;
+  int extra;
+
+  rb.size = conf.relay_bufsize < RIO_BUFSIZE ? RIO_BUFSIZE : conf.relay_bufsize;
+  rb.buf = Malloc(rb.size);
+  rb.head = rb.len = 0;
+  high = conf.relay_high_wm < rb.size ? conf.relay_high_wm : rb.size;
+  low = conf.relay_low_wm < high ? conf.relay_low_wm : high / 2;
+
+  if (r->limit == 0) {
+    src_eof = 1;
+    finish_src(r, &src_done, 1);
+  }
+
+  /* 클라이언트 쓰기만 non-blocking. 끝나면 원래 플래그로 되돌린다 */
+  flags = fcntl(r->dst_fd, F_GETFL);
+  fcntl(r->dst_fd, F_SETFL, flags | O_NONBLOCK);
+  last_progress = last_src = msec_now();
+
+  while (1) {
+    /* 임시 파일로 넘겨둔 데이터를 링 버퍼로 되돌림 */
+    if (spill_wr > spill_rd && rb.len <= low) {
+      iovcnt = ring_free_iov(&rb, iov, spill_wr - spill_rd);
+      if ((n = preadv(spillfd, iov, iovcnt, spill_rd)) <= 0) {
+        rc = RELAY_ESRC;
+        break;
+      }
+      rb.len += n;
+      spill_rd += n;
+      if (spill_rd == spill_wr) {
+        spill_rd = spill_wr = 0;
+        if (ftruncate(spillfd, 0) < 0)
+          ; /* 다음 쓰기에서 덮어쓰므로 무시 */
+      }
+    }
+
+    if (src_eof && rb.len == 0 && spill_wr == spill_rd)
+      break;
+
+    /* watermark 기반 hysteresis */
+    if (!paused && rb.len >= high) {
+      paused = 1;
+      r->npauses++;
+    } else if (paused && rb.len <= low) {
+      paused = 0;
+    }
+
+    to_spill = spill_wr > spill_rd || (paused && conf.relay_spill);
+    if (src_eof)
+      want_read = 0;
+    else if (to_spill)
+      want_read = (size_t)(spill_wr - spill_rd) < conf.relay_spill_max;
+    else
+      want_read = !paused && rb.len < rb.size;
+
+    /* 보낼 데이터가 없는 동안은 write deadline을, origin을 기다리지 않는 동안은
+       src idle deadline을 세지 않는다 */
+    now = msec_now();
+    if (rb.len == 0)
+      last_progress = now;
+    if (!want_read)
+      last_src = now;
+
+    /* 관심 없는 쪽은 fd를 음수로 둬서 POLLHUP 등도 받지 않게 한다 */
+    pfd[0].fd = want_read ? r->src_fd : -1;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = rb.len > 0 ? r->dst_fd : -1;
+    pfd[1].events = POLLOUT;
+    pfd[1].revents = 0;
+
+    if (want_read && r->src_rio && r->src_rio->rio_cnt > 0) {
+      pfd[0].revents = POLLIN;  /* 이미 user space에 있는 바이트 */
+    } else {
+      timeout = -1;
+      if (rb.len > 0) {
+        timeout = (int)(last_progress + conf.relay_write_timeout_ms - now);
+        if (timeout < 0)
+          timeout = 0;
+      }
+      if (want_read && r->src_timeout_ms > 0) {
+        n = last_src + r->src_timeout_ms - now;
+        if (n < 0)
+          n = 0;
+        if (timeout < 0 || n < timeout)
+          timeout = (int)n;
+      }
+      if ((n = poll(pfd, 2, timeout)) < 0) {
+        if (errno == EINTR)
+          continue;
+        rc = RELAY_EDST;
+        break;
+      }
+      now = msec_now();
+      if (n == 0 && rb.len > 0 &&
+          now - last_progress >= conf.relay_write_timeout_ms) {
+        rc = RELAY_ESTALL;
+        break;
+      }
+      /* origin이 src_timeout_ms 동안 한 바이트도 안 보내면 잘린 응답으로 끝냄.
+         이미 받은 것은 클라이언트로 마저 보낸다 */
+      if (!pfd[0].revents && want_read && r->src_timeout_ms > 0 &&
+          now - last_src >= r->src_timeout_ms) {
+        src_eof = src_err = 1;
+        finish_src(r, &src_done, 0);
+        continue;
+      }
+    }
+
+    /* 클라이언트로 쓰기 */
+    if (pfd[1].revents) {
+      iovcnt = ring_data_iov(&rb, iov);
+      n = writev(r->dst_fd, iov, iovcnt);
+      if (n > 0) {
+        rb.head = (rb.head + n) % rb.size;
+        rb.len -= n;
+        r->nwritten += n;
+        last_progress = msec_now();
+      } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        rc = RELAY_EDST;
+        break;
+      }
+    }
+
+    /* origin에서 읽기 */
+    if (pfd[0].revents) {
+      buffered = 0;
+      if (to_spill) {
+        if (spillfd < 0) {
+          char tmpl[] = "/tmp/proxy-spill-XXXXXX";
+          if ((spillfd = mkstemp(tmpl)) < 0) {
+            rc = RELAY_ESRC;
+            break;
+          }
+          unlink(tmpl);
+        }
+        iov[0].iov_base = chunk;
+        iov[0].iov_len = src_allow(r, sizeof(chunk));
+        iovcnt = 1;
+      } else {
+        iovcnt = ring_free_iov(&rb, iov, src_allow(r, rb.size));
+        buffered = 1;
+      }
+
+      n = src_readv(r, iov, iovcnt);
+      extra = 0;
+      if (n > 0 && r->chunked) {
+        /* 응답 끝 뒤에 붙어 온 바이트는 버리고, 그 연결은 재사용하지 않게 함 */
+        if ((k = chunk_scan_iov(&r->ch, iov, iovcnt, n)) < 0)
+          n = -1;
+        else if (k < n)
+          n = k, extra = 1;
+      }
+      if (n > 0) {
+        last_src = msec_now();
+        tap_iov(r, iov, iovcnt, n);
+        r->nread += n;
+        if (buffered) {
+          rb.len += n;
+        } else if (pwrite(spillfd, chunk, n, spill_wr) != n) {
+          rc = RELAY_ESRC;
+          break;
+        } else {
+          spill_wr += n;
+          r->nspilled += n;
+        }
+        if ((r->limit >= 0 && r->nread >= r->limit) ||
+            (r->chunked && r->ch.state == CH_DONE)) {
+          src_eof = 1;
+          finish_src(r, &src_done, !extra);
+        }
+      } else {
+        /* EOF 또는 에러. limit이 있는데 모자라거나 chunked 끝을 못 봤으면 잘린 응답 */
+        src_eof = 1;
+        if (n < 0 || (r->limit >= 0 && r->nread < r->limit) || r->chunked)
+          src_err = 1;
+        finish_src(r, &src_done, !src_err);
+      }
+    }
+  }
+
+  if (rc == RELAY_OK && src_err)
+    rc = RELAY_ESRC;
+  finish_src(r, &src_done, 0);
+  fcntl(r->dst_fd, F_SETFL, flags);
+  if (spillfd >= 0)
+    close(spillfd);
+  Free(rb.buf);
+  return rc;
+}
+
+int relay_copy(int dst_fd, rio_t *src, long long n)
+{
+  char buf[MAXBUF];
+  size_t c;
+  ssize_t k;
+  int rc;
+
+  /* rio 버퍼에 이미 읽혀 있는 본문 앞부분 */
+  while (n > 0 && src->rio_cnt > 0) {
+    c = n < src->rio_cnt ? (size_t)n : (size_t)src->rio_cnt;
+    if (rio_writen(dst_fd, src->rio_bufptr, c) != c)
+      return -1;
+    src->rio_bufptr += c;
+    src->rio_cnt -= c;
+    n -= c;
+  }
+
+  /* 나머지는 splice (작은 본문은 파이프 만드는 비용이 더 큼) */
+  if (conf.relay_splice_min > 0 && n >= (long long)conf.relay_splice_min) {
+    rc = zc_copy(src->rio_fd, dst_fd, n);
+    if (rc == 0)
+      return 0;
+    if (rc != ZC_UNSUPPORTED)
+      return -1;
+  }
+
+  while (n > 0) {
+    c = n < (long long)sizeof(buf) ? (size_t)n : sizeof(buf);
+    if ((k = rio_readnb(src, buf, c)) <= 0)
+      return -1;
+    if (rio_writen(dst_fd, buf, k) != k)
+      return -1;
+    n -= k;
+  }
+  return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * relay.h - origin → 클라이언트 응답 중계 (backpressure 포함)
+ *
+ * 클라이언트 소켓은 non-blocking 으로 쓰고, 연결마다 크기가 정해진 링 버퍼
+ * 하나만 둔다. 버퍼가 high watermark 까지 차면 origin 읽기를 멈추고
+ * (relay_spill=1 이면 임시 파일로 넘기고), low watermark 아래로 비워지면
+ * 다시 읽는다. 클라이언트가 relay_write_timeout_ms 동안 한 바이트도 받지
+ * 않으면 느린 클라이언트로 보고 중계를 끝낸다.
+ */
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include "csapp.h"
+
+/* relay() 결과 */
+#define RELAY_OK       0   /* src를 끝까지(또는 limit까지) 다 전달함 */
+#define RELAY_ESRC    -1   /* origin 읽기 실패 */
+#define RELAY_EDST    -2   /* 클라이언트 쓰기 실패 */
+#define RELAY_ESTALL  -3   /* 클라이언트가 write deadline 안에 못 받음 */
+
+/* origin에서 읽은 바이트를 그대로 엿보는 콜백 (캐시 채우기 등) */
+typedef void relay_tap_t(void *arg, const char *buf, size_t n);
+
+/* origin을 다 읽은 순간 호출됨. 클라이언트가 아직 받는 중이어도
+   origin 연결은 여기서 바로 돌려줄 수 있다. ok 는 응답이 정확히 끝에서
+   멈췄을 때만 1 (그 뒤에 바이트가 더 왔으면 0) */
+typedef void relay_done_t(void *arg, int ok);
+
+/* chunked 응답의 끝을 찾는 디코더 상태 (본문은 바꾸지 않고 그대로 흘려보냄) */
+typedef struct {
+  int state;
+  long long left;           /* 현재 청크에서 남은 데이터 바이트 (크기 줄에서는 누적 중인 값) */
+  int ndigits;              /* 크기 줄에서 읽은 16진수 자릿수 */
+  int linelen;              /* trailer 줄 길이 (0이면 빈 줄) */
+} chunk_dec_t;
+
+typedef struct {
+  /* 입력 */
+  int src_fd;               /* origin 소켓 */
+  rio_t *src_rio;           /* src_fd에 붙은 rio 버퍼 (남은 바이트부터 소비, NULL 가능) */
+  long long limit;          /* origin에서 읽을 최대 바이트 (-1이면 EOF까지) */
+  int chunked;              /* 1이면 limit 대신 chunked 프레이밍으로 응답 끝을 판단 */
+  int src_timeout_ms;       /* origin이 이 시간 동안 아무것도 안 보내면 ESRC (0이면 끔) */
+  int dst_fd;               /* 클라이언트 소켓 */
+  relay_tap_t *tap;         /* NULL 가능 */
+  void *tap_arg;
+  relay_done_t *src_done;   /* NULL 가능 */
+  void *done_arg;
+
+  /* 결과 통계 */
+  long long nread;          /* origin에서 읽은 바이트 */
+  long long nwritten;       /* 클라이언트에 쓴 바이트 */
+  int npauses;              /* high watermark 때문에 origin 읽기를 멈춘 횟수 */
+  long long nspilled;       /* 임시 파일로 넘긴 바이트 */
+
+  chunk_dec_t ch;           /* 내부용 */
+} relay_t;
+
+void relay_init(relay_t *r, int src_fd, rio_t *src_rio, int dst_fd);
+int relay(relay_t *r);
+
+/* 요청 본문 업로드용: src(rio)에서 정확히 n 바이트를 dst로 옮김.
+   rio에 남은 바이트를 먼저 쓰고, 나머지는 가능하면 splice로 커널 안에서만 옮긴다.
+   메모리는 본문 크기와 상관없이 MAXBUF 하나로 고정. 성공 0, 실패 -1 */
+int relay_copy(int dst_fd, rio_t *src, long long n);
+
+#endif /* __RELAY_H__ */
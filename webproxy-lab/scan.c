@@ -0,0 +1,179 @@
+/*
+ * scan.c - HTTP 헤더의 구분 문자 찾기 (SIMD)
+ */
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* 토큰을 끝내는 바이트: SP, HT 를 포함한 0x20 이하, DEL, (colon 이면) ':' */
+static int is_delim(unsigned char c, int colon)
+{
+  return c <= 0x20 || c == 0x7f || (colon && c == ':');
+}
+
+static const char *eol_scalar(const char *p, const char *e)
+{
+  const char *nl = memchr(p, '\n', e - p);
+
+  return nl ? nl : e;
+}
+
+static const char *delim_scalar(const char *p, const char *e, int colon)
+{
+  while (p < e && !is_delim(*p, colon))
+    p++;
+  return p;
+}
+
+#ifdef SCAN_X86
+/* 16바이트씩: 비교 결과를 movemask 로 비트 16개로 모아 첫 1 비트의 위치를 봄 */
+static const char *eol_sse2(const char *p, const char *e)
+{
+  const __m128i nl = _mm_set1_epi8('\n');
+  int bits;
+
+  for (; e - p >= 16; p += 16) {
+    bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), nl));
+    if (bits)
+      return p + __builtin_ctz(bits);
+  }
+  return eol_scalar(p, e);
+}
+
+/* x <= 0x20 은 부호 없는 min(x, 0x20) == x 로 */
+static const char *delim_sse2(const char *p, const char *e, int colon)
+{
+  const __m128i sp = _mm_set1_epi8(0x20), del = _mm_set1_epi8(0x7f);
+  const __m128i col = _mm_set1_epi8(colon ? ':' : 0x7f);
+  __m128i x, m;
+  int bits;
+
+  for (; e - p >= 16; p += 16) {
+    x = _mm_loadu_si128((const __m128i *)p);
+    m = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(x, sp), x),
+                     _mm_or_si128(_mm_cmpeq_epi8(x, del), _mm_cmpeq_epi8(x, col)));
+    if ((bits = _mm_movemask_epi8(m)))
+      return p + __builtin_ctz(bits);
+  }
+  return delim_scalar(p, e, colon);
+}
+
+/* 32바이트씩, 남은 16바이트는 같은 함수 안에서 128비트로 (VEX 인코딩이라 SSE2 코드로
+   넘어갈 때의 전환 지연이 없음). 짧은 헤더 줄은 대부분 여기서 끝남 */
+__attribute__((target("avx2")))
+static const char *eol_avx2(const char *p, const char *e)
+{
+  const __m256i nl = _mm256_set1_epi8('\n');
+  unsigned bits;
+
+  for (; e - p >= 32; p += 32) {
+    bits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)p), nl));
+    if (bits)
+      return p + __builtin_ctz(bits);
+  }
+  if (e - p >= 16) {
+    bits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p),
+                                            _mm256_castsi256_si128(nl)));
+    if (bits)
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return eol_scalar(p, e);
+}
+
+__attribute__((target("avx2")))
+static const char *delim_avx2(const char *p, const char *e, int colon)
+{
+  const __m256i sp = _mm256_set1_epi8(0x20), del = _mm256_set1_epi8(0x7f);
+  const __m256i col = _mm256_set1_epi8(colon ? ':' : 0x7f);
+  __m256i x, m;
+  __m128i y, n;
+  unsigned bits;
+
+  for (; e - p >= 32; p += 32) {
+    x = _mm256_loadu_si256((const __m256i *)p);
+    m = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(x, sp), x),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(x, del), _mm256_cmpeq_epi8(x, col)));
+    if ((bits = _mm256_movemask_epi8(m)))
+      return p + __builtin_ctz(bits);
+  }
+  if (e - p >= 16) {
+    y = _mm_loadu_si128((const __m128i *)p);
+    n = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(y, _mm256_castsi256_si128(sp)), y),
+                     _mm_or_si128(_mm_cmpeq_epi8(y, _mm256_castsi256_si128(del)),
+                                  _mm_cmpeq_epi8(y, _mm256_castsi256_si128(col))));
+    if ((bits = _mm_movemask_epi8(n)))
+      return p + __builtin_ctz(bits);
+    p += 16;
+  }
+  return delim_scalar(p, e, colon);
+}
+#endif
+
+/* 프로그램이 시작할 때 (main 전, 스레드가 생기기 전에) 한 번만 CPU 를 보고 구현을 고름.
+   그 뒤로 eol_fn, delim_fn 은 scan_set_level (벤치마크) 만 바꿈 */
+static const char *(*eol_fn)(const char *, const char *) = eol_scalar;
+static const char *(*delim_fn)(const char *, const char *, int) = delim_scalar;
+static int cur_level = SCAN_SCALAR;
+
+__attribute__((constructor))
+static void pick(void)
+{
+  int level = SCAN_SCALAR;
+
+#ifdef SCAN_X86
+  __builtin_cpu_init();  /* constructor 에서는 직접 불러야 함 */
+  if (__builtin_cpu_supports("avx2"))
+    level = SCAN_AVX2;
+  else if (__builtin_cpu_supports("sse2"))
+    level = SCAN_SSE2;
+#endif
+  scan_set_level(level);
+}
+
+const char *scan_eol(const char *p, const char *e)
+{
+  return eol_fn(p, e);
+}
+
+const char *scan_delim(const char *p, const char *e, int colon)
+{
+  return delim_fn(p, e, colon);
+}
+
+int scan_level(void)
+{
+  return cur_level;
+}
+
+int scan_set_level(int level)
+{
+  switch (level) {
+  case SCAN_SCALAR:
+    eol_fn = eol_scalar;
+    delim_fn = delim_scalar;
+    break;
+#ifdef SCAN_X86
+  case SCAN_SSE2:
+    if (!__builtin_cpu_supports("sse2"))
+      return -1;
+    eol_fn = eol_sse2;
+    delim_fn = delim_sse2;
+    break;
+  case SCAN_AVX2:
+    if (!__builtin_cpu_supports("avx2"))
+      return -1;
+    eol_fn = eol_avx2;
+    delim_fn = delim_avx2;
+    break;
+#endif
+  default:
+    return -1;
+  }
+  cur_level = level;
+  return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * scan.h - HTTP 헤더의 구분 문자 찾기 (SIMD)
+ *
+ * 헤더 파싱에서 시간을 쓰는 곳은 한 바이트씩 줄 끝('\n')과 ':', 공백을 찾는
+ * 루프다. 여기서는 16바이트(SSE2)나 32바이트(AVX2)를 한 번에 비교해서 첫 위치를
+ * 찾는다. 어떤 구현을 쓸지는 프로그램이 시작할 때 CPU 를 보고 한 번 정하고,
+ * x86 이 아니면 한 바이트씩 보는 구현을 쓴다.
+ *
+ * 모두 [p, e) 안에서 찾고, 없으면 e 를 돌려준다.
+ */
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+/* 구현 (scan_level/scan_set_level) */
+#define SCAN_SCALAR 0
+#define SCAN_SSE2   1
+#define SCAN_AVX2   2
+
+/* 첫 '\n' */
+const char *scan_eol(const char *p, const char *e);
+
+/* 토큰의 끝: 첫 공백(SP/HT)이나 제어 문자(CR, LF 포함, DEL 까지).
+   colon 이면 ':' 에서도 멈춤 (헤더 이름의 끝) */
+const char *scan_delim(const char *p, const char *e, int colon);
+
+/* 지금 쓰는 구현 */
+int scan_level(void);
+
+/* 구현을 바꿈 (벤치마크에서 비교할 때만. 다른 스레드가 scan 중이면 안 됨). CPU 가 지원하지 않으면 -1 */
+int scan_set_level(int level);
+
+#endif /* __SCAN_H__ */
@@ -7,6 +7,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
@@ -25,9 +26,13 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 /* Default file permissions are DEF_MODE & ~DEF_UMASK */
 /* $begin createmasks */
@@ -51,6 +56,17 @@ typedef struct {
 } rio_t;
 /* $end rio_t */
 
+/* Persistent state for the header builder (Hdr) package */
+#define HDR_MAXIOV  32
+#define HDR_DYNSIZE 8192
+typedef struct {
+    struct iovec hdr_iov[HDR_MAXIOV]; /* Fragments in emission order */
+    int hdr_iovcnt;                   /* Fragments in use, -1 on overflow */
+    size_t hdr_len;                   /* Total bytes across all fragments */
+    size_t hdr_dynlen;                /* Bytes used in hdr_dyn */
+    char hdr_dyn[HDR_DYNSIZE];        /* Backing store for formatted fields */
+} hdr_t;
+
 /* External variables */
 extern int h_errno;    /* Defined by BIND for DNS errors */ 
 extern char **environ; /* Defined by libc */
@@ -59,6 +75,12 @@ extern char **environ; /* Defined by libc */
 #define	MAXLINE	 8192  /* Max text line length */
 #define MAXBUF   8192  /* Max I/O buffer size */
 #define LISTENQ  1024  /* Second argument to listen() */
+#define HE_MAXADDRS 16  /* Max addresses raced by open_clientfd */
+#define HE_DELAY_MS 250 /* Happy-eyeballs connection attempt delay */
+#define TFO_QLEN    256 /* Pending Fast Open requests on a listener */
+
+/* Flags for open_clientfd_ai and open_listenfd_flags */
+#define OPEN_TFO    0x1 /* TCP Fast Open */
 
 /* Our own error-handling functions */
 void unix_error(char *msg);
@@ -178,6 +200,7 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n);
 void rio_readinitb(rio_t *rp, int fd); 
 ssize_t	rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t	rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
+ssize_t	rio_fillb(rio_t *rp);
 
 /* Wrappers for Rio package */
 ssize_t Rio_readn(int fd, void *usrbuf, size_t n);
@@ -186,13 +209,33 @@ void Rio_readinitb(rio_t *rp, int fd);
 ssize_t Rio_readnb(rio_t *rp, void *usrbuf, size_t n);
 ssize_t Rio_readlineb(rio_t *rp, void *usrbuf, size_t maxlen);
 
+/* Hdr (header builder) package - gathers fragments for one writev */
+void hdr_init(hdr_t *hp);
+void hdr_add(hdr_t *hp, const void *buf, size_t n);
+void hdr_adds(hdr_t *hp, const char *s);
+void hdr_printf(hdr_t *hp, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+ssize_t hdr_writev(int fd, hdr_t *hp);
+#define hdr_static(hp, lit) hdr_add((hp), (lit), sizeof(lit) - 1)
+
+/* Wrappers for Hdr package */
+void Hdr_writev(int fd, hdr_t *hp);
+
 /* Reentrant protocol-independent client/server helpers */
 int open_clientfd(char *hostname, char *port);
+int open_clientfd_ai(struct addrinfo *listp, int timeout_ms, int flags);
+int he_order(struct addrinfo *listp, struct addrinfo **out);
 int open_listenfd(char *port);
+int open_listenfd_flags(char *port, int flags);
+
+/* Unix domain (AF_UNIX stream) client/server helpers */
+int open_unix_clientfd(char *path);
+int open_unix_listenfd(char *path);
 
 /* Wrappers for reentrant protocol-independent client/server helpers */
 int Open_clientfd(char *hostname, char *port);
 int Open_listenfd(char *port);
+int Open_unix_listenfd(char *path);
 
 
 #endif /* __CSAPP_H__ */
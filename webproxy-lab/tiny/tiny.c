@@ -47,13 +47,17 @@ int main(int argc, char **argv)
   struct sockaddr_storage clientaddr; // 클라이언트 주소 정보를 담는 구조체
 
   /* Check command line args */
-  if (argc != 2)  // 인자 개수가 2개가 아니면 (프로그램명 + 포트번호)
+  if (argc != 2)  // 인자 개수가 2개가 아니면 (프로그램명 + 포트번호 또는 소켓 경로)
   {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]); // 사용법 출력
+    fprintf(stderr, "usage: %s <port | /unix/socket/path>\n", argv[0]); // 사용법 출력
     exit(1); // 비정상 종료
   }
 
-  listenfd = Open_listenfd(argv[1]); // 포트 번호로 리스닝 소켓 생성
+  // '/'로 시작하면 같은 호스트의 프록시용 Unix 도메인 소켓, 아니면 TCP 포트
+  if (argv[1][0] == '/')
+    listenfd = Open_unix_listenfd(argv[1]);
+  else
+    listenfd = Open_listenfd(argv[1]); // 포트 번호로 리스닝 소켓 생성
 
   while (1) // 무한 루프: 클라이언트 요청을 계속 처리
   {
@@ -61,7 +65,11 @@ int main(int argc, char **argv)
     connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen); 
     // 클라이언트 연결 요청 수락 → 연결된 소켓 connfd 리턴
 
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
+    if (clientaddr.ss_family == AF_UNIX) {  // Unix 소켓 클라이언트는 주소가 없음
+      strcpy(hostname, "unix");
+      strcpy(port, argv[1]);
+    } else
+      Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
     // 클라이언트 주소 정보를 사람이 읽을 수 있는 문자열로 변환
 
     printf("Accepted connection from (%s, %s)\n", hostname, port); 
@@ -155,31 +163,28 @@ void doit(int fd)
 	3.	HTML 본문을 클라이언트에게 전송하는 구조*/
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg, char *longmsg)
 {
-  char buf[MAXLINE], body[MAXBUF]; // 응답 헤더(buf)와 응답 본문(body)를 담을 버퍼
-
-  // 응답 본문(HTML) 구성 시작
-
-  sprintf(body, "<html><title>Tiny Error</title>"); // HTML 문서의 제목
-  sprintf(body, "%s<body bgcolor=\"ffffff\">\r\n", body); // 배경색 지정 (오타: bacolor → bgcolor)
-
-  sprintf(body, "%s%s : %s\r\n", body, errnum, shortmsg); // 상태 코드 및 간단한 설명
-  sprintf(body, "%s<p>%s : %s\r\n", body, longmsg, cause); // 자세한 설명과 원인
-  sprintf(body, "%s<hr><em>The Tiny Web server</em>\r\n", body); // 서버 정보 푸터
-
-  // HTTP 응답 헤더 전송
-
-  sprintf(buf, "HTTP/1.0 %s %s\r\n", errnum, shortmsg); // 상태 줄 생성 (예: HTTP/1.0 404 Not found)
-  Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 상태 줄 전송
-
-  sprintf(buf, "Content-type: text/html\r\n"); // MIME 타입 명시 (HTML)
-  Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 전송
-
-  sprintf(buf, "Content-length: %d\r\n\r\n", (int)strlen(body)); // 본문 길이 명시 + 헤더 종료
-  Rio_writen(fd, buf, strlen(buf)); // 클라이언트에게 전송
-
-  // HTML 본문 전송
-
-  Rio_writen(fd, body, strlen(body)); // 클라이언트에게 본문(HTML) 전송
+  char body[MAXBUF]; // 응답 본문(HTML)을 담을 버퍼
+  int bodylen;
+  hdr_t hdr;         // 상태 줄 + 헤더 + 본문 조각 모음
+
+  // 응답 본문(HTML) 구성: sprintf 누적 대신 snprintf 한 번으로
+  bodylen = snprintf(body, sizeof(body),
+                     "<html><title>Tiny Error</title>"       // HTML 문서의 제목
+                     "<body bgcolor=\"ffffff\">\r\n"         // 배경색 지정
+                     "%s : %s\r\n"                           // 상태 코드 및 간단한 설명
+                     "<p>%s : %s\r\n"                        // 자세한 설명과 원인
+                     "<hr><em>The Tiny Web server</em>\r\n", // 서버 정보 푸터
+                     errnum, shortmsg, longmsg, cause);
+  if (bodylen >= sizeof(body))
+    bodylen = sizeof(body) - 1;
+
+  // HTTP 응답 헤더 + HTML 본문을 writev 한 번으로 전송
+  hdr_init(&hdr);
+  hdr_printf(&hdr, "HTTP/1.0 %s %s\r\n", errnum, shortmsg); // 상태 줄 (예: HTTP/1.0 404 Not found)
+  hdr_static(&hdr, "Content-type: text/html\r\n");         // MIME 타입 명시 (HTML)
+  hdr_printf(&hdr, "Content-length: %d\r\n\r\n", bodylen); // 본문 길이 명시 + 헤더 종료
+  hdr_add(&hdr, body, bodylen);
+  Hdr_writev(fd, &hdr);
 }
 
 //헤더만 다 읽고 버리는 함수
@@ -187,15 +192,9 @@ void read_requesthdrs(rio_t *rp)
 {
   char buf[MAXLINE];  // 요청 헤더의 각 줄을 저장할 버퍼
 
-  Rio_readlineb(rp, buf, MAXLINE);  // 첫 번째 헤더 줄 읽기
-
-  // 빈 줄("\r\n")이 나올 때까지 반복해서 헤더를 계속 읽음
-  while (strcmp(buf, "\r\n")) {
-      Rio_readlineb(rp, buf, MAXLINE);  // 다음 줄 읽기
-      printf("%s", buf);                // 읽은 헤더 줄을 출력 (디버깅용)
-  }
-
-  return;  // 헤더를 모두 읽고 나면 함수 종료
+  // 빈 줄("\r\n")이 나올 때까지 반복해서 헤더를 계속 읽음 (클라이언트가 닫으면 그만)
+  while (Rio_readlineb(rp, buf, MAXLINE) > 0 && strcmp(buf, "\r\n"))
+    printf("%s", buf);  // 읽은 헤더 줄을 출력 (디버깅용)
 }
 
 //요청된 URI가 정적(static) 콘텐츠인지, 동적(dynamic, CGI) 콘텐츠인지 구분하고
@@ -237,37 +236,41 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 
 void serve_static(int fd, char *filename, int filesize, char *method)
 {
-    int srcfd;                      // 파일 디스크립터
+    int srcfd, i;                   // 파일 디스크립터, 로그 출력용 인덱스
     char *srcp, filetype[MAXLINE]; // 파일을 메모리에 매핑할 포인터, MIME 타입 저장용
-    char buf[MAXBUF];              // 응답 헤더 저장용 버퍼
+    hdr_t hdr;                     // 응답 헤더 + 본문 조각 모음
 
-     //1. 응답 헤더 생성 및 클라이언트에 전송
+     //1. 응답 헤더 생성
     
     get_filetype(filename, filetype);  // 파일 확장자 기반으로 MIME 타입 결정
 
-    // 상태 줄 + 헤더들 작성
-    sprintf(buf, "HTTP/1.0 200 OK\r\n");
-    sprintf(buf, "%sServer: Tiny Web Server\r\n", buf);
-    sprintf(buf, "%sConnection: close\r\n", buf);              // keep-alive X
-    sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);   // 응답 본문 크기
-    sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype); // MIME 타입 (ex. text/html)
+    // 상태 줄 + 헤더들 작성 (고정 헤더는 문자열 상수 그대로, 동적 값만 포맷)
+    hdr_init(&hdr);
+    hdr_static(&hdr, "HTTP/1.0 200 OK\r\n"
+                     "Server: Tiny Web Server\r\n"
+                     "Connection: close\r\n");                   // keep-alive X
+    hdr_printf(&hdr, "Content-length: %d\r\n", filesize);        // 응답 본문 크기
+    hdr_printf(&hdr, "Content-type: %s\r\n\r\n", filetype);     // MIME 타입 (ex. text/html)
 
-    Rio_writen(fd, buf, strlen(buf)); // 클라이언트에 헤더 전송
+    printf("Response headers:\n");    // 서버 로그 출력 (보낼 조각을 순서대로: 고정 헤더 + 포맷한 값)
+    for (i = 0; i < hdr.hdr_iovcnt; i++)
+      printf("%.*s", (int)hdr.hdr_iov[i].iov_len, (char *)hdr.hdr_iov[i].iov_base);
 
-    printf("Response headers:\n");    // 서버 로그 출력
-    printf("%s", buf);
+      //2. 파일 본문을 메모리에 매핑 후 헤더와 함께 writev 한 번으로 전송
 
-      //2. 파일 본문을 메모리에 매핑 후 클라이언트로 전송
+    // 연습문제 11.11: HEAD 요청이면 헤더만 전송
+    if (strcasecmp(method, "HEAD") == 0 || filesize == 0) {
+      Hdr_writev(fd, &hdr);
+      return;
+    }
 
     srcfd = Open(filename, O_RDONLY, 0); // 파일 열기 (읽기 전용)
     
-    // 파일을 메모리에 매핑 (mmap): 빠르게 전송하기 위해 메모리에 바로 매핑
+    // 파일을 메모리에 매핑 (mmap): 복사 없이 iovec에 바로 붙이기 위해
     srcp = Mmap(0, filesize, PROT_READ, MAP_PRIVATE, srcfd, 0);
     Close(srcfd); // 파일 디스크립터는 닫아도 mmap으로 접근 가능
-    // 연습문제 11.11
-    if (strcasecmp(method, "HEAD") != 0) {
-      Rio_writen(fd, srcp, filesize); // GET 요청일 때만 전송
-    }
+    hdr_add(&hdr, srcp, filesize);  // 본문은 매핑된 페이지를 그대로 참조
+    Hdr_writev(fd, &hdr);           // 헤더 + 본문을 한 번에 전송
     Munmap(srcp, filesize);         // 메모리 매핑 해제
 /*  
     csapp 숙제문제 11.9 
@@ -316,15 +319,12 @@ void get_filetype(char *filename, char *filetype)
 
 void serve_dynamic(int fd, char *filename, char *cgiargs)
 {
-  char buf[MAXLINE];                   // 응답 헤더 저장용 버퍼
+  static const char hdrs[] = "HTTP/1.0 200 OK\r\n"           // 상태 줄
+                             "Server: Tiny Web Server\r\n"; // 서버 정보 헤더
   char *emptylist[] = { NULL };        // 인자 없는 execve용 인자 리스트 (argv = NULL)
 
-  /*1. 클라이언트에게 HTTP 응답 헤더 전송 */
-  sprintf(buf, "HTTP/1.0 200 OK\r\n");
-  Rio_writen(fd, buf, strlen(buf));    // 상태 줄 전송
-
-  sprintf(buf, "Server: Tiny Web Server\r\n");
-  Rio_writen(fd, buf, strlen(buf));    // 서버 정보 헤더 전송
+  /*1. 클라이언트에게 HTTP 응답 헤더 전송 (미리 합쳐둔 상수를 write 한 번으로) */
+  Rio_writen(fd, (void *)hdrs, sizeof(hdrs) - 1);
 
   /*2. 자식 프로세스 생성하여 CGI 실행 */
   if (Fork() == 0) {  // 자식 프로세스라면
@@ -0,0 +1,567 @@
+/*
+ * tunnel.c - CONNECT 터널 중계 (epoll + splice)
+ *
+ * 터널마다 방향별로 파이프가 하나씩 있다.
+ *   client --splice--> pipe[0] --splice--> server
+ *   server --splice--> pipe[1] --splice--> client
+ * 이벤트가 오면 두 방향을 모두 할 수 있는 만큼 밀어 넣고, 파이프 상태에 맞춰
+ * epoll 관심 이벤트를 다시 맞춘다 (level-triggered).
+ *
+ * tunnel_connect 로 받은 터널은 중계 전에 연결 단계를 거친다.
+ *   1. 이름 해석: dns_lookup_async 의 콜백은 결과를 resolved 리스트에 넣고
+ *      eventfd 로 터널 스레드를 깨우기만 한다. 터널 상태는 터널 스레드만 바꾼다.
+ *   2. 연결: open_clientfd_ai 와 같은 happy eyeballs. he_order 로 섞은 주소에
+ *      HE_DELAY_MS 마다 (앞 시도가 실패하면 바로) non-blocking connect 를 하나씩
+ *      더 걸고, EPOLLOUT 으로 먼저 끝난 것을 쓴다.
+ *   3. 200 과 CONNECT 와 같이 읽힌 바이트는 파이프에 넣어 두고 보통 중계로 보낸다.
+ * 두 단계 모두 터널 리스트에 올라 있으므로 deadline (이름 해석 중에는
+ * dns_timeout_ms, 연결 중에는 upstream_connect_timeout_ms) 을 넘기면 정리 때 504.
+ * 그 사이 워커 스레드는 아무것도 기다리지 않는다.
+ */
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "tunnel.h"
+#include "conf.h"
+#include "dns.h"
+#include "zcopy.h"
+
+#define TUN_PIPE_CAP  (64 * 1024)   /* 기본 파이프 용량 */
+#define TUN_MAXEVENTS 64
+#define TUN_SWEEP_MS  1000          /* idle 터널 검사 주기 */
+
+typedef struct tunnel tunnel_t;
+
+/* 터널의 한쪽 끝 (epoll 등록 단위). 첫 필드는 tun_dial_t 와 같이 터널 */
+typedef struct {
+  tunnel_t *t;
+  int fd;
+  int rd_eof;          /* 이쪽에서 더 읽을 게 없음 */
+  int shut;            /* 반대편에 FIN(SHUT_WR) 전달 완료 */
+  int pipe_full;       /* 파이프 페이지가 꽉 차서 읽기를 잠시 멈춤 */
+  zc_pipe_t out;       /* 이쪽에서 읽어 반대편으로 보낼 바이트 */
+  unsigned int events; /* 현재 epoll 관심 이벤트 */
+} tun_end_t;
+
+/* 서버로의 연결 시도 하나 (epoll 등록 단위) */
+typedef struct {
+  tunnel_t *t;
+  int fd;              /* 끝났거나 시작 전이면 -1 */
+} tun_dial_t;
+
+struct tunnel {
+  tun_end_t end[2];    /* 0 = client, 1 = server */
+  long long last_active;
+  int dead;
+
+  /* tunnel_connect: 200 을 보내기 전 (end[1].fd 는 -1) */
+  int connecting;
+  int resolving;         /* dns 콜백을 기다리는 중. 콜백이 올 때까지 free 하지 않음 */
+  int dialing;           /* 연결 시도 중 (dialing 리스트에 있음) */
+  dns_ent_t *de;         /* 이름 해석 결과 (연결이 끝날 때까지 잡아둠) */
+  struct addrinfo *addrs[HE_MAXADDRS]; /* he_order 로 섞은 주소 */
+  tun_dial_t dial[HE_MAXADDRS];        /* addrs[i] 로의 연결 시도 */
+  int naddrs, ndialed;   /* 주소 수, 연결을 시작한 주소 수 */
+  int active;            /* 진행 중인 연결 시도 수 */
+  long long next_start;  /* 이때가 지나면 다음 주소도 시작 */
+  long long deadline;    /* 이때까지 연결이 안 되면 504 (0 이면 제한 없음) */
+  char *early;           /* CONNECT 와 같이 읽혀 버린 바이트 (연결되면 서버로) */
+  size_t nearly;
+
+  tunnel_t *prev, *next;   /* 전체 터널 리스트 */
+  tunnel_t *gnext;         /* 닫혔지만 아직 free 전인 터널 리스트 */
+  tunnel_t *rnext;         /* 이름 해석이 끝나 터널 스레드를 기다리는 리스트 */
+  tunnel_t *dprev, *dnext; /* 연결 시도 중인 터널 리스트 */
+};
+
+static int epfd = -1;
+static tunnel_t *tun_head;
+static int tun_count;
+static pthread_mutex_t tun_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* 이번 이벤트 묶음에서 닫힌 터널, 연결 시도 중인 터널. 터널 스레드만 만지므로 락 불필요 */
+static tunnel_t *graveyard;
+static tunnel_t *dialing;
+
+/* dns 콜백이 넘긴 터널 (tun_lock). 넣은 쪽은 wakefd 로 터널 스레드를 깨움 */
+static tunnel_t *resolved;
+static int wakefd = -1;
+
+static void tun_event(tun_end_t *e, unsigned int revents);
+
+static const char established[] = "HTTP/1.1 200 Connection Established\r\n\r\n";
+
+static void tun_link(tunnel_t *t)
+{
+  pthread_mutex_lock(&tun_lock);
+  t->next = tun_head;
+  if (tun_head)
+    tun_head->prev = t;
+  tun_head = t;
+  tun_count++;
+  pthread_mutex_unlock(&tun_lock);
+}
+
+static void tun_unlink(tunnel_t *t)
+{
+  pthread_mutex_lock(&tun_lock);
+  if (t->prev) t->prev->next = t->next; else tun_head = t->next;
+  if (t->next) t->next->prev = t->prev;
+  tun_count--;
+  pthread_mutex_unlock(&tun_lock);
+}
+
+/* 진행 중인 연결 시도를 모두 닫고 dialing 리스트에서 뺌 */
+static void tun_dial_stop(tunnel_t *t)
+{
+  int i;
+
+  if (!t->dialing)
+    return;
+  t->dialing = 0;
+  for (i = 0; i < t->ndialed; i++) {
+    if (t->dial[i].fd < 0)
+      continue;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, t->dial[i].fd, NULL);
+    close(t->dial[i].fd);
+    t->dial[i].fd = -1;
+  }
+  t->active = 0;
+  if (t->dprev) t->dprev->dnext = t->dnext; else dialing = t->dnext;
+  if (t->dnext) t->dnext->dprev = t->dprev;
+}
+
+/* fd와 파이프를 바로 닫고, 구조체는 이번 이벤트 묶음이 끝난 뒤 free
+   (이름 해석 중이면 dns 콜백이 온 뒤에) */
+static void tun_close(tunnel_t *t)
+{
+  int i;
+
+  if (t->dead)
+    return;
+  t->dead = 1;
+  tun_unlink(t);
+  tun_dial_stop(t);
+  for (i = 0; i < 2; i++) {
+    if (t->end[i].fd < 0)
+      continue;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, t->end[i].fd, NULL);
+    close(t->end[i].fd);
+    zc_pipe_close(&t->end[i].out);
+  }
+  if (t->early)
+    Free(t->early);
+  t->early = NULL;
+  if (t->resolving)
+    return;
+  if (t->de)
+    dns_release(t->de);
+  t->gnext = graveyard;
+  graveyard = t;
+}
+
+/* end[i] 에서 읽어 end[1-i] 로 보냄. 움직인 게 있으면 1, 에러면 -1 */
+static int pump(tunnel_t *t, int i)
+{
+  tun_end_t *src = &t->end[i], *dst = &t->end[1 - i];
+  ssize_t n;
+  int moved = 0;
+
+  while (1) {
+    if (src->out.held > 0) {
+      if ((n = zc_drain(&src->out, dst->fd)) < 0)
+        return -1;
+      if (n > 0) {
+        moved = 1;
+        src->pipe_full = 0;
+      }
+      if (src->out.held > 0)
+        break;  /* 반대편 소켓 버퍼가 가득 참 */
+    }
+    if (src->rd_eof || src->out.held >= TUN_PIPE_CAP)
+      break;
+    n = zc_fill(&src->out, src->fd, TUN_PIPE_CAP - src->out.held);
+    if (n == ZC_AGAIN) {
+      /* 파이프에 뭔가 남아 있는데 EAGAIN이면 소켓이 아니라 파이프가 찬 것 */
+      if (src->out.held > 0)
+        src->pipe_full = 1;
+      break;
+    }
+    if (n == ZC_EOF) {
+      src->rd_eof = 1;
+      break;
+    }
+    if (n < 0)
+      return -1;
+    moved = 1;
+  }
+
+  /* 한쪽이 보내기를 끝냈고 파이프도 비었으면 반대편에 FIN 전달 (half-close) */
+  if (src->rd_eof && src->out.held == 0 && !src->shut) {
+    shutdown(dst->fd, SHUT_WR);
+    src->shut = 1;
+  }
+  return moved;
+}
+
+/* 파이프 상태에 맞춰 epoll 관심 이벤트 갱신 */
+static void tun_rearm(tunnel_t *t)
+{
+  struct epoll_event ev;
+  tun_end_t *e;
+  unsigned int want;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    e = &t->end[i];
+    want = 0;
+    if (!e->rd_eof && !e->pipe_full && e->out.held < TUN_PIPE_CAP)
+      want |= EPOLLIN;
+    if (t->end[1 - i].out.held > 0)
+      want |= EPOLLOUT;
+    if (want != e->events) {
+      ev.events = want;
+      ev.data.ptr = e;
+      epoll_ctl(epfd, EPOLL_CTL_MOD, e->fd, &ev);
+      e->events = want;
+    }
+  }
+}
+
+/* 연결하지 못한 CONNECT 에 오류 응답 (닫는 건 호출자). 곧 닫을 연결이므로 소켓 버퍼에
+   들어가는 만큼만 보내고 기다리지 않음 */
+static void tun_reply_error(int fd, int timeout)
+{
+  static const char bad[] =
+    "HTTP/1.0 502 Bad Gateway\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+  static const char slow[] =
+    "HTTP/1.0 504 Gateway Timeout\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+  if (timeout)
+    send(fd, slow, sizeof(slow) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+  else
+    send(fd, bad, sizeof(bad) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* 연결된 터널: 파이프를 열고 두 소켓을 non-blocking 으로. 클라이언트에 보낼 200 과
+   서버에 보낼 early 바이트는 각 방향 파이프에 미리 넣어 두고 pump 가 보내게 함
+   성공 0, 실패 -1 (fd 는 호출자가 정리) */
+static int tun_start(tunnel_t *t)
+{
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (zc_pipe_open(&t->end[i].out) < 0)
+      return -1;
+    fcntl(t->end[i].fd, F_SETFL, fcntl(t->end[i].fd, F_GETFL) | O_NONBLOCK);
+  }
+  if (zc_put(&t->end[1].out, established, sizeof(established) - 1) < 0 ||
+      (t->nearly > 0 && zc_put(&t->end[0].out, t->early, t->nearly) < 0))
+    return -1;
+  t->last_active = msec_now();
+  return 0;
+}
+
+/* 두 끝을 읽기 이벤트로 epoll 에 등록 */
+static void tun_watch(tunnel_t *t)
+{
+  struct epoll_event ev;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    ev.events = t->end[i].events = EPOLLIN;
+    ev.data.ptr = &t->end[i];
+    epoll_ctl(epfd, EPOLL_CTL_ADD, t->end[i].fd, &ev);
+  }
+}
+
+/* 다음 주소로 non-blocking connect 를 하나 시작 (바로 실패한 주소는 건너뜀)
+   시작했으면 1, 남은 주소가 없으면 0 */
+static int tun_dial_next(tunnel_t *t)
+{
+  struct epoll_event ev;
+  struct addrinfo *p;
+  tun_dial_t *d;
+  int fd;
+
+  while (t->ndialed < t->naddrs) {
+    d = &t->dial[t->ndialed];
+    p = t->addrs[t->ndialed++];
+    if ((fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol)) < 0)
+      continue;
+    if (connect(fd, p->ai_addr, p->ai_addrlen) < 0 && errno != EINPROGRESS) {
+      close(fd);
+      continue;
+    }
+    d->fd = fd;
+    ev.events = EPOLLOUT;
+    ev.data.ptr = d;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    t->active++;
+    t->next_start = msec_now() + HE_DELAY_MS;
+    return 1;
+  }
+  return 0;
+}
+
+/* 이름 해석이 끝난 터널 (터널 스레드): 주소를 섞고 첫 연결 시도를 시작 */
+static void tun_dial_start(tunnel_t *t)
+{
+  dns_ent_t *e = t->de;
+  int i;
+
+  if (e->err) {
+    tun_reply_error(t->end[0].fd, e->err == EAI_AGAIN);
+    tun_close(t);
+    return;
+  }
+  t->naddrs = he_order(e->addrs, t->addrs);
+  for (i = 0; i < t->naddrs; i++) {
+    t->dial[i].t = t;
+    t->dial[i].fd = -1;
+  }
+  t->deadline = conf.upstream_connect_timeout_ms > 0 ? msec_now() + conf.upstream_connect_timeout_ms : 0;
+  t->dialing = 1;
+  t->dprev = NULL;
+  t->dnext = dialing;
+  if (dialing)
+    dialing->dprev = t;
+  dialing = t;
+  if (!tun_dial_next(t)) {
+    tun_reply_error(t->end[0].fd, 0);
+    tun_close(t);
+  }
+}
+
+/* dns_lookup_async 콜백 (resolver 스레드, 캐시 히트면 tunnel_connect 를 부른 스레드)
+   터널은 건드리지 않고 터널 스레드에 넘기기만 함 */
+static void tun_resolved(void *arg, dns_ent_t *e)
+{
+  tunnel_t *t = arg;
+  uint64_t one = 1;
+
+  pthread_mutex_lock(&tun_lock);
+  t->de = e;
+  t->rnext = resolved;
+  resolved = t;
+  pthread_mutex_unlock(&tun_lock);
+  if (write(wakefd, &one, sizeof(one)) < 0)
+    ;  /* 카운터가 넘칠 일은 없음. 이미 깨어 있으면 그걸로 충분 */
+}
+
+/* wakefd 이벤트: 이름 해석이 끝난 터널들의 연결 시작 (그 사이 닫혔으면 여기서 free) */
+static void tun_take_resolved(void)
+{
+  tunnel_t *t, *next;
+  uint64_t n;
+
+  if (read(wakefd, &n, sizeof(n)) < 0)
+    ;  /* EAGAIN: 다른 이벤트 묶음에서 이미 비움 */
+  pthread_mutex_lock(&tun_lock);
+  t = resolved;
+  resolved = NULL;
+  pthread_mutex_unlock(&tun_lock);
+  for (; t; t = next) {
+    next = t->rnext;
+    t->resolving = 0;
+    if (t->dead) {
+      dns_release(t->de);
+      t->gnext = graveyard;
+      graveyard = t;
+      continue;
+    }
+    tun_dial_start(t);
+  }
+}
+
+/* 연결 시도 하나가 끝남: 성공이면 나머지를 취소하고 터널로, 실패면 (다른 시도가 없을 때) 다음 주소 */
+static void tun_dial_event(tun_dial_t *d)
+{
+  tunnel_t *t = d->t;
+  socklen_t len = sizeof(int);
+  int fd = d->fd, err = 0;
+
+  if (fd < 0)
+    return;  /* 같은 이벤트 묶음에서 이미 정리한 시도 */
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  d->fd = -1;
+  t->active--;
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+    err = errno;
+  if (err) {
+    close(fd);
+    if (t->active == 0 && !tun_dial_next(t)) {
+      tun_reply_error(t->end[0].fd, 0);
+      tun_close(t);
+    }
+    return;
+  }
+
+  /* 연결됨: 늦은 시도들은 닫고, 200 과 미리 읽힌 바이트를 파이프에 넣은 뒤 중계 시작 */
+  tun_dial_stop(t);
+  t->connecting = 0;
+  t->end[1].fd = fd;
+  if (tun_start(t) < 0) {
+    tun_close(t);
+    return;
+  }
+  dns_release(t->de);
+  t->de = NULL;
+  if (t->early)
+    Free(t->early);
+  t->early = NULL;
+  tun_watch(t);
+  tun_event(&t->end[0], 0);
+}
+
+/* happy eyeballs: HE_DELAY_MS 가 지난 터널은 다음 주소도 시작. 다음 시작까지 남은 ms 를 돌려줌 */
+static int tun_dial_timers(int wait)
+{
+  long long now = msec_now();
+  tunnel_t *t;
+
+  for (t = dialing; t; t = t->dnext) {
+    if (t->ndialed >= t->naddrs)
+      continue;
+    if (now >= t->next_start)
+      tun_dial_next(t);
+    if (t->ndialed < t->naddrs && t->next_start - now < wait)
+      wait = t->next_start > now ? (int)(t->next_start - now) : 0;
+  }
+  return wait;
+}
+
+static void tun_event(tun_end_t *e, unsigned int revents)
+{
+  tunnel_t *t = e->t;
+  int a, b;
+
+  if (t->dead)
+    return;
+  a = pump(t, 0);
+  b = pump(t, 1);
+
+  /* ERR/HUP 은 관심 이벤트와 상관없이 계속 올라오므로, 한 번 밀어낸 뒤 정리 */
+  if (a < 0 || b < 0 || (revents & (EPOLLERR | EPOLLHUP)) ||
+      (t->end[0].shut && t->end[1].shut)) {
+    tun_close(t);
+    return;
+  }
+  if (a > 0 || b > 0)
+    t->last_active = msec_now();
+  tun_rearm(t);
+}
+
+/* 오래 놀고 있는 터널 정리 */
+static void tun_sweep(void)
+{
+  tunnel_t *t, *next;
+  long long now = msec_now();
+
+  pthread_mutex_lock(&tun_lock);
+  t = tun_head;
+  pthread_mutex_unlock(&tun_lock);
+  for (; t; t = next) {
+    pthread_mutex_lock(&tun_lock);
+    next = t->next;
+    pthread_mutex_unlock(&tun_lock);
+    if (t->connecting) {
+      if (t->deadline > 0 && now >= t->deadline) {
+        tun_reply_error(t->end[0].fd, 1);
+        tun_close(t);
+      }
+    } else if (conf.tunnel_idle_timeout_ms > 0 && now - t->last_active >= conf.tunnel_idle_timeout_ms) {
+      tun_close(t);
+    }
+  }
+}
+
+static void *tunnel_thread(void *vargp)
+{
+  struct epoll_event evs[TUN_MAXEVENTS];
+  long long last_sweep = msec_now();
+  tunnel_t *t;
+  void *ptr;
+  int i, n;
+
+  Pthread_detach(pthread_self());
+  while (1) {
+    n = epoll_wait(epfd, evs, TUN_MAXEVENTS, tun_dial_timers(TUN_SWEEP_MS));
+    if (n < 0 && errno != EINTR)
+      unix_error("epoll_wait error");
+
+    for (i = 0; i < n; i++) {
+      if ((ptr = evs[i].data.ptr) == NULL) {
+        tun_take_resolved();
+        continue;
+      }
+      /* tun_end_t 와 tun_dial_t 모두 첫 필드가 터널 */
+      t = *(tunnel_t **)ptr;
+      if (t->dead)
+        continue;
+      if (ptr == &t->end[0] || ptr == &t->end[1])
+        tun_event(ptr, evs[i].events);
+      else
+        tun_dial_event(ptr);
+    }
+    if (msec_now() - last_sweep >= TUN_SWEEP_MS) {
+      tun_sweep();
+      last_sweep = msec_now();
+    }
+
+    /* 같은 묶음 안에 같은 터널 이벤트가 여러 개 있을 수 있으므로 마지막에 free */
+    while (graveyard) {
+      t = graveyard;
+      graveyard = t->gnext;
+      Free(t);
+    }
+  }
+  return NULL;
+}
+
+void tunnel_init(void)
+{
+  struct epoll_event ev;
+  pthread_t tid;
+
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create1 error");
+  if ((wakefd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+    unix_error("eventfd error");
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+  Pthread_create(&tid, NULL, tunnel_thread, NULL);
+}
+
+void tunnel_connect(int clientfd, rio_t *crio, const char *host, const char *port)
+{
+  tunnel_t *t = Calloc(1, sizeof(tunnel_t));
+
+  t->end[0].t = t->end[1].t = t;
+  t->end[0].fd = clientfd;
+  t->end[1].fd = -1;
+  t->end[0].out.rd = t->end[0].out.wr = t->end[1].out.rd = t->end[1].out.wr = -1;
+  t->connecting = t->resolving = 1;
+  if (crio->rio_cnt > 0) {
+    t->early = Malloc(crio->rio_cnt);
+    memcpy(t->early, crio->rio_bufptr, crio->rio_cnt);
+    t->nearly = crio->rio_cnt;
+    crio->rio_cnt = 0;
+  }
+  /* 이름 해석도 dns_timeout_ms 를 넘기면 정리 때 504 (워커의 dns_lookup 과 같은 한도) */
+  t->last_active = msec_now();
+  if (conf.dns_timeout_ms > 0)
+    t->deadline = t->last_active + conf.dns_timeout_ms;
+  tun_link(t);
+  dns_lookup_async(host, port, tun_resolved, t);
+}
+
+int tunnel_count(void)
+{
+  int n;
+
+  pthread_mutex_lock(&tun_lock);
+  n = tun_count;
+  pthread_mutex_unlock(&tun_lock);
+  return n;
+}
@@ -0,0 +1,27 @@
+/*
+ * tunnel.h - CONNECT 터널 중계
+ *
+ * CONNECT 의 연결과 "200 Connection Established" 를 보낸 뒤의 양방향 바이트
+ * 중계는 워커 스레드가 아니라 epoll 스레드 하나가 모든 터널을 맡는다. 바이트는
+ * splice 로 소켓 → 파이프 → 소켓으로만 움직이므로 user space 로 복사되지
+ * 않는다. 놀고 있는 터널은 스레드를 차지하지 않고, 터널 구조체 하나와
+ * 빈 파이프 두 개만큼의 고정 비용만 든다.
+ */
+#ifndef __TUNNEL_H__
+#define __TUNNEL_H__
+
+#include "csapp.h"
+
+void tunnel_init(void);
+
+/* CONNECT host:port 를 워커 스레드를 잡지 않고 처리: 이름 해석은 dns_lookup_async,
+   연결은 터널 스레드의 epoll 에서 non-blocking happy eyeballs 로. 연결되면 clientfd 에
+   "200 Connection Established" 를 보내고 중계를 시작하고, 실패하면 502 (이름 해석이
+   dns_timeout_ms, 연결이 upstream_connect_timeout_ms 를 넘으면 504. 정리 주기만큼
+   늦을 수 있음) 를 보내고 닫는다. clientfd 와 crio 에 남은 바이트는 넘겨받는다 */
+void tunnel_connect(int clientfd, rio_t *crio, const char *host, const char *port);
+
+/* 현재 열려 있는 터널 수 */
+int tunnel_count(void);
+
+#endif /* __TUNNEL_H__ */
@@ -0,0 +1,167 @@
+/*
+ * zcopy.c - splice(2) 기반 zero-copy 전송
+ */
+#define _GNU_SOURCE  /* splice, pipe2 */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "zcopy.h"
+
+#define ZC_CHUNK (64 * 1024)   /* 기본 파이프 용량 */
+
+int zc_pipe_open(zc_pipe_t *zp)
+{
+  int p[2];
+
+  if (pipe2(p, O_CLOEXEC | O_NONBLOCK) < 0)
+    return -1;
+  zp->rd = p[0];
+  zp->wr = p[1];
+  zp->held = 0;
+  return 0;
+}
+
+void zc_pipe_close(zc_pipe_t *zp)
+{
+  if (zp->rd >= 0)
+    close(zp->rd);
+  if (zp->wr >= 0)
+    close(zp->wr);
+  zp->rd = zp->wr = -1;
+  zp->held = 0;
+}
+
+static ssize_t fill(zc_pipe_t *zp, int src, size_t max, unsigned int flags)
+{
+  ssize_t n;
+
+  if (max > ZC_CHUNK)
+    max = ZC_CHUNK;
+  while ((n = splice(src, NULL, zp->wr, NULL, max, flags)) < 0 && errno == EINTR)
+    ;
+  if (n > 0) {
+    zp->held += n;
+    return n;
+  }
+  if (n == 0)
+    return ZC_EOF;
+  if (errno == EAGAIN || errno == EWOULDBLOCK)
+    return ZC_AGAIN;
+  if (errno == EINVAL || errno == ENOSYS)
+    return ZC_UNSUPPORTED;
+  return ZC_ERROR;
+}
+
+ssize_t zc_fill(zc_pipe_t *zp, int src, size_t max)
+{
+  return fill(zp, src, max, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+}
+
+static ssize_t drain(zc_pipe_t *zp, int dst, unsigned int flags)
+{
+  ssize_t n;
+
+  if (zp->held == 0)
+    return 0;
+  while ((n = splice(zp->rd, NULL, dst, NULL, zp->held, flags)) < 0 && errno == EINTR)
+    ;
+  if (n > 0) {
+    zp->held -= n;
+    return n;
+  }
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return 0;
+  return ZC_ERROR;
+}
+
+ssize_t zc_drain(zc_pipe_t *zp, int dst)
+{
+  return drain(zp, dst, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+}
+
+int zc_put(zc_pipe_t *zp, const void *buf, size_t n)
+{
+  ssize_t k;
+
+  while ((k = write(zp->wr, buf, n)) < 0 && errno == EINTR)
+    ;
+  if (k < 0 || (size_t)k != n)
+    return ZC_ERROR;  /* 일부만 들어갔으면 이어 쓸 방법이 없으므로 실패로 */
+  zp->held += k;
+  return 0;
+}
+
+/* AF_UNIX 소켓은 파이프가 non-blocking 이면 소켓이 blocking 이어도 EAGAIN 을 돌려줌.
+   그때는 소켓의 SO_RCVTIMEO 만큼 poll 로 기다림. 데이터가 오면 0, 시간이 지나면 -1 */
+static int wait_readable(int fd)
+{
+  struct timeval tv = { 0, 0 };
+  socklen_t len = sizeof(tv);
+  struct pollfd pfd = { .fd = fd, .events = POLLIN };
+  int ms = -1, n;
+
+  if (getsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, &len) == 0 && (tv.tv_sec || tv.tv_usec))
+    ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  while ((n = poll(&pfd, 1, ms)) < 0 && errno == EINTR)
+    ;
+  return n > 0 ? 0 : -1;
+}
+
+/* 쓰기 쪽: zc_copy 는 파이프 → 소켓을 non-blocking 으로 옮기고 소켓 버퍼가 차 있으면
+   소켓의 SO_SNDTIMEO 만큼 poll 로 기다림. 자리가 나면 0, 시간이 지나면 -1 (errno = EAGAIN) */
+static int wait_writable(int fd)
+{
+  struct timeval tv = { 0, 0 };
+  socklen_t len = sizeof(tv);
+  struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+  int ms = -1, n;
+
+  if (getsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, &len) == 0 && (tv.tv_sec || tv.tv_usec))
+    ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+  while ((n = poll(&pfd, 1, ms)) < 0 && errno == EINTR)
+    ;
+  if (n == 0)
+    errno = EAGAIN;
+  return n > 0 ? 0 : -1;
+}
+
+/* blocking 소켓 기준. 소켓 쪽은 데이터가 올 때까지 기다리고,
+   파이프는 매번 다 비우므로 막히지 않는다. dst 가 SO_SNDTIMEO 동안 한 바이트도
+   받지 않으면 ZC_ERROR (errno = EAGAIN) */
+int zc_copy(int src, int dst, long long n)
+{
+  zc_pipe_t zp;
+  ssize_t k;
+  int moved = 0;
+
+  if (zc_pipe_open(&zp) < 0)
+    return ZC_UNSUPPORTED;
+  while (n > 0) {
+    k = fill(&zp, src, n < ZC_CHUNK ? (size_t)n : ZC_CHUNK,
+             SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (k == ZC_AGAIN && wait_readable(src) == 0)
+      continue;
+    if (k == ZC_UNSUPPORTED && moved)
+      k = ZC_ERROR;
+    if (k <= 0) {
+      zc_pipe_close(&zp);
+      return k == ZC_EOF ? ZC_ERROR : (int)k;
+    }
+    moved = 1;
+    n -= k;
+    while (zp.held > 0) {
+      k = drain(&zp, dst, SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
+      if (k < 0 || (k == 0 && wait_writable(dst) < 0)) {
+        k = errno;  /* close 가 errno 를 덮지 않도록 */
+        zc_pipe_close(&zp);
+        errno = k;
+        return ZC_ERROR;
+      }
+    }
+  }
+  zc_pipe_close(&zp);
+  return 0;
+}
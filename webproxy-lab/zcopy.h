@@ -0,0 +1,38 @@
+/*
+ * zcopy.h - splice(2) 기반 zero-copy 전송
+ *
+ * 소켓 → 파이프 → 소켓으로 바이트를 커널 안에서만 옮긴다. 파이프 하나가
+ * 한 방향의 중간 버퍼 역할을 하고, held 는 파이프에 들어 있는 바이트 수다.
+ *
+ * splice 선언에 _GNU_SOURCE 가 필요한데 csapp.h 의 gai_error 와 충돌하므로
+ * 이 모듈은 csapp.h 없이 따로 컴파일한다.
+ */
+#ifndef __ZCOPY_H__
+#define __ZCOPY_H__
+
+#include <sys/types.h>
+
+#define ZC_EOF          0    /* 소스가 닫힘 */
+#define ZC_ERROR       -1    /* errno 참고 */
+#define ZC_UNSUPPORTED -2    /* 이 fd 조합은 splice 불가 → 일반 read/write로 */
+#define ZC_AGAIN       -3    /* non-blocking: 지금은 옮길 게 없음 */
+
+typedef struct {
+  int rd, wr;      /* 파이프 양 끝 */
+  size_t held;     /* 파이프에 남아 있는 바이트 */
+} zc_pipe_t;
+
+int zc_pipe_open(zc_pipe_t *zp);
+void zc_pipe_close(zc_pipe_t *zp);
+
+/* src → 파이프로 최대 max 바이트 (non-blocking). 옮긴 바이트 수 또는 ZC_* */
+ssize_t zc_fill(zc_pipe_t *zp, int src, size_t max);
+/* 파이프 → dst 로 가능한 만큼 (non-blocking). 옮긴 바이트 수(0 가능) 또는 ZC_ERROR */
+ssize_t zc_drain(zc_pipe_t *zp, int dst);
+/* 메모리 → 파이프 (non-blocking). 다 넣었으면 0, 파이프에 자리가 모자라거나 에러면 ZC_ERROR */
+int zc_put(zc_pipe_t *zp, const void *buf, size_t n);
+
+/* blocking fd 끼리 정확히 n 바이트 옮김. 0 성공, ZC_* 실패 */
+int zc_copy(int src, int dst, long long n);
+
+#endif /* __ZCOPY_H__ */